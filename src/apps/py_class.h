@@ -20,6 +20,9 @@ namespace py = pybind11;
 using namespace py::literals;
 using PyFloatArr = py::array_t<float>;
 using PyUIntArr = py::array_t<uint>;
+// contiguous arrays that can be borrowed without copying (converted only if the dtype differs)
+using PyDenseFloatArr = py::array_t<float, py::array::c_style | py::array::forcecast>;
+using PyDenseUIntArr = py::array_t<uint, py::array::c_style | py::array::forcecast>;
 
 template <typename T>
 luisa::vector<T> pyarray_to_vector(const py::array_t<T> &array) noexcept {
@@ -28,6 +31,11 @@ luisa::vector<T> pyarray_to_vector(const py::array_t<T> &array) noexcept {
     return v;
 }
 
+template <typename T, int Flags>
+luisa::span<const T> pyarray_to_span(const py::array_t<T, Flags> &array) noexcept {
+    return {array.data(), static_cast<size_t>(array.size())};
+}
+
 template <typename T>
 py::array_t<T> get_default_array(const luisa::vector<T> &a) {
     auto buffer_info = py::buffer_info{
@@ -303,7 +311,8 @@ struct PyShape {
 
     static PyShape deformable(
         std::string_view name,
-        std::string_view surface, std::string_view emission, float clamp_normal
+        std::string_view surface, std::string_view emission, float clamp_normal,
+        bool refit
     ) noexcept {
         PyShape shape(
             luisa::string(name), RawTransformInfo(),
@@ -316,19 +325,20 @@ struct PyShape {
             luisa::vector<float>(),
             true
         );
+        shape.shape_info.mesh_info->refit = refit;
         return shape;
     }
 
     static PyShape particles(
         std::string_view name, float radius, uint subdivision,
-        std::string_view surface, std::string_view emission
+        std::string_view surface, std::string_view emission, bool procedural
     ) noexcept {
         PyShape shape(
             luisa::string(name), RawTransformInfo(),
             luisa::string(surface), luisa::string(emission), "", -1.f
         );
         shape.shape_info.build_spheres(
-            luisa::vector<float>(), radius, subdivision
+            luisa::vector<float>(), radius, subdivision, procedural
         );
         return shape;
     }
@@ -4,6 +4,8 @@
 #include <string>
 
 #include <luisa/backends/ext/denoiser_ext.h>
+#include <luisa/dsl/sugar.h>
+#include <pybind11/stl.h>
 #include <base/scene.h>
 #include <base/pipeline.h>
 #include <apps/app_base.h>
@@ -17,12 +19,19 @@ struct CameraStorage {
     CameraStorage(uint index, Device* device, uint pixel_count) noexcept:
         index{index},
         hdr_buffer{device->create_buffer<float>(pixel_count)},
-        denoised_buffer{device->create_buffer<float>(pixel_count)} {} 
+        denoised_buffer{device->create_buffer<float>(pixel_count)},
+        ldr_buffer{device->create_buffer<float>(pixel_count)},
+        rgba8_buffer{device->create_buffer<uint>(pixel_count / 4u)} {} 
     uint index;
     Buffer<float> hdr_buffer;
     Buffer<float> denoised_buffer;
+    Buffer<float> ldr_buffer;
+    Buffer<uint> rgba8_buffer;
 };
 
+using GammaShader = Shader1D<Buffer<float>, Buffer<float>>;
+using QuantizeShader = Shader1D<Buffer<float>, Buffer<uint>>;
+
 luisa::unique_ptr<Stream> stream;
 luisa::unique_ptr<Device> device;
 luisa::unique_ptr<Context> context;
@@ -33,6 +42,31 @@ luisa::unique_ptr<Pipeline> pipeline;
 luisa::unique_ptr<Scene> scene;
 luisa::unordered_map<luisa::string, luisa::unique_ptr<CameraStorage>> camera_storage;
 luisa::string context_storage;
+luisa::unique_ptr<GammaShader> gamma_shader;
+luisa::unique_ptr<QuantizeShader> quantize_shader;
+/* Packed images of render_cameras(), grown on demand */
+Buffer<float> batch_hdr_buffer;
+Buffer<float> batch_ldr_buffer;
+
+/* Same encoding as apply_gamma() and convert_to_int_pixel(), but on the device */
+void compile_tonemap_shaders() noexcept {
+    static constexpr auto inv_gamma = 1.f / 2.2f;
+    Kernel1D gamma_kernel = [](BufferFloat hdr, BufferFloat ldr) noexcept {
+        auto i = dispatch_x();
+        auto c = hdr.read(i);
+        ldr.write(i, ite(i % 4u == 3u, c, clamp(pow(max(c, 0.f), inv_gamma), 0.f, 1.f)));
+    };
+    Kernel1D quantize_kernel = [](BufferFloat hdr, BufferUInt rgba8) noexcept {
+        auto i = dispatch_x();
+        auto rgb = make_float3(hdr.read(i * 4u + 0u), hdr.read(i * 4u + 1u), hdr.read(i * 4u + 2u));
+        auto alpha = hdr.read(i * 4u + 3u);
+        auto c = clamp(make_float4(pow(max(rgb, 0.f), inv_gamma), alpha), 0.f, 1.f);
+        auto q = make_uint4(c * 255.f + .5f);
+        rgba8.write(i, q.x | (q.y << 8u) | (q.z << 16u) | (q.w << 24u));
+    };
+    gamma_shader = luisa::make_unique<GammaShader>(device->compile(gamma_kernel));
+    quantize_shader = luisa::make_unique<QuantizeShader>(device->compile(quantize_kernel));
+}
 
 void init(
     std::string_view context_path, uint cuda_device, LogLevel log_level,
@@ -70,6 +104,8 @@ void init(
 
     pipeline = Pipeline::create(*device, *stream, *scene);
     LUISA_INFO("Pipeline created!");   
+
+    compile_tonemap_shaders();
 }
 
 void add_environment(
@@ -135,6 +171,55 @@ void update_shape(const PyShape &shape) noexcept {
     auto shape_node = scene->update_shape(shape.shape_info);
 }
 
+/* Update an existing deformable mesh directly from numpy buffers, packing them into vertices in one pass */
+void update_deformable_arrays(
+    std::string_view name,
+    const PyDenseFloatArr &vertices, const PyDenseUIntArr &triangles,
+    const PyDenseFloatArr &normals, const PyDenseFloatArr &uvs
+) noexcept {
+    RawShapeInfo shape_info{luisa::string(name), RawTransformInfo(), -1.f, "", "", ""};
+    shape_info.build_mesh({}, {}, {}, {}, true);
+    shape_info.mesh_info->borrowed_view = RawMeshView{
+        pyarray_to_span(vertices), pyarray_to_span(triangles),
+        pyarray_to_span(normals), pyarray_to_span(uvs)
+    };
+    LUISA_VERBOSE("Update: {}", shape_info.get_info());
+    py::gil_scoped_release release;
+    if (scene->load_node_from_name(shape_info.name) == nullptr) [[unlikely]] {
+        LUISA_ERROR_WITH_LOCATION("Deformable mesh '{}' has not been added.", name);
+    }
+    auto shape_node = scene->update_shape(shape_info);
+}
+
+[[nodiscard]] CameraStorage *find_camera_storage(std::string_view name) noexcept {
+    auto camera_name = luisa::string(name);
+    auto it = camera_storage.find(camera_name);
+    if (it == camera_storage.end()) [[unlikely]] {
+        LUISA_ERROR_WITH_LOCATION("Failed to find camera name '{}'.", camera_name);
+    }
+    return it->second.get();
+}
+
+/* Render (and denoise) a camera into device memory, returns the buffer holding the linear image */
+[[nodiscard]] Buffer<float> &render_to_device(CameraStorage *camera_store, uint2 resolution, bool denoise) noexcept {
+    pipeline->render_to_buffer(*stream, camera_store->index, camera_store->hdr_buffer.view().as<float4>());
+    if (!denoise) { return camera_store->hdr_buffer; }
+    DenoiserExt::DenoiserInput data;
+    data.beauty = &camera_store->hdr_buffer;
+    denoiser_ext->init(*stream, *mode, data, resolution);
+    denoiser_ext->process(*stream, data);
+    denoiser_ext->get_result(*stream, camera_store->denoised_buffer);
+    return camera_store->denoised_buffer;
+}
+
+/* Must be called after the stream is synchronized */
+void finish_denoise(bool denoise) noexcept {
+    if (denoise) {
+        denoiser_ext->destroy(*stream);
+        stream->synchronize();
+    }
+}
+
 PyFloatArr render_frame(
     std::string_view name, std::string_view path,
     bool denoise, bool save_picture, bool render_png
@@ -142,62 +227,100 @@ PyFloatArr render_frame(
     LUISA_INFO("Start rendering camera {}, saving {}", name, save_picture);
     pipeline->scene_update(*stream, *scene, 0);
 
-    auto camera_name = luisa::string(name);
-    if (auto it = camera_storage.find(camera_name); it == camera_storage.end()) {
-        LUISA_ERROR_WITH_LOCATION("Failed to find camera name '{}'.", camera_name);
-    }
-    auto camera_store = camera_storage[camera_name].get();
-    auto idx = camera_store->index;
-    auto resolution = scene->cameras()[idx]->film()->resolution();
+    auto camera_store = find_camera_storage(name);
+    auto resolution = scene->cameras()[camera_store->index]->film()->resolution();
+    auto pixel_count = resolution.x * resolution.y;
     std::filesystem::path exr_path = path;
-    auto picture = pipeline->render_to_buffer(*stream, idx);
-    auto buffer = reinterpret_cast<float *>((*picture).data());
-    stream->synchronize();
+    auto &result_buffer = render_to_device(camera_store, resolution, denoise);
 
-    /* denoise image */
-    if (denoise) {
-        LUISA_INFO("Start denoising...");
-        if (save_picture) {
+    /* save linear images, only this debugging path reads them back */
+    if (save_picture) {
+        luisa::vector<float> pixels(pixel_count * 4u);
+        if (denoise) {
             std::filesystem::path origin_path(exr_path);
             origin_path.replace_filename(origin_path.stem().string() + "_ori" + origin_path.extension().string());
-            save_image(origin_path, buffer, resolution);
+            (*stream) << camera_store->hdr_buffer.copy_to(pixels.data()) << synchronize();
+            save_image(origin_path, pixels.data(), resolution);
         }
-
-        Buffer<float> &hdr_buffer = camera_store->hdr_buffer;
-        Buffer<float> &denoised_buffer = camera_store->denoised_buffer;
-        (*stream) << hdr_buffer.copy_from(buffer);
-        stream->synchronize();
-
-        DenoiserExt::DenoiserInput data;
-        data.beauty = &hdr_buffer;
-        denoiser_ext->init(*stream, *mode, data, resolution);
-        denoiser_ext->process(*stream, data);
-        denoiser_ext->get_result(*stream, denoised_buffer);
-        stream->synchronize();
-
-        (*stream) << denoised_buffer.copy_to(buffer);
-        stream->synchronize();
-        denoiser_ext->destroy(*stream);
-        stream->synchronize();
+        (*stream) << result_buffer.copy_to(pixels.data()) << synchronize();
+        save_image(exr_path, pixels.data(), resolution);
     }
 
-    /* save image */
-    if (save_picture) save_image(exr_path, buffer, resolution);
-
-    apply_gamma(buffer, resolution);
+    auto array_buffer = PyFloatArr(pixel_count * 4u);
+    (*stream) << (*gamma_shader)(result_buffer, camera_store->ldr_buffer).dispatch(pixel_count * 4u)
+              << camera_store->ldr_buffer.copy_to(array_buffer.mutable_data());
+    stream->synchronize();
+    finish_denoise(denoise);
 
     if (save_picture && render_png) {
         std::filesystem::path png_path = path;
         png_path.replace_extension(".png");
-        auto int_buffer = convert_to_int_pixel(buffer, resolution);
+        auto int_buffer = convert_to_int_pixel(array_buffer.data(), resolution);
         save_image(png_path, (*int_buffer).data(), resolution);
     }
+    return array_buffer;
+}
+
+/* Render several cameras at once, returns their gamma encoded images packed back to back */
+PyFloatArr render_cameras(const std::vector<std::string> &names) noexcept {
+    luisa::vector<uint> camera_indices;
+    camera_indices.reserve(names.size());
+    auto pixel_count = 0u;
+    for (auto &&name : names) {
+        auto camera_store = find_camera_storage(name);
+        auto resolution = scene->cameras()[camera_store->index]->film()->resolution();
+        camera_indices.emplace_back(camera_store->index);
+        pixel_count += resolution.x * resolution.y;
+    }
+    auto array_buffer = PyFloatArr(pixel_count * 4u);
+    if (pixel_count == 0u) { return array_buffer; }
+    auto data = array_buffer.mutable_data();
 
-    auto array_buffer = PyFloatArr(resolution.x * resolution.y * 4);
-    std::memcpy(array_buffer.mutable_data(), buffer, array_buffer.size() * sizeof(float));
+    py::gil_scoped_release release;
+    if (!batch_hdr_buffer || batch_hdr_buffer.size() < pixel_count * 4u) {
+        batch_hdr_buffer = device->create_buffer<float>(next_pow2(pixel_count) * 4u);
+        batch_ldr_buffer = device->create_buffer<float>(next_pow2(pixel_count) * 4u);
+    }
+    auto hdr_view = batch_hdr_buffer.view(0u, pixel_count * 4u);
+    auto ldr_view = batch_ldr_buffer.view(0u, pixel_count * 4u);
+    pipeline->scene_update(*stream, *scene, 0);
+    pipeline->render_to_buffer(*stream, camera_indices, hdr_view.as<float4>());
+    (*stream) << (*gamma_shader)(hdr_view, ldr_view).dispatch(pixel_count * 4u)
+              << ldr_view.copy_to(data);
+    stream->synchronize();
     return array_buffer;
 }
 
+/* Render into a caller-provided, reusable float32 (gamma encoded) or uint8 (RGBA8) array with a single download */
+void render_frame_into(std::string_view name, py::array &output, bool denoise) noexcept {
+    auto camera_store = find_camera_storage(name);
+    auto resolution = scene->cameras()[camera_store->index]->film()->resolution();
+    auto pixel_count = resolution.x * resolution.y;
+    auto is_uint8 = output.dtype().is(py::dtype::of<uint8_t>());
+    auto is_float = output.dtype().is(py::dtype::of<float>());
+    if (!(is_uint8 || is_float) || output.size() != pixel_count * 4u ||
+        !(output.flags() & py::array::c_style) || !output.writeable()) [[unlikely]] {
+        LUISA_ERROR_WITH_LOCATION(
+            "Output of camera '{}' must be a writeable C-contiguous "
+            "float32 or uint8 array of {}x{}x4 elements.",
+            name, resolution.y, resolution.x);
+    }
+    auto data = output.mutable_data();
+
+    py::gil_scoped_release release;
+    pipeline->scene_update(*stream, *scene, 0);
+    auto &result_buffer = render_to_device(camera_store, resolution, denoise);
+    if (is_uint8) {
+        (*stream) << (*quantize_shader)(result_buffer, camera_store->rgba8_buffer).dispatch(pixel_count)
+                  << camera_store->rgba8_buffer.copy_to(data);
+    } else {
+        (*stream) << (*gamma_shader)(result_buffer, camera_store->ldr_buffer).dispatch(pixel_count * 4u)
+                  << camera_store->ldr_buffer.copy_to(data);
+    }
+    stream->synchronize();
+    finish_denoise(denoise);
+}
+
 void destroy() {}
 
 PYBIND11_MODULE(LuisaRenderPy, m) {
@@ -272,14 +395,16 @@ PYBIND11_MODULE(LuisaRenderPy, m) {
             py::arg("name"),
             py::arg("surface") = "",
             py::arg("emission") = "",
-            py::arg("clamp_normal") = -1.f
+            py::arg("clamp_normal") = -1.f,
+            py::arg("refit") = false
         )
         .def_static("particles", &PyShape::particles,
             py::arg("name"),
             py::arg("radius"),
             py::arg("subdivision") = 0u,
             py::arg("surface") = "",
-            py::arg("emission") = ""
+            py::arg("emission") = "",
+            py::arg("procedural") = false
         )
         .def_static("plane", &PyShape::plane,
             py::arg("name"),
@@ -295,7 +420,7 @@ PYBIND11_MODULE(LuisaRenderPy, m) {
         )
         .def("update_deformable", &PyShape::update_deformable,
             py::arg("vertices"),
-            py::arg("triangles"),
+            py::arg("triangles") = PyUIntArr(),
             py::arg("normals") = PyFloatArr(),
             py::arg("uvs") = PyFloatArr()
         )
@@ -360,6 +485,13 @@ PYBIND11_MODULE(LuisaRenderPy, m) {
     m.def("update_shape", &update_shape,
         py::arg("shape")
     );
+    m.def("update_deformable_arrays", &update_deformable_arrays,
+        py::arg("name"),
+        py::arg("vertices"),
+        py::arg("triangles") = PyDenseUIntArr(),
+        py::arg("normals") = PyDenseFloatArr(),
+        py::arg("uvs") = PyDenseFloatArr()
+    );
     m.def("render_frame", &render_frame,
         py::arg("name"),
         py::arg("path") = "",
@@ -367,4 +499,12 @@ PYBIND11_MODULE(LuisaRenderPy, m) {
         py::arg("save_picture") = false,
         py::arg("render_png") = true
     );
+    m.def("render_cameras", &render_cameras,
+        py::arg("names")
+    );
+    m.def("render_frame_into", &render_frame_into,
+        py::arg("name"),
+        py::arg("output"),
+        py::arg("denoise") = true
+    );
 }
\ No newline at end of file
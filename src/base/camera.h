@@ -55,6 +55,11 @@ public:
                                       Expr<float2> u_lens,
                                       Expr<float> time) const noexcept = 0;
 
+    protected:
+        // for instances that forward to other cameras and own no film
+        Instance(const Pipeline &pipeline, const Camera *camera) noexcept
+            : _pipeline{&pipeline}, _camera{camera}, _filter{nullptr} {}
+
     public:
         Instance(Pipeline &pipeline, CommandBuffer &command_buffer, const Camera *camera) noexcept;
         Instance(const Instance &) noexcept = delete;
@@ -70,11 +75,11 @@ public:
         [[nodiscard]] auto film() const noexcept { return _film.get(); }
         [[nodiscard]] auto filter() noexcept { return _filter; }
         [[nodiscard]] auto filter() const noexcept { return _filter; }
-        [[nodiscard]] Sample generate_ray(Expr<uint2> pixel_coord, Expr<float> time,
-                                          Expr<float2> u_filter, Expr<float2> u_lens) const noexcept;
-        [[nodiscard]] SampleDifferential generate_ray_differential(Expr<uint2> pixel_coord, Expr<float> time,
-                                                                   Expr<float2> u_filter, Expr<float2> u_lens) const noexcept;
-        [[nodiscard]] Float4x4 camera_to_world() const noexcept;
+        [[nodiscard]] virtual Sample generate_ray(Expr<uint2> pixel_coord, Expr<float> time,
+                                                  Expr<float2> u_filter, Expr<float2> u_lens) const noexcept;
+        [[nodiscard]] virtual SampleDifferential generate_ray_differential(Expr<uint2> pixel_coord, Expr<float> time,
+                                                                           Expr<float2> u_filter, Expr<float2> u_lens) const noexcept;
+        [[nodiscard]] virtual Float4x4 camera_to_world() const noexcept;
     };
 
     struct ShutterPoint {
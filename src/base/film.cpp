@@ -25,6 +25,23 @@ bool Film::update_film(Scene *scene, const uint2 &resolution) noexcept {
     return false;
 }
 
+void Film::Instance::track_variance(CommandBuffer &command_buffer) noexcept {
+    if (!_variance_tracked) {
+        _variance_tracked = true;
+        _bump_generation();
+    }
+}
+
+void Film::Instance::_set_window(uint2 offset, uint2 size) noexcept {
+    auto resolution = node()->resolution();
+    LUISA_ASSERT(all(size > 0u) && all(offset + size <= resolution),
+                 "Invalid film window (offset = ({}, {}), size = {}x{}) "
+                 "for resolution {}x{}.",
+                 offset.x, offset.y, size.x, size.y, resolution.x, resolution.y);
+    _window_offset = offset;
+    _window_size = size;
+}
+
 void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb,
                                 Expr<float> effective_spp) const noexcept {
 #ifndef NDEBUG
@@ -36,4 +53,15 @@ void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb,
 #endif
 }
 
+void Film::Instance::accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb,
+                                          Expr<float> effective_spp) const noexcept {
+#ifndef NDEBUG
+    $if(all(pixel >= 0u && pixel < node()->resolution())) {
+#endif
+        _accumulate_exclusive(pixel, rgb, effective_spp);
+#ifndef NDEBUG
+    };
+#endif
+}
+
 }// namespace luisa::render
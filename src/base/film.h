@@ -4,17 +4,23 @@
 
 #pragma once
 
+#include <luisa/runtime/buffer.h>
 #include <util/spec.h>
 #include <base/scene_node.h>
 
 namespace luisa::render {
 
+using compute::BufferView;
+
 class Film : public SceneNode {
 
 public:
     struct Accumulation {
         Float3 average;
         Float sample_count;
+        // estimated variance of the luminance of the average, for adaptive sampling;
+        // zero unless the film tracks variance
+        Float variance;
     };
 
     class Instance {
@@ -22,10 +28,21 @@ public:
     private:
         const Pipeline &_pipeline;
         const Film *_film;
+        uint _generation{0u};
+        uint2 _window_offset;
+        uint2 _window_size;
+        bool _variance_tracked{false};
 
     protected:
+        // call when device storage captured by compiled kernels is reallocated
+        void _bump_generation() noexcept { _generation++; }
+        void _set_window(uint2 offset, uint2 size) noexcept;
         virtual void _accumulate(Expr<uint2> pixel, Expr<float3> rgb,
                                  Expr<float> effective_spp) const noexcept = 0;
+        virtual void _accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb,
+                                           Expr<float> effective_spp) const noexcept {
+            _accumulate(pixel, rgb, effective_spp);
+        }
 
     public:
         explicit Instance(const Pipeline &pipeline, const Film *film) noexcept
@@ -36,12 +53,28 @@ public:
             requires std::is_base_of_v<Film, T>
         [[nodiscard]] auto node() const noexcept { return static_cast<const T *>(_film); }
         [[nodiscard]] auto &pipeline() const noexcept { return _pipeline; }
+        [[nodiscard]] auto generation() const noexcept { return _generation; }
+        // the region of the film currently backed by device storage
+        [[nodiscard]] auto window_offset() const noexcept { return _window_offset; }
+        [[nodiscard]] auto window_size() const noexcept { return _window_size; }
         [[nodiscard]] virtual Accumulation read(Expr<uint2> pixel) const noexcept = 0;
+        // safe for any number of threads splatting to the same pixel
         void accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp = 1.f) const noexcept;
+        // without atomics; requires that no other thread touches the pixel during the dispatch
+        void accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp = 1.f) const noexcept;
         virtual void prepare(CommandBuffer &command_buffer) noexcept = 0;
+        // backs only a window of the film with storage, pixels keep their film coordinates
+        // and clear(), download() and read() operate on the window
+        virtual void prepare_window(CommandBuffer &command_buffer, uint2 offset, uint2 size) noexcept = 0;
         virtual void clear(CommandBuffer &command_buffer) noexcept = 0;
         virtual void download(CommandBuffer &command_buffer, float4 *framebuffer) const noexcept = 0;
+        // converts the accumulation into a device buffer, without a host round trip
+        virtual void download(CommandBuffer &command_buffer, BufferView<float4> framebuffer) const noexcept = 0;
         virtual void release() const noexcept = 0;
+        // the variance costs an extra accumulation per sample, so it is only tracked once
+        // requested; kernels splatting to the film must be recorded afterwards
+        virtual void track_variance(CommandBuffer &command_buffer) noexcept;
+        [[nodiscard]] auto tracks_variance() const noexcept { return _variance_tracked; }
     };
 
 private:
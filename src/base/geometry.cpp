@@ -21,14 +21,331 @@ void Geometry::build(
 ) noexcept {
     // TODO: AccelOption
     _accel = _pipeline.device().create_accel({});
-    for (auto i = 0u; i < 3u; ++i) {
-        _world_max[i] = -std::numeric_limits<float>::max();
-        _world_min[i] = std::numeric_limits<float>::max();
-    }
     for (auto shape : shapes) { _process_shape(command_buffer, shape, init_time); }
+    _update_world_bounds();
     _instance_buffer = _pipeline.device().create_buffer<uint4>(_instances.size());
-    command_buffer << _instance_buffer.copy_from(_instances.data())
-                   << _accel.build();
+    command_buffer << _instance_buffer.copy_from(_instances.data());
+    if (!_instanced_lights.empty()) {
+        _emission_buffer = _pipeline.device().create_buffer<uint2>(_emission_buffer_ids.size());
+        command_buffer << _emission_buffer.copy_from(_emission_buffer_ids.data());
+    }
+    if (!_dynamic_transforms.empty()) { _build_motion_groups(command_buffer, init_time); }
+    command_buffer << _accel.build();
+}
+
+namespace {
+// the kernel being recorded is thread-local in the DSL, and so is its bound shutter time
+thread_local const compute::Expression *bound_shutter_time{nullptr};
+}// namespace
+
+Geometry::ShutterTime::ShutterTime(Expr<float> time) noexcept
+    : _previous{std::exchange(bound_shutter_time, time.expression())} {}
+
+Geometry::ShutterTime::~ShutterTime() noexcept { bound_shutter_time = _previous; }
+
+Geometry::Bounds Geometry::Bounds::transformed(const float4x4 &m) const noexcept {
+    if (empty()) { return {}; }
+    Bounds bounds;
+    for (auto i = 0u; i < 8u; i++) {
+        auto corner = make_float3((i & 1u) ? max.x : min.x,
+                                  (i & 2u) ? max.y : min.y,
+                                  (i & 4u) ? max.z : min.z);
+        auto p = make_float3(m * make_float4(corner, 1.f));
+        bounds.min = luisa::min(bounds.min, p);
+        bounds.max = luisa::max(bounds.max, p);
+    }
+    return bounds;
+}
+
+// reduces the vertex positions in parallel chunks; the inner loop is a plain
+// float3 min/max that the compiler vectorizes
+[[nodiscard]] static auto mesh_bounds(luisa::span<const Vertex> vertices) noexcept {
+    constexpr auto chunk_size = 16384u;
+    auto chunk_bounds = [vertices](size_t begin, size_t end) noexcept {
+        Geometry::Bounds bounds;
+        for (auto i = begin; i < end; i++) {
+            auto p = vertices[i].position();
+            bounds.min = luisa::min(bounds.min, p);
+            bounds.max = luisa::max(bounds.max, p);
+        }
+        return bounds;
+    };
+    if (vertices.size() <= chunk_size) { return chunk_bounds(0u, vertices.size()); }
+    // waits on its own chunks only, not on everything else queued in the pool
+    auto chunk_count = (vertices.size() + chunk_size - 1u) / chunk_size;
+    luisa::vector<std::shared_future<Geometry::Bounds>> partial;
+    partial.reserve(chunk_count - 1u);
+    for (auto i = 1u; i < chunk_count; i++) {
+        auto begin = static_cast<size_t>(i) * chunk_size;
+        partial.emplace_back(global_thread_pool().async([chunk_bounds, begin, n = vertices.size()] {
+            return chunk_bounds(begin, std::min<size_t>(begin + chunk_size, n));
+        }));
+    }
+    auto bounds = chunk_bounds(0u, chunk_size);
+    for (auto &&b : partial) { bounds.merge(b.get()); }
+    return bounds;
+}
+
+[[nodiscard]] static auto sphere_bounds(luisa::span<const float4> spheres) noexcept {
+    Geometry::Bounds bounds;
+    for (auto s : spheres) {
+        auto r = std::abs(s.w);
+        bounds.min = luisa::min(bounds.min, make_float3(s) - r);
+        bounds.max = luisa::max(bounds.max, make_float3(s) + r);
+    }
+    return bounds;
+}
+
+[[nodiscard]] static auto mesh_content_hash(MeshView mesh) noexcept {
+    auto hash = luisa::hash64(mesh.vertices.data(), mesh.vertices.size_bytes(), luisa::hash64_default_seed);
+    return luisa::hash64(mesh.triangles.data(), mesh.triangles.size_bytes(), hash);
+}
+
+// shapes that know the identity of their mesh data are keyed by (identity, version),
+// so that only anonymous (explicitly deduplicated) meshes are hashed by content
+[[nodiscard]] static auto mesh_key(const Shape *shape, MeshView mesh) noexcept {
+    if (auto identity = shape->mesh_identity(); identity != 0u) {
+        std::array<uint64_t, 2u> key{identity, shape->mesh_version()};
+        return luisa::hash64(key.data(), sizeof(key), luisa::hash64_default_seed);
+    }
+    return mesh_content_hash(mesh);
+}
+
+uint Geometry::_register_mesh(CommandBuffer &command_buffer, const Shape *shape) noexcept {
+    auto mesh_view = shape->mesh();
+    auto [vertices, triangles] = mesh_view;
+    // LUISA_ASSERT(!vertices.empty() && !triangles.empty(), "Empty mesh.");
+    auto key = mesh_key(shape, mesh_view);
+    if (auto mesh_iter = _mesh_cache.find(key);
+        mesh_iter != _mesh_cache.end()) {
+        _mesh_geometries[mesh_iter->second].ref_count++;
+        return mesh_iter->second;
+    }
+
+    // create mesh
+    // auto [vertex_buffer, vertex_index, vertex_buffer_id] = _pipeline.bindless_buffer<Vertex>(vertices.size());
+    // auto [triangle_buffer, triangle_index, triangle_buffer_id] = _pipeline.bindless_buffer<Triangle>(triangles.size());
+    auto [vertex_buffer, vertex_index] = _pipeline.create_with_index<Buffer<Vertex>>(vertices.size());
+    auto [triangle_buffer, triangle_index] = _pipeline.create_with_index<Buffer<Triangle>>(triangles.size());
+    auto [mesh, mesh_index] = _pipeline.create_with_index<Mesh>(*vertex_buffer, *triangle_buffer, shape->build_option());
+    auto vertex_buffer_id = _pipeline.register_bindless(vertex_buffer->view());
+    auto triangle_buffer_id = _pipeline.register_bindless(triangle_buffer->view());
+    _resource_store.insert(_resource_store.end(), {vertex_index, triangle_index, mesh_index});
+
+    LUISA_ASSERT(triangle_buffer_id - vertex_buffer_id == Shape::Handle::triangle_buffer_id_offset, "Invalid.");
+    auto geom = MeshGeometry{
+        .resource = mesh,
+        .buffer_id_base = vertex_buffer_id,
+        .vertex_buffer = vertex_buffer,
+        .triangle_buffer = triangle_buffer,
+        .resource_indices = {vertex_index, triangle_index, mesh_index},
+        .key = key,
+        .ref_count = 1u};
+    _upload_mesh(command_buffer, geom, mesh_view, true, AccelBuildRequest::FORCE_BUILD);
+    auto index = static_cast<uint>(_mesh_geometries.size());
+    _mesh_geometries.emplace_back(geom);
+    _mesh_cache.emplace(key, index);
+    return index;
+}
+
+void Geometry::_upload_mesh(CommandBuffer &command_buffer, MeshGeometry &geom, MeshView mesh,
+                            bool upload_triangles, AccelBuildRequest request) noexcept {
+    auto [vertices, triangles] = mesh;
+    geom.bounds = mesh_bounds(vertices);
+    command_buffer << geom.vertex_buffer->copy_from(vertices.data());
+    if (upload_triangles) { command_buffer << geom.triangle_buffer->copy_from(triangles.data()); }
+    command_buffer << compute::commit()
+                   << geom.resource->build(request)
+                   << compute::commit();
+    // keep the sampling tables of emissive meshes in sync with the new vertices
+    if (geom.has_alias_table()) {
+        LUISA_ASSERT(geom.alias_table_buffer.size() == triangles.size(),
+                     "Alias table size mismatch: expected {}, got {}.",
+                     triangles.size(), geom.alias_table_buffer.size());
+        _build_alias_table(command_buffer, geom, mesh);
+    }
+}
+
+static constexpr auto triangle_area_shader_name = luisa::string_view{"__triangle_area_shader"};
+
+void Geometry::_build_alias_table(CommandBuffer &command_buffer, MeshGeometry &geom, MeshView mesh) noexcept {
+    using namespace luisa::compute;
+    auto triangle_count = mesh.triangles.size();
+    if (!geom.has_alias_table()) {
+        auto [alias_table_buffer_view, alias_table_index, alias_table_buffer_id] =
+            _pipeline.bindless_buffer<AliasEntry>(triangle_count);
+        auto [pdf_buffer_view, pdf_index, pdf_buffer_id] = _pipeline.bindless_buffer<float>(triangle_count);
+        _resource_store.insert(_resource_store.end(), {alias_table_index, pdf_index});
+        geom.alias_table_buffer = alias_table_buffer_view;
+        geom.pdf_buffer = pdf_buffer_view;
+        geom.alias_table_buffer_id = alias_table_buffer_id;
+        geom.pdf_buffer_id = pdf_buffer_id;
+        geom.alias_resource_indices = {alias_table_index, pdf_index};
+    }
+    _pipeline.register_shader<1u>(
+        triangle_area_shader_name,
+        [](BufferVar<Vertex> vertices, BufferVar<Triangle> triangles, BufferFloat areas) noexcept {
+            auto i = dispatch_x();
+            auto t = triangles.read(i);
+            auto p0 = vertices.read(t.i0).position();
+            auto p1 = vertices.read(t.i1).position();
+            auto p2 = vertices.read(t.i2).position();
+            areas.write(i, length(cross(p1 - p0, p2 - p0)));
+        });
+    // the areas are computed from the uploaded buffers straight into the pdf buffer,
+    // which the builder then normalizes in place
+    command_buffer << _pipeline.shader<1u, Buffer<Vertex>, Buffer<Triangle>, Buffer<float>>(
+                          triangle_area_shader_name, *geom.vertex_buffer, *geom.triangle_buffer, geom.pdf_buffer)
+                          .dispatch(triangle_count);
+    _pipeline.alias_table_builder().build(
+        command_buffer, geom.pdf_buffer, geom.alias_table_buffer, geom.pdf_buffer,
+        static_cast<uint>(triangle_count));
+    command_buffer << compute::commit();
+}
+
+void Geometry::_release_mesh(uint index) noexcept {
+    auto &geom = _mesh_geometries[index];
+    if (--geom.ref_count != 0u) { return; }
+    if (auto iter = _mesh_cache.find(geom.key);
+        iter != _mesh_cache.end() && iter->second == index) {
+        _mesh_cache.erase(iter);
+    }
+    for (auto i = 0u; i <= Shape::Handle::triangle_buffer_id_offset; i++) {
+        _pipeline.bindless_array().remove_buffer_on_update(geom.buffer_id_base + i);
+    }
+    // queued commands may still use the mesh; the indices are also kept in _resource_store,
+    // and removing twice is harmless
+    _retired_resources.insert(_retired_resources.end(), geom.resource_indices.cbegin(), geom.resource_indices.cend());
+    if (geom.has_alias_table()) {
+        _pipeline.bindless_array().remove_buffer_on_update(geom.alias_table_buffer_id);
+        _pipeline.bindless_array().remove_buffer_on_update(geom.pdf_buffer_id);
+        _retired_resources.insert(_retired_resources.end(), geom.alias_resource_indices.cbegin(),
+                                  geom.alias_resource_indices.cend());
+        geom.alias_table_buffer_id = ~0u;
+        geom.pdf_buffer_id = ~0u;
+    }
+    geom.resource = nullptr;
+}
+
+static constexpr auto sphere_aabb_shader_name = luisa::string_view{"__sphere_aabb_shader"};
+
+uint Geometry::_register_spheres(CommandBuffer &command_buffer, const Shape *shape) noexcept {
+    using namespace luisa::compute;
+    _pipeline.register_shader<1u>(
+        sphere_aabb_shader_name, [](BufferFloat4 spheres, BufferFloat aabbs) noexcept {
+            auto i = dispatch_x();
+            auto sphere = spheres.read(i);
+            auto r = abs(sphere.w);
+            for (auto k = 0u; k < 3u; k++) {
+                aabbs.write(i * 6u + k, sphere[k] - r);
+                aabbs.write(i * 6u + 3u + k, sphere[k] + r);
+            }
+        });
+    auto spheres = shape->spheres();
+    auto [sphere_buffer, sphere_index] = _pipeline.create_with_index<Buffer<float4>>(spheres.size());
+    auto [aabb_buffer, aabb_index] = _pipeline.create_with_index<Buffer<AABB>>(spheres.size());
+    auto [primitive, primitive_index] = _pipeline.create_with_index<ProceduralPrimitive>(
+        aabb_buffer->view(), shape->build_option());
+    auto sphere_buffer_id = _pipeline.register_bindless(sphere_buffer->view());
+    _resource_store.insert(_resource_store.end(), {sphere_index, aabb_index, primitive_index});
+    auto geom = ProceduralGeometry{
+        .resource = primitive,
+        .buffer_id = sphere_buffer_id,
+        .sphere_buffer = sphere_buffer,
+        .aabb_buffer = aabb_buffer,
+        .resource_indices = {sphere_index, aabb_index, primitive_index}};
+    _upload_spheres(command_buffer, geom, spheres, AccelBuildRequest::FORCE_BUILD);
+    auto index = static_cast<uint>(_procedural_geometries.size());
+    _procedural_geometries.emplace_back(geom);
+    _has_procedural = true;
+    return index;
+}
+
+void Geometry::_upload_spheres(CommandBuffer &command_buffer, ProceduralGeometry &geom,
+                               luisa::span<const float4> spheres, AccelBuildRequest request) noexcept {
+    geom.bounds = sphere_bounds(spheres);
+    // the spheres are the only upload, the bounding boxes are derived on the device
+    command_buffer << geom.sphere_buffer->copy_from(spheres.data())
+                   << _pipeline.shader<1u, Buffer<float4>, Buffer<float>>(
+                          sphere_aabb_shader_name, *geom.sphere_buffer, geom.aabb_buffer->view().as<float>())
+                          .dispatch(spheres.size())
+                   << geom.resource->build(request)
+                   << compute::commit();
+}
+
+void Geometry::_release_spheres(uint index) noexcept {
+    auto &geom = _procedural_geometries[index];
+    _pipeline.bindless_array().remove_buffer_on_update(geom.buffer_id);
+    _retired_resources.insert(_retired_resources.end(), geom.resource_indices.cbegin(), geom.resource_indices.cend());
+    geom.resource = nullptr;
+}
+
+void Geometry::_set_instance_bounds(uint instance_id, const Bounds &object_bounds,
+                                    const float4x4 &object_to_world) noexcept {
+    if (instance_id == _instance_bounds.size()) {
+        _instance_bounds.emplace_back(object_bounds);
+        _instance_world_bounds.emplace_back(object_bounds.transformed(object_to_world));
+    } else {
+        _instance_bounds[instance_id] = object_bounds;
+        _instance_world_bounds[instance_id] = object_bounds.transformed(object_to_world);
+    }
+}
+
+// recomputed from the per-instance bounds, so that they also shrink when geometry moves or changes
+void Geometry::_update_world_bounds() noexcept {
+    Bounds bounds;
+    for (auto &&b : _instance_world_bounds) { bounds.merge(b); }
+    _world_min = bounds.min;
+    _world_max = bounds.max;
+}
+
+void Geometry::_process_procedural(
+    CommandBuffer &command_buffer, const Shape *shape, float init_time,
+    const Surface *surface, const Light *light, const Medium *medium, bool visible) noexcept {
+
+    auto &record = [&]() -> ShapeRecord & {
+        if (auto iter = _shape_records.find(shape);
+            iter != _shape_records.end()) { return iter->second; }
+        auto geometry = _register_spheres(command_buffer, shape);
+        return _shape_records.emplace(shape, ShapeRecord{
+            .transform = shape->transform(),
+            .geometry = geometry,
+            .procedural = true,
+            .copy_count = 1u}).first->second;
+    }();
+    auto &geom = _procedural_geometries[record.geometry];
+    auto instance_id = static_cast<uint>(_accel.size());
+    auto [t_node, is_static] = _transform_tree.leaf(shape->transform());
+    InstancedTransform inst_xform{t_node, instance_id};
+    if (!is_static) { _dynamic_transforms.emplace_back(inst_xform); }
+    record.instances.emplace_back(inst_xform);
+    _copy_transforms.emplace_back(make_float4x4(1.f));
+    auto object_to_world = _instance_transform(inst_xform, init_time);
+    _accel.emplace_back(*geom.resource, object_to_world, visible ? static_visibility : 0u);
+    _instance_visible.emplace_back(visible);
+    _set_instance_bounds(instance_id, geom.bounds, object_to_world);
+
+    // create instance
+    auto surface_tag = 0u;
+    auto medium_tag = 0u;
+    auto properties = Shape::property_flag_procedural;
+    if (surface != nullptr && !surface->is_null()) {
+        surface_tag = _pipeline.register_surface(command_buffer, surface);// material id, see Geometry::instance()
+        properties |= Shape::property_flag_has_surface;
+    }
+    if (light != nullptr && !light->is_null()) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION(
+            "Lights on procedural shapes are not supported and will be ignored.");
+    }
+    if (medium != nullptr && !medium->is_null()) {
+        medium_tag = _pipeline.register_medium(command_buffer, medium);
+        properties |= Shape::property_flag_has_medium;
+    }
+    _emission_buffer_ids.emplace_back(make_uint2(~0u));
+    _instances.emplace_back(Shape::Handle::encode(
+        geom.buffer_id, properties, surface_tag, 0u, medium_tag,
+        static_cast<uint>(shape->spheres().size()),
+        0.f, shape->intersection_offset_factor(), shape->clamp_normal_factor()));
 }
 
 void Geometry::_process_shape(
@@ -43,57 +360,24 @@ void Geometry::_process_shape(
     auto medium = overridden_medium == nullptr ? shape->medium() : overridden_medium;
     auto visible = overridden_visible && shape->visible();
 
-    if (shape->is_mesh() && !shape->empty()) {
+    auto occurrence = ShapeOccurrence{overridden_surface, overridden_light, overridden_medium, light};
+    if (shape->is_mesh() && !shape->empty() && shape->is_procedural()) {
+        _process_procedural(command_buffer, shape, init_time, surface, light, medium, visible);
+        _shape_records.at(shape).occurrences.emplace_back(occurrence);
+    } else if (shape->is_mesh() && !shape->empty()) {
+        auto &record = [&]() -> ShapeRecord & {
+            if (auto iter = _shape_records.find(shape);
+                iter != _shape_records.end()) { return iter->second; }
+            auto geometry = _register_mesh(command_buffer, shape);
+            return _shape_records.emplace(shape, ShapeRecord{
+                .transform = shape->transform(),
+                .geometry = geometry,
+                .procedural = false,
+                .copy_count = std::max(static_cast<uint>(shape->copies().size()), 1u)}).first->second;
+        }();
+        record.occurrences.emplace_back(occurrence);
         auto mesh = [&] {
-            auto mesh_geom = [&] {
-                auto [vertices, triangles] = shape->mesh();
-                // LUISA_ASSERT(!vertices.empty() && !triangles.empty(), "Empty mesh.");
-                auto hash = luisa::hash64(vertices.data(), vertices.size_bytes(), luisa::hash64_default_seed);
-                hash = luisa::hash64(triangles.data(), triangles.size_bytes(), hash);
-                if (auto mesh_iter = _mesh_cache.find(hash);
-                    mesh_iter != _mesh_cache.end()) {
-                    return mesh_iter->second;
-                }
-
-                // create mesh
-                // auto [vertex_buffer, vertex_index, vertex_buffer_id] = _pipeline.bindless_buffer<Vertex>(vertices.size());
-                // auto [triangle_buffer, triangle_index, triangle_buffer_id] = _pipeline.bindless_buffer<Triangle>(triangles.size());
-                auto [vertex_buffer, vertex_index] = _pipeline.create_with_index<Buffer<Vertex>>(vertices.size());
-                auto [triangle_buffer, triangle_index] = _pipeline.create_with_index<Buffer<Triangle>>(triangles.size());
-                auto [mesh, mesh_index] = _pipeline.create_with_index<Mesh>(*vertex_buffer, *triangle_buffer, shape->build_option());
-                command_buffer << vertex_buffer->copy_from(vertices.data())
-                               << triangle_buffer->copy_from(triangles.data())
-                               << compute::commit()
-                               << mesh->build()
-                               << compute::commit();
-                auto vertex_buffer_id = _pipeline.register_bindless(vertex_buffer->view());
-                auto triangle_buffer_id = _pipeline.register_bindless(triangle_buffer->view());
-                // compute alias table
-                luisa::vector<float> triangle_areas(triangles.size());
-                for (auto i = 0u; i < triangles.size(); i++) {
-                    auto t = triangles[i];
-                    auto p0 = vertices[t.i0].position();
-                    auto p1 = vertices[t.i1].position();
-                    auto p2 = vertices[t.i2].position();
-                    triangle_areas[i] = std::abs(length(cross(p1 - p0, p2 - p0)));
-                }
-                auto [alias_table, pdf] = create_alias_table(triangle_areas);
-                auto [alias_table_buffer_view, alias_table_index, alias_buffer_id] =
-                     _pipeline.bindless_buffer<AliasEntry>(alias_table.size());
-                auto [pdf_buffer_view, pdf_index, pdf_buffer_id] = _pipeline.bindless_buffer<float>(pdf.size());
-                _resource_store.insert(_resource_store.end(), {vertex_index, triangle_index, mesh_index, alias_table_index, pdf_index});
-
-                LUISA_ASSERT(triangle_buffer_id - vertex_buffer_id == Shape::Handle::triangle_buffer_id_offset, "Invalid.");
-                LUISA_ASSERT(alias_buffer_id - vertex_buffer_id == Shape::Handle::alias_table_buffer_id_offset, "Invalid.");
-                LUISA_ASSERT(pdf_buffer_id - vertex_buffer_id == Shape::Handle::pdf_buffer_id_offset, "Invalid.");
-                command_buffer << alias_table_buffer_view.copy_from(alias_table.data())
-                               << pdf_buffer_view.copy_from(pdf.data())
-                               << compute::commit();
-                auto geom = MeshGeometry{mesh, vertex_buffer_id};
-                _mesh_cache.emplace(hash, geom);
-                return geom;
-            }();
-            
+            auto &mesh_geom = _mesh_geometries[record.geometry];
             // assign mesh data
             MeshData mesh_data{
                 .resource = mesh_geom.resource,
@@ -112,50 +396,58 @@ void Geometry::_process_shape(
             _meshes[shape] = mesh_data;
             return mesh_data;
         }();
-        auto instance_id = static_cast<uint>(_accel.size());
-        auto [t_node, is_static] = _transform_tree.leaf(shape->transform());
-        InstancedTransform inst_xform{t_node, instance_id};
-        if (!is_static) { _dynamic_transforms.emplace_back(inst_xform); }
-        auto object_to_world = inst_xform.matrix(init_time);
-        _accel.emplace_back(*mesh.resource, object_to_world, visible);
-
-        // TODO: _world_max/min cannot support deleting objects
-        auto vertices = shape->mesh().vertices;
-        for (auto &v : vertices) {
-            _world_max = max(_world_max, make_float3(object_to_world * make_float4(v.position(), 1.f)));
-            _world_min = min(_world_min, make_float3(object_to_world * make_float4(v.position(), 1.f)));
-        }
-
         // create instance
         auto surface_tag = 0u;
         auto light_tag = 0u;
         auto medium_tag = 0u;
         auto properties = mesh.vertex_properties;
         if (surface != nullptr && !surface->is_null()) {
-            surface_tag = _pipeline.register_surface(command_buffer, surface);
+            surface_tag = _pipeline.register_surface(command_buffer, surface);// material id, see Geometry::instance()
             properties |= Shape::property_flag_has_surface;
         }
+        auto emission_buffer_ids = make_uint2(~0u);
         if (light != nullptr && !light->is_null()) {
-            light_tag = _pipeline.register_light(command_buffer, light);
+            light_tag = _pipeline.register_light(command_buffer, light);// light id, see Geometry::instance()
             properties |= Shape::property_flag_has_light;
+            auto &mesh_geom = _mesh_geometries[record.geometry];
+            if (!mesh_geom.has_alias_table()) { _build_alias_table(command_buffer, mesh_geom, shape->mesh()); }
+            emission_buffer_ids = make_uint2(mesh_geom.alias_table_buffer_id, mesh_geom.pdf_buffer_id);
         }
         if (medium != nullptr && !medium->is_null()) {
             medium_tag = _pipeline.register_medium(command_buffer, medium);
             properties |= Shape::property_flag_has_medium;
         }
-        _instances.emplace_back(Shape::Handle::encode(
+        auto encoded = Shape::Handle::encode(
             mesh.geometry_buffer_id_base,
             properties, surface_tag, light_tag, medium_tag,
             mesh.resource->triangle_count(),
             static_cast<float>(mesh.shadow_term) / static_cast<float>(Shape::Handle::shadow_term_mask),
             static_cast<float>(mesh.intersection_offset) / static_cast<float>(Shape::Handle::inter_offset_mask),
             static_cast<float>(mesh.clamp_normal) / static_cast<float>(Shape::Handle::clamp_normal_mask) * 2.f - 1
-        ));
-        if (properties & Shape::property_flag_has_light) {
-            _instanced_lights.emplace_back(Light::Handle{
-                .instance_id = instance_id,
-                .light_tag = light_tag
-            });
+        );
+
+        // shapes with copies place the shared mesh once per copy, all referencing the same BLAS
+        auto copies = shape->copies();
+        auto identity = make_float4x4(1.f);
+        auto [t_node, is_static] = _transform_tree.leaf(shape->transform());
+        for (auto i = 0u; i < record.copy_count; i++) {
+            auto instance_id = static_cast<uint>(_accel.size());
+            InstancedTransform inst_xform{t_node, instance_id};
+            if (!is_static) { _dynamic_transforms.emplace_back(inst_xform); }
+            record.instances.emplace_back(inst_xform);
+            _copy_transforms.emplace_back(copies.empty() ? identity : copies[i]);
+            auto object_to_world = _instance_transform(inst_xform, init_time);
+            _accel.emplace_back(*mesh.resource, object_to_world, visible ? static_visibility : 0u);
+            _instance_visible.emplace_back(visible);
+            _set_instance_bounds(instance_id, _mesh_geometries[record.geometry].bounds, object_to_world);
+            _instances.emplace_back(encoded);
+            _emission_buffer_ids.emplace_back(emission_buffer_ids);
+            if (properties & Shape::property_flag_has_light) {
+                _instanced_lights.emplace_back(Light::Handle{
+                    .instance_id = instance_id,
+                    .light_tag = light_tag
+                });
+            }
         }
     } else {
         _transform_tree.push(shape->transform());
@@ -166,45 +458,494 @@ void Geometry::_process_shape(
     }
 }
 
+void Geometry::_build_motion_groups(CommandBuffer &command_buffer, float init_time) noexcept {
+    _motion_span = make_float2(init_time);
+    luisa::unordered_map<const TransformTree::Node *, uint> group_ids;
+    _motion_group_ids.assign(_instances.size(), ~0u);
+    for (auto t : _dynamic_transforms) {
+        auto [iter, first] = group_ids.try_emplace(t.node(), static_cast<uint>(_motion_groups.size()));
+        if (first) { _motion_groups.emplace_back(t.node()); }
+        _motion_group_ids[t.instance_id()] = iter->second;
+    }
+    // each group traces the accel once, and the visibility masks have room for a few only
+    if (_motion_groups.size() > max_motion_groups) {
+        LUISA_WARNING_WITH_LOCATION(
+            "{} motion groups exceed the maximum of {}. "
+            "Falling back to an accel build per shutter sample.",
+            _motion_groups.size(), max_motion_groups);
+        _motion_groups.clear();
+        _motion_group_ids.clear();
+        return;
+    }
+    for (auto t : _dynamic_transforms) {
+        if (auto id = t.instance_id(); _instance_visible[id]) {
+            _accel.set_visibility_on_update(id, static_visibility << (_motion_group_ids[id] + 1u));
+        }
+    }
+    _motion_keyframes.resize(_motion_groups.size() * motion_keyframe_count);
+    _motion_group_buffer = _pipeline.device().create_buffer<uint>(_motion_group_ids.size());
+    _motion_keyframe_buffer = _pipeline.device().create_buffer<float4x4>(_motion_keyframes.size());
+    _motion_span_buffer = _pipeline.device().create_buffer<float2>(1u);
+    command_buffer << _motion_group_buffer.copy_from(_motion_group_ids.data());
+    _update_motion_keyframes(command_buffer, make_float2(init_time));
+    LUISA_INFO("Grouped {} dynamic instance(s) into {} motion group(s).",
+               _dynamic_transforms.size(), _motion_groups.size());
+}
+
+// places the dynamic instances at the start of the span, with world bounds covering the whole span
+void Geometry::_set_dynamic_transforms(float2 span) noexcept {
+    auto sample_count = span.x < span.y ? motion_keyframe_count : 1u;
+    auto set_transform = [this, span, sample_count](InstancedTransform t) noexcept {
+        auto instance_id = t.instance_id();
+        auto object_to_world = _instance_transform(t, span.x);
+        _accel.set_transform_on_update(instance_id, object_to_world);
+        auto bounds = _instance_bounds[instance_id].transformed(object_to_world);
+        for (auto k = 1u; k < sample_count; k++) {
+            auto time = span.x + (span.y - span.x) * static_cast<float>(k) / static_cast<float>(sample_count - 1u);
+            bounds.merge(_instance_bounds[instance_id].transformed(_instance_transform(t, time)));
+        }
+        _instance_world_bounds[instance_id] = bounds;
+    };
+    // waits on its own chunks only, not on everything else queued in the pool
+    constexpr auto chunk_size = 128u;
+    auto set_transforms = [this, &set_transform](size_t begin, size_t end) noexcept {
+        for (auto i = begin; i < end; i++) { set_transform(_dynamic_transforms[i]); }
+    };
+    auto n = _dynamic_transforms.size();
+    luisa::vector<std::shared_future<void>> chunks;
+    for (auto begin = static_cast<size_t>(chunk_size); begin < n; begin += chunk_size) {
+        chunks.emplace_back(global_thread_pool().async([&set_transforms, begin, n] {
+            set_transforms(begin, std::min<size_t>(begin + chunk_size, n));
+        }));
+    }
+    set_transforms(0u, std::min<size_t>(chunk_size, n));
+    for (auto &&c : chunks) { c.wait(); }
+}
+
+// an empty span (x == y) stores identities, i.e., no motion relative to the accel
+void Geometry::_update_motion_keyframes(CommandBuffer &command_buffer, float2 span) noexcept {
+    _motion_span = span;
+    if (_motion_groups.empty()) { return; }
+    constexpr auto n = motion_keyframe_count;
+    auto moving = span.x < span.y;
+    for (auto g = 0u; g < _motion_groups.size(); g++) {
+        auto node = _motion_groups[g];
+        auto world_to_reference = moving ? inverse(node->matrix(span.x)) : make_float4x4(1.f);
+        for (auto k = 0u; k < n; k++) {
+            auto time = span.x + (span.y - span.x) * static_cast<float>(k) / static_cast<float>(n - 1u);
+            _motion_keyframes[g * n + k] = moving ? node->matrix(time) * world_to_reference : make_float4x4(1.f);
+        }
+    }
+    command_buffer << _motion_keyframe_buffer.copy_from(_motion_keyframes.data())
+                   << _motion_span_buffer.copy_from(&_motion_span);
+}
+
+void Geometry::_update_dynamic(CommandBuffer &command_buffer, float2 span) noexcept {
+    _set_dynamic_transforms(span);
+    _update_world_bounds();
+    _update_motion_keyframes(command_buffer, span);
+    command_buffer << _accel.build();
+}
+
 bool Geometry::update(CommandBuffer &command_buffer, float time) noexcept {
-    auto updated = false;
-    if (!_dynamic_transforms.empty()) {
-        updated = true;
-        if (_dynamic_transforms.size() < 128u) {
-            for (auto t : _dynamic_transforms) {
-                _accel.set_transform_on_update(
-                    t.instance_id(), t.matrix(time));
+    if (_dynamic_transforms.empty()) { return false; }
+    if (_motion_span.x < _motion_span.y &&
+        time >= _motion_span.x && time <= _motion_span.y) { return false; }
+    _update_dynamic(command_buffer, make_float2(time));
+    return true;
+}
+
+bool Geometry::update_motion(CommandBuffer &command_buffer, float2 shutter_span) noexcept {
+    if (_dynamic_transforms.empty()) { return false; }
+    // nothing to interpolate, so the update() of the first shutter sample builds the accel
+    if (_motion_groups.empty() || !(shutter_span.x < shutter_span.y)) {
+        _update_motion_keyframes(command_buffer, make_float2(shutter_span.x));
+        return false;
+    }
+    _update_dynamic(command_buffer, shutter_span);
+    return true;
+}
+
+bool Geometry::update_shapes(CommandBuffer &command_buffer,
+                             const luisa::unordered_set<const Shape *> &shapes,
+                             float time) noexcept {
+    _light_instances_updated = false;
+    // shapes that are new, emptied, or re-parented to another transform change the instance layout
+    for (auto shape : shapes) {
+        auto iter = _shape_records.find(shape);
+        if (iter == _shape_records.end() || !shape->is_mesh() || shape->empty() ||
+            iter->second.transform != shape->transform() ||
+            iter->second.procedural != shape->is_procedural() ||
+            iter->second.copy_count != std::max(static_cast<uint>(shape->copies().size()), 1u)) { return false; }
+        // other light changes are patched, but the emission buffer only comes with the first emissive instance
+        if (!_emission_buffer && !iter->second.procedural) {
+            for (auto &&o : iter->second.occurrences) {
+                if ((o.light == nullptr ? shape->light() : o.light) != o.resolved_light) { return false; }
+            }
+        }
+    }
+    for (auto shape : shapes) {
+        auto &record = _shape_records.at(shape);
+        if (_update_materials(command_buffer, shape, record)) { _light_instances_updated = true; }
+        if (record.procedural) {
+            _update_procedural(command_buffer, shape, record, time);
+            continue;
+        }
+        auto mesh_view = shape->mesh();
+        auto &old_geom = _mesh_geometries[record.geometry];
+        auto old_resource = old_geom.resource;
+        auto key = mesh_key(shape, mesh_view);
+        if (old_geom.key == key) {
+            // unchanged mesh (e.g. moving copies of a shared mesh): only the transforms are updated
+        } else if (old_geom.ref_count == 1u &&
+            old_geom.vertex_buffer->size() == mesh_view.vertices.size() &&
+            old_geom.triangle_buffer->size() == mesh_view.triangles.size()) {
+            // same size and not shared: overwrite the buffers and keep the bindless slots;
+            // if only the vertices moved, the triangles are kept and the BLAS may be refit
+            if (auto iter = _mesh_cache.find(old_geom.key);
+                iter != _mesh_cache.end() && iter->second == record.geometry) {
+                _mesh_cache.erase(iter);
             }
+            old_geom.key = key;
+            _mesh_cache.try_emplace(old_geom.key, record.geometry);
+            auto topology_updated = shape->topology_updated();
+            auto refit = !topology_updated && shape->build_option().allow_update;
+            _upload_mesh(command_buffer, old_geom, mesh_view, topology_updated,
+                         refit ? AccelBuildRequest::PREFER_UPDATE : AccelBuildRequest::FORCE_BUILD);
         } else {
-            global_thread_pool().parallel(
-                _dynamic_transforms.size(),
-                [this, time](auto i) noexcept {
-                    auto t = _dynamic_transforms[i];
-                    _accel.set_transform_on_update(
-                        t.instance_id(), t.matrix(time));
-                });
-            global_thread_pool().synchronize();
+            auto old_index = record.geometry;
+            record.geometry = _register_mesh(command_buffer, shape);
+            _release_mesh(old_index);
+        }
+        auto &geom = _mesh_geometries[record.geometry];
+        auto &mesh_data = _meshes.at(shape);
+        mesh_data.resource = geom.resource;
+        mesh_data.geometry_buffer_id_base = geom.buffer_id_base;
+        mesh_data.vertex_properties = shape->vertex_properties();
+        constexpr auto vertex_property_mask = Shape::property_flag_has_vertex_normal |
+                                              Shape::property_flag_has_vertex_uv;
+        auto copies = shape->copies();
+        for (auto i = 0u; i < record.instances.size(); i++) {
+            auto t = record.instances[i];
+            auto instance_id = static_cast<uint>(t.instance_id());
+            if (!copies.empty()) { _copy_transforms[instance_id] = copies[i % record.copy_count]; }
+            auto &instance = _instances[instance_id];
+            auto flags = (instance.x & Shape::Handle::property_flag_mask & ~vertex_property_mask) |
+                         shape->vertex_properties();
+            instance.x = (geom.buffer_id_base << Shape::Handle::property_flag_bits) | flags;
+            instance.z = geom.resource->triangle_count();
+            command_buffer << _instance_buffer.view(instance_id, 1u).copy_from(&instance);
+            if (instance.x & Shape::property_flag_has_light) {
+                if (!geom.has_alias_table()) { _build_alias_table(command_buffer, geom, mesh_view); }
+                auto &ids = _emission_buffer_ids[instance_id];
+                ids = make_uint2(geom.alias_table_buffer_id, geom.pdf_buffer_id);
+                command_buffer << _emission_buffer.view(instance_id, 1u).copy_from(&ids);
+            }
+            if (geom.resource != old_resource) { _accel.set_mesh(instance_id, *geom.resource); }
+            auto object_to_world = _instance_transform(t, time);
+            _accel.set_transform_on_update(instance_id, object_to_world);
+            _set_instance_bounds(instance_id, geom.bounds, object_to_world);
+        }
+    }
+    if (_light_instances_updated) {
+        // kept in instance order, as built by _process_shape()
+        _instanced_lights.clear();
+        for (auto i = 0u; i < _instances.size(); i++) {
+            if (_instances[i].x & Shape::property_flag_has_light) {
+                _instanced_lights.emplace_back(Light::Handle{
+                    .instance_id = i,
+                    .light_tag = (_instances[i].y >> Shape::Handle::light_tag_offset) & Shape::Handle::light_tag_max});
+            }
+        }
+    }
+    _update_world_bounds();
+    // the patched instances are placed at the given time, so any baked motion is dropped
+    _update_motion_keyframes(command_buffer, make_float2(time));
+    command_buffer << _accel.build();
+    return true;
+}
+
+// re-registers the surfaces, lights and media of the instances; they are uploaded by the caller.
+// Returns whether the lights of the instances changed.
+bool Geometry::_update_materials(CommandBuffer &command_buffer, const Shape *shape,
+                                 ShapeRecord &record) noexcept {
+    using Handle = Shape::Handle;
+    constexpr auto flag_mask = Shape::property_flag_has_surface |
+                               Shape::property_flag_has_light |
+                               Shape::property_flag_has_medium;
+    constexpr auto tag_mask = (Handle::surface_tag_max << Handle::surface_tag_offset) |
+                              (Handle::light_tag_max << Handle::light_tag_offset) |
+                              (Handle::medium_tag_max << Handle::medium_tag_offset);
+    auto lights_changed = false;
+    for (auto i = 0u; i < record.occurrences.size(); i++) {
+        auto &&o = record.occurrences[i];
+        auto surface = o.surface == nullptr ? shape->surface() : o.surface;
+        auto light = o.light == nullptr ? shape->light() : o.light;
+        auto medium = o.medium == nullptr ? shape->medium() : o.medium;
+        auto flags = 0u;
+        auto tags = 0u;
+        if (surface != nullptr && !surface->is_null()) {
+            tags |= _pipeline.register_surface(command_buffer, surface) << Handle::surface_tag_offset;
+            flags |= Shape::property_flag_has_surface;
         }
-        command_buffer << _accel.build();
+        // lights on procedural shapes are ignored, see _process_procedural()
+        if (!record.procedural && light != nullptr && !light->is_null()) {
+            tags |= _pipeline.register_light(command_buffer, light) << Handle::light_tag_offset;
+            flags |= Shape::property_flag_has_light;
+        }
+        if (light != o.resolved_light) {
+            o.resolved_light = light;
+            lights_changed |= !record.procedural;
+        }
+        if (medium != nullptr && !medium->is_null()) {
+            tags |= _pipeline.register_medium(command_buffer, medium) << Handle::medium_tag_offset;
+            flags |= Shape::property_flag_has_medium;
+        }
+        for (auto k = 0u; k < record.copy_count; k++) {
+            auto &instance = _instances[record.instances[i * record.copy_count + k].instance_id()];
+            instance.x = (instance.x & ~flag_mask) | flags;
+            instance.y = (instance.y & ~tag_mask) | tags;
+        }
+    }
+    return lights_changed;
+}
+
+void Geometry::release_retired_resources(CommandBuffer &command_buffer) noexcept {
+    if (_retired_resources.empty()) { return; }
+    command_buffer << compute::synchronize();
+    for (auto index : _retired_resources) { _pipeline.remove_resource(index); }
+    _retired_resources.clear();
+}
+
+void Geometry::_update_procedural(CommandBuffer &command_buffer, const Shape *shape,
+                                  ShapeRecord &record, float time) noexcept {
+    auto spheres = shape->spheres();
+    auto old_resource = _procedural_geometries[record.geometry].resource;
+    if (auto &old_geom = _procedural_geometries[record.geometry];
+        old_geom.sphere_buffer->size() == spheres.size()) {
+        // same count: one upload and an AABB rebuild (or refit) in place
+        auto refit = shape->build_option().allow_update;
+        _upload_spheres(command_buffer, old_geom, spheres,
+                        refit ? AccelBuildRequest::PREFER_UPDATE : AccelBuildRequest::FORCE_BUILD);
+    } else {
+        auto old_index = record.geometry;
+        record.geometry = _register_spheres(command_buffer, shape);
+        _release_spheres(old_index);
+    }
+    auto &geom = _procedural_geometries[record.geometry];
+    for (auto t : record.instances) {
+        auto instance_id = static_cast<uint>(t.instance_id());
+        auto &instance = _instances[instance_id];
+        instance.x = (geom.buffer_id << Shape::Handle::property_flag_bits) |
+                     (instance.x & Shape::Handle::property_flag_mask);
+        instance.z = static_cast<uint>(spheres.size());
+        command_buffer << _instance_buffer.view(instance_id, 1u).copy_from(&instance);
+        if (geom.resource != old_resource) { _accel.set_procedural_primitive(instance_id, *geom.resource); }
+        auto object_to_world = _instance_transform(t, time);
+        _accel.set_transform_on_update(instance_id, object_to_world);
+        _set_instance_bounds(instance_id, geom.bounds, object_to_world);
     }
-    return updated;
+}
+
+Var<float> Geometry::_intersect_sphere(const Var<Ray> &ray, Expr<uint> inst_id,
+                                       Expr<uint> prim_id, Expr<float> t_max) const noexcept {
+    using namespace luisa::compute;
+    auto shape = instance(inst_id);
+    auto sphere = _pipeline.buffer<float4>(shape.sphere_buffer_id()).read(prim_id);
+    auto m = instance_to_world(inst_id);
+    auto inv_m = inverse(make_float3x3(m));
+    // object space; d is not normalized so that t stays the world-space distance
+    auto o = inv_m * (ray->origin() - make_float3(m[3])) - sphere.xyz();
+    auto d = inv_m * ray->direction();
+    auto a = dot(d, d);
+    auto b = dot(o, d);
+    auto c = dot(o, o) - sphere.w * sphere.w;
+    // numerically robust form (Ray Tracing Gems, Ch. 7)
+    auto l = o - (b / a) * d;
+    auto disc = a * (sphere.w * sphere.w - dot(l, l));
+    auto t = def(-1.f);
+    $if(disc >= 0.f) {
+        auto q = -b - ite(b >= 0.f, 1.f, -1.f) * sqrt(disc);
+        auto t0 = c / q;
+        auto t1 = q / a;
+        auto t_near = min(t0, t1);
+        auto t_far = max(t0, t1);
+        auto t_min = ray->t_min();
+        $if(t_near >= t_min & t_near <= t_max) {
+            t = t_near;
+        }
+        $elif(t_far >= t_min & t_far <= t_max) {
+            t = t_far;
+        };
+    };
+    return t;
+}
+
+Var<float2> Geometry::_sphere_uv(const Var<Ray> &ray, Expr<uint> inst_id,
+                                 Expr<uint> prim_id, Expr<float> t) const noexcept {
+    auto shape = instance(inst_id);
+    auto sphere = _pipeline.buffer<float4>(shape.sphere_buffer_id()).read(prim_id);
+    auto m = instance_to_world(inst_id);
+    auto p = inverse(make_float3x3(m)) * (ray->origin() + t * ray->direction() - make_float3(m[3]));
+    auto w = normalize(p - sphere.xyz());
+    // same parameterization as the tessellated spheres; only u wraps around, v = 1 is the south pole
+    auto theta = acos(clamp(w.y, -1.f, 1.f));
+    auto phi = atan2(w.x, w.z);
+    return make_float2(fract(.5f * inv_pi * phi), clamp(theta * inv_pi, 0.f, 1.f));
 }
 
 Var<Hit> Geometry::trace_closest(const Var<Ray> &ray) const noexcept {
-    auto hit = _accel->trace_closest(ray);
-    return Var<Hit>{hit.inst, hit.prim, hit.bary};
+    using namespace luisa::compute;
+    if (auto time = _shutter_time()) {
+        // static instances first, then each motion group with the ray taken back to the reference time
+        auto best_t = def(ray->t_max());
+        auto hit = def(_trace_motion_group(ray, ray, static_visibility, best_t));
+        $for(group, 0u, static_cast<uint>(_motion_groups.size())) {
+            auto m = inverse(_motion_transform(group, *time));
+            // d is not normalized, so t is the same along both rays
+            auto moved = make_ray(make_float3(m * make_float4(ray->origin(), 1.f)),
+                                  make_float3x3(m) * ray->direction(), ray->t_min(), best_t);
+            auto h = _trace_motion_group(ray, moved, static_visibility << (group + 1u), best_t);
+            $if(!h->miss()) { hit = h; };
+        };
+        return hit;
+    }
+    if (!_has_procedural) {
+        auto hit = _accel->trace_closest(ray);
+        return Var<Hit>{hit.inst, hit.prim, hit.bary};
+    }
+    auto best_t = def(ray->t_max());
+    auto committed = _accel->query_all(ray)
+                         .on_triangle_candidate([&](TriangleCandidate &c) noexcept {
+                             c.commit();
+                         })
+                         .on_procedural_candidate([&](ProceduralCandidate &c) noexcept {
+                             auto h = c.hit();
+                             auto t = _intersect_sphere(ray, h.inst, h.prim, min(c.ray()->t_max(), best_t));
+                             $if(t >= 0.f) {
+                                 best_t = t;
+                                 c.commit(t);
+                             };
+                         })
+                         .trace();
+    Var<Hit> hit{~0u, ~0u, make_float2(0.f)};
+    $if(committed->is_triangle()) {
+        hit = Var<Hit>{committed.inst, committed.prim, committed.bary};
+    }
+    $elif(committed->is_procedural()) {
+        hit = Var<Hit>{committed.inst, committed.prim,
+                       _sphere_uv(ray, committed.inst, committed.prim, committed.committed_ray_t)};
+    };
+    return hit;
 }
 
 Var<bool> Geometry::trace_any(const Var<Ray> &ray) const noexcept {
-    return _accel->trace_any(ray);
+    using namespace luisa::compute;
+    if (auto time = _shutter_time()) {
+        auto occluded = def(_trace_any_motion_group(ray, ray, static_visibility));
+        $for(group, 0u, static_cast<uint>(_motion_groups.size())) {
+            $if(occluded) { $break; };
+            auto m = inverse(_motion_transform(group, *time));
+            auto moved = make_ray(make_float3(m * make_float4(ray->origin(), 1.f)),
+                                  make_float3x3(m) * ray->direction(), ray->t_min(), ray->t_max());
+            occluded = _trace_any_motion_group(ray, moved, static_visibility << (group + 1u));
+        };
+        return occluded;
+    }
+    if (!_has_procedural) { return _accel->trace_any(ray); }
+    auto committed = _accel->query_any(ray)
+                         .on_triangle_candidate([&](TriangleCandidate &c) noexcept {
+                             c.commit();
+                         })
+                         .on_procedural_candidate([&](ProceduralCandidate &c) noexcept {
+                             auto h = c.hit();
+                             auto t = _intersect_sphere(ray, h.inst, h.prim, c.ray()->t_max());
+                             $if(t >= 0.f) { c.commit(t); };
+                         })
+                         .trace();
+    return !committed->miss();
+}
+
+luisa::optional<Expr<float>> Geometry::_shutter_time() const noexcept {
+    if (_motion_groups.empty() || bound_shutter_time == nullptr) { return luisa::nullopt; }
+    return Expr<float>{bound_shutter_time};
+}
+
+Float4x4 Geometry::_motion_transform(Expr<uint> group, Expr<float> time) const noexcept {
+    using namespace luisa::compute;
+    constexpr auto n = motion_keyframe_count;
+    auto span = _motion_span_buffer->read(0u);
+    auto u = clamp((time - span.x) / max(span.y - span.x, 1e-6f), 0.f, 1.f) * static_cast<float>(n - 1u);
+    auto k = min(cast<uint>(u), n - 2u);
+    auto f = u - cast<float>(k);
+    auto m0 = _motion_keyframe_buffer->read(group * n + k);
+    auto m1 = _motion_keyframe_buffer->read(group * n + k + 1u);
+    return make_float4x4(lerp(m0[0], m1[0], f), lerp(m0[1], m1[1], f),
+                         lerp(m0[2], m1[2], f), lerp(m0[3], m1[3], f));
+}
+
+// closest hit among the instances of one visibility mask, i.e. the static ones or a motion
+// group; the traversal uses ray in the reference frame, while spheres are tested against world_ray
+Var<Hit> Geometry::_trace_motion_group(const Var<Ray> &world_ray, const Var<Ray> &ray,
+                                       Expr<uint> mask, Var<float> &best_t) const noexcept {
+    using namespace luisa::compute;
+    auto committed = _accel->query_all(ray, mask)
+                         .on_triangle_candidate([&](TriangleCandidate &c) noexcept {
+                             c.commit();
+                         })
+                         .on_procedural_candidate([&](ProceduralCandidate &c) noexcept {
+                             auto h = c.hit();
+                             auto t = _intersect_sphere(world_ray, h.inst, h.prim, min(c.ray()->t_max(), best_t));
+                             $if(t >= 0.f) {
+                                 best_t = t;
+                                 c.commit(t);
+                             };
+                         })
+                         .trace();
+    Var<Hit> hit{~0u, ~0u, make_float2(0.f)};
+    $if(committed->is_triangle()) {
+        best_t = committed.committed_ray_t;
+        hit = Var<Hit>{committed.inst, committed.prim, committed.bary};
+    }
+    $elif(committed->is_procedural()) {
+        hit = Var<Hit>{committed.inst, committed.prim,
+                       _sphere_uv(world_ray, committed.inst, committed.prim, committed.committed_ray_t)};
+    };
+    return hit;
+}
+
+Var<bool> Geometry::_trace_any_motion_group(const Var<Ray> &world_ray, const Var<Ray> &ray,
+                                            Expr<uint> mask) const noexcept {
+    using namespace luisa::compute;
+    auto committed = _accel->query_any(ray, mask)
+                         .on_triangle_candidate([&](TriangleCandidate &c) noexcept {
+                             c.commit();
+                         })
+                         .on_procedural_candidate([&](ProceduralCandidate &c) noexcept {
+                             auto h = c.hit();
+                             auto t = _intersect_sphere(world_ray, h.inst, h.prim, c.ray()->t_max());
+                             $if(t >= 0.f) { c.commit(t); };
+                         })
+                         .trace();
+    return !committed->miss();
 }
 
 luisa::shared_ptr<Interaction> Geometry::interaction(Expr<uint> inst_id, Expr<uint> prim_id,
                                                      Expr<float3> bary, Expr<float3> wo) const noexcept {
+    using namespace luisa::compute;
     auto shape = instance(inst_id);
     auto m = instance_to_world(inst_id);
-    auto tri = triangle(shape, prim_id);
-    auto attrib = shading_point(shape, tri, bary, m);
+    ShadingAttribute attrib;
+    if (!_has_procedural) {
+        attrib = shading_point(shape, triangle(shape, prim_id), bary, m);
+    } else {
+        $if(shape.is_procedural()) {
+            attrib = _sphere_point(shape, prim_id, bary.yz(), m);
+        }
+        $else {
+            attrib = shading_point(shape, triangle(shape, prim_id), bary, m);
+        };
+    }
     return luisa::make_shared<Interaction>(
         std::move(shape), inst_id, prim_id,
         attrib, dot(wo, attrib.g.n) < 0.0f);
@@ -224,11 +965,29 @@ luisa::shared_ptr<Interaction> Geometry::interaction(const Var<Ray> &ray, const
 }
 
 Shape::Handle Geometry::instance(Expr<uint> index) const noexcept {
-    return Shape::Handle::decode(_instance_buffer->read(index));
+    auto handle = Shape::Handle::decode(_instance_buffer->read(index));
+    handle.resolve_material(_pipeline.material(handle.surface_tag()));
+    if (!_pipeline.lights().empty()) { handle.resolve_light(_pipeline.light(handle.light_tag())); }
+    return handle;
 }
 
 Float4x4 Geometry::instance_to_world(Expr<uint> index) const noexcept {
-    return _accel->instance_transform(index);
+    using namespace luisa::compute;
+    auto m = _accel->instance_transform(index);
+    auto time = _shutter_time();
+    if (!time) { return m; }
+    auto object_to_world = def(m);
+    auto group = _motion_group_buffer->read(index);
+    $if(group != ~0u) { object_to_world = _motion_transform(group, *time) * m; };
+    return object_to_world;
+}
+
+UInt Geometry::alias_table_buffer_id(Expr<uint> index) const noexcept {
+    return _emission_buffer->read(index).x;
+}
+
+UInt Geometry::pdf_buffer_id(Expr<uint> index) const noexcept {
+    return _emission_buffer->read(index).y;
 }
 
 Var<Triangle> Geometry::triangle(const Shape::Handle &instance, Expr<uint> index) const noexcept {
@@ -327,4 +1086,41 @@ ShadingAttribute Geometry::shading_point(const Shape::Handle &instance, const Va
             .uv = uv};
 }
 
+ShadingAttribute Geometry::_sphere_point(const Shape::Handle &instance, Expr<uint> prim_id,
+                                         Expr<float2> uv, const Var<float4x4> &shape_to_world) const noexcept {
+    using namespace luisa::compute;
+    auto sphere = _pipeline.buffer<float4>(instance.sphere_buffer_id()).read(prim_id);
+    auto r = sphere.w;
+    // invert the tessellated spheres' parameterization: u = phi / 2pi, v = theta / pi
+    auto phi = 2.f * pi * uv.x;
+    auto theta = pi * uv.y;
+    auto sin_theta = sin(theta);
+    auto cos_theta = cos(theta);
+    auto sin_phi = sin(phi);
+    auto cos_phi = cos(phi);
+    auto w = make_float3(sin_theta * sin_phi, cos_theta, sin_theta * cos_phi);
+    auto dpdu_local = 2.f * pi * r * make_float3(sin_theta * cos_phi, 0.f, -sin_theta * sin_phi);
+    auto dpdv_local = pi * r * make_float3(cos_theta * sin_phi, -sin_theta, cos_theta * cos_phi);
+
+    // world space
+    auto m = make_float3x3(shape_to_world);
+    auto t = make_float3(shape_to_world[3]);
+    auto p = m * (sphere.xyz() + r * w) + t;
+    auto n = normalize(transpose(inverse(m)) * w);
+    auto fallback_frame = Frame::make(n);
+    auto at_pole = sin_theta < 1e-6f;
+    auto dpdu = ite(at_pole, fallback_frame.s(), m * dpdu_local);
+    auto dpdv = ite(at_pole, fallback_frame.t(), m * dpdv_local);
+    // exact for rigid and uniformly scaled instances
+    auto area = 4.f * pi * r * r * pow(abs(determinant(m)), 2.f / 3.f);
+    return {.g = {.p = p,
+                  .n = n,
+                  .area = area},
+            .ps = p,
+            .ns = n,
+            .dpdu = dpdu,
+            .dpdv = dpdv,
+            .uv = uv};
+}
+
 }// namespace luisa::render
@@ -6,6 +6,8 @@
 
 #include <luisa/dsl/syntax.h>
 #include <luisa/runtime/rtx/accel.h>
+#include <luisa/runtime/rtx/procedural_primitive.h>
+#include <util/sampling.h>
 #include <base/transform.h>
 #include <base/light.h>
 #include <base/shape.h>
@@ -30,11 +32,14 @@ LUISA_STRUCT(luisa::render::Hit, inst, prim, bary) {
 namespace luisa::render {
 
 using compute::Accel;
+using compute::AccelBuildRequest;
 using compute::AccelOption;
 using compute::Buffer;
+using compute::BufferView;
 using compute::Expr;
 using compute::Float4x4;
 using compute::Mesh;
+using compute::ProceduralPrimitive;
 using compute::Var;
 
 class Pipeline;
@@ -42,9 +47,61 @@ class Pipeline;
 class Geometry {
 
 public:
+    // axis-aligned bounds, empty by default
+    struct Bounds {
+        float3 min{std::numeric_limits<float>::max()};
+        float3 max{-std::numeric_limits<float>::max()};
+        [[nodiscard]] auto empty() const noexcept { return any(min > max); }
+        void merge(const Bounds &other) noexcept {
+            min = luisa::min(min, other.min);
+            max = luisa::max(max, other.max);
+        }
+        [[nodiscard]] Bounds transformed(const float4x4 &m) const noexcept;
+    };
+
     struct MeshGeometry {
         Mesh *resource;
         uint buffer_id_base;
+        Buffer<Vertex> *vertex_buffer;
+        Buffer<Triangle> *triangle_buffer;
+        std::array<uint, 3u> resource_indices;
+        uint64_t key;// see Shape::mesh_identity()
+        uint ref_count;// number of distinct shapes referencing this geometry
+        // area-sampling tables, only built once the mesh is referenced by an emissive instance
+        BufferView<AliasEntry> alias_table_buffer;
+        BufferView<float> pdf_buffer;
+        uint alias_table_buffer_id{~0u};
+        uint pdf_buffer_id{~0u};
+        std::array<uint, 2u> alias_resource_indices{};
+        Bounds bounds;// object space, shared by all instances
+        [[nodiscard]] auto has_alias_table() const noexcept { return alias_table_buffer_id != ~0u; }
+    };
+
+    // analytic spheres, one (center, radius) per primitive
+    struct ProceduralGeometry {
+        ProceduralPrimitive *resource;
+        uint buffer_id;
+        Buffer<float4> *sphere_buffer;
+        Buffer<compute::AABB> *aabb_buffer;
+        std::array<uint, 3u> resource_indices;
+        Bounds bounds;// object space
+    };
+
+    // surface, light and medium passed down by the parent shapes, null if not overridden
+    struct ShapeOccurrence {
+        const Surface *surface;
+        const Light *light;
+        const Medium *medium;
+        const Light *resolved_light;// the light the instances were built with
+    };
+
+    struct ShapeRecord {
+        const Transform *transform;
+        uint geometry;// index into _mesh_geometries, or _procedural_geometries if procedural
+        bool procedural;
+        uint copy_count;// instances per occurrence of the shape, see Shape::copies()
+        luisa::vector<InstancedTransform> instances;
+        luisa::vector<ShapeOccurrence> occurrences;// each owns copy_count consecutive instances
     };
 
     struct MeshData {
@@ -58,21 +115,104 @@ public:
 
     static_assert(sizeof(MeshData) == 16u);
 
+    // transforms baked per motion group over the shutter span, see update_motion()
+    static constexpr auto motion_keyframe_count = 16u;
+    // visibility masks of the instances: bit 0 for static ones and bit g + 1 for motion
+    // group g, so that the rays of each group only traverse its own instances
+    static constexpr auto static_visibility = 1u;
+    static constexpr auto max_motion_groups = 7u;
+
+    // Binds the shutter time of the rays traced by the kernel being recorded on this
+    // thread, so that moving instances are interpolated from the baked keyframes.
+    // The time must be an expression of the kernel itself, not of a callable.
+    class ShutterTime {
+
+    private:
+        const compute::Expression *_previous;
+
+    public:
+        explicit ShutterTime(Expr<float> time) noexcept;
+        ~ShutterTime() noexcept;
+        ShutterTime(ShutterTime &&) noexcept = delete;
+        ShutterTime(const ShutterTime &) noexcept = delete;
+        ShutterTime &operator=(ShutterTime &&) noexcept = delete;
+        ShutterTime &operator=(const ShutterTime &) noexcept = delete;
+    };
+
 private:
     Pipeline &_pipeline;
     Accel _accel;
     TransformTree _transform_tree;
     luisa::vector<uint> _resource_store;
-    luisa::unordered_map<uint64_t, MeshGeometry> _mesh_cache;
+    luisa::vector<uint> _retired_resources;// of replaced geometries, see release_retired_resources()
+    luisa::vector<MeshGeometry> _mesh_geometries;
+    luisa::unordered_map<uint64_t, uint> _mesh_cache;// mesh key -> index into _mesh_geometries
+    luisa::vector<ProceduralGeometry> _procedural_geometries;
     luisa::unordered_map<const Shape *, MeshData> _meshes;
+    luisa::unordered_map<const Shape *, ShapeRecord> _shape_records;
     luisa::vector<Light::Handle> _instanced_lights;
     luisa::vector<uint4> _instances;
     luisa::vector<InstancedTransform> _dynamic_transforms;
+    luisa::vector<float4x4> _copy_transforms;// per-instance object transforms, identity unless copied
+    luisa::vector<uint2> _emission_buffer_ids;// per-instance (alias table, pdf) bindless ids, ~0u if not emissive
+    luisa::vector<Bounds> _instance_bounds;// per-instance object-space bounds of the geometry
+    luisa::vector<Bounds> _instance_world_bounds;
+    luisa::vector<bool> _instance_visible;
     Buffer<uint4> _instance_buffer;
+    Buffer<uint2> _emission_buffer;// only created if there are emissive instances
     float3 _world_min;
     float3 _world_max;
+    bool _has_procedural{false};
+    bool _light_instances_updated{false};
+    // instances sharing a dynamic transform node move together and form a motion group;
+    // the accel holds them at the reference time (the start of the span), and the keyframes
+    // hold their motion relative to it; with more than max_motion_groups groups, the accel is
+    // rebuilt per shutter sample instead
+    luisa::vector<const TransformTree::Node *> _motion_groups;
+    luisa::vector<uint> _motion_group_ids;// per instance, ~0u if static
+    luisa::vector<float4x4> _motion_keyframes;
+    float2 _motion_span{};
+    Buffer<uint> _motion_group_buffer;
+    Buffer<float4x4> _motion_keyframe_buffer;
+    Buffer<float2> _motion_span_buffer;
 
 private:
+    [[nodiscard]] uint _register_mesh(CommandBuffer &command_buffer, const Shape *shape) noexcept;
+    void _upload_mesh(CommandBuffer &command_buffer, MeshGeometry &geom, MeshView mesh,
+                      bool upload_triangles, AccelBuildRequest request) noexcept;
+    void _release_mesh(uint index) noexcept;
+    void _build_alias_table(CommandBuffer &command_buffer, MeshGeometry &geom, MeshView mesh) noexcept;
+    [[nodiscard]] float4x4 _instance_transform(const InstancedTransform &t, float time) const noexcept {
+        return t.matrix(time) * _copy_transforms[t.instance_id()];
+    }
+    [[nodiscard]] uint _register_spheres(CommandBuffer &command_buffer, const Shape *shape) noexcept;
+    void _upload_spheres(CommandBuffer &command_buffer, ProceduralGeometry &geom,
+                         luisa::span<const float4> spheres, AccelBuildRequest request) noexcept;
+    void _release_spheres(uint index) noexcept;
+    [[nodiscard]] bool _update_materials(CommandBuffer &command_buffer, const Shape *shape, ShapeRecord &record) noexcept;
+    void _set_instance_bounds(uint instance_id, const Bounds &object_bounds, const float4x4 &object_to_world) noexcept;
+    void _update_world_bounds() noexcept;
+    void _build_motion_groups(CommandBuffer &command_buffer, float init_time) noexcept;
+    void _set_dynamic_transforms(float2 span) noexcept;
+    void _update_motion_keyframes(CommandBuffer &command_buffer, float2 span) noexcept;
+    void _update_dynamic(CommandBuffer &command_buffer, float2 span) noexcept;
+    [[nodiscard]] luisa::optional<Expr<float>> _shutter_time() const noexcept;
+    [[nodiscard]] Float4x4 _motion_transform(Expr<uint> group, Expr<float> time) const noexcept;
+    [[nodiscard]] Var<Hit> _trace_motion_group(const Var<Ray> &world_ray, const Var<Ray> &ray,
+                                               Expr<uint> mask, Var<float> &best_t) const noexcept;
+    [[nodiscard]] Var<bool> _trace_any_motion_group(const Var<Ray> &world_ray, const Var<Ray> &ray,
+                                                    Expr<uint> mask) const noexcept;
+    void _process_procedural(
+        CommandBuffer &command_buffer, const Shape *shape, float init_time,
+        const Surface *surface, const Light *light, const Medium *medium, bool visible) noexcept;
+    void _update_procedural(CommandBuffer &command_buffer, const Shape *shape,
+                            ShapeRecord &record, float time) noexcept;
+    [[nodiscard]] Var<float> _intersect_sphere(const Var<Ray> &ray, Expr<uint> inst_id,
+                                               Expr<uint> prim_id, Expr<float> t_max) const noexcept;
+    [[nodiscard]] Var<float2> _sphere_uv(const Var<Ray> &ray, Expr<uint> inst_id,
+                                         Expr<uint> prim_id, Expr<float> t) const noexcept;
+    [[nodiscard]] ShadingAttribute _sphere_point(const Shape::Handle &instance, Expr<uint> prim_id,
+                                                 Expr<float2> uv, const Var<float4x4> &shape_to_world) const noexcept;
     void _process_shape(
         CommandBuffer &command_buffer, const Shape *shape, float init_time,
         const Surface *overridden_surface = nullptr,
@@ -84,11 +224,31 @@ public:
     explicit Geometry(Pipeline &pipeline) noexcept : _pipeline{pipeline} {};
     ~Geometry() noexcept;
     void build(CommandBuffer &command_buffer, luisa::span<const Shape *const> shapes, float init_time) noexcept;
+    // Moves the dynamic instances to the given time. Times inside the span baked by
+    // update_motion() are interpolated on the device and need no accel build.
     bool update(CommandBuffer &command_buffer, float time) noexcept;
+    // Builds the accel once for the whole shutter span and bakes the keyframes of the
+    // dynamic instances over it; rays of kernels with a bound ShutterTime see the
+    // instances at their own time. An empty span, or too many motion groups, leaves
+    // the build to the following update().
+    bool update_motion(CommandBuffer &command_buffer, float2 shutter_span) noexcept;
+    // Patches the meshes and instances of the given (already built) shapes in place.
+    // Returns false if the change is structural and requires a full rebuild.
+    [[nodiscard]] bool update_shapes(CommandBuffer &command_buffer,
+                                     const luisa::unordered_set<const Shape *> &shapes,
+                                     float time) noexcept;
+    // Removes the resources of the geometries replaced by update_shapes(), once the
+    // stream has finished the commands that may still reference them.
+    void release_retired_resources(CommandBuffer &command_buffer) noexcept;
+    // hands a replaced pipeline resource to release_retired_resources()
+    void retire_resource(uint index) noexcept { _retired_resources.emplace_back(index); }
     [[nodiscard]] auto instances() const noexcept { return luisa::span{_instances}; }
     [[nodiscard]] auto light_instances() const noexcept { return luisa::span{_instanced_lights}; }
+    // whether the last update_shapes() changed the lights of any instance
+    [[nodiscard]] auto light_instances_updated() const noexcept { return _light_instances_updated; }
     [[nodiscard]] auto world_min() const noexcept { return _world_min; }
     [[nodiscard]] auto world_max() const noexcept { return _world_max; }
+    // for procedural instances, Hit::bary holds the surface uv instead of barycentrics
     [[nodiscard]] Var<Hit> trace_closest(const Var<Ray> &ray) const noexcept;
     [[nodiscard]] Var<bool> trace_any(const Var<Ray> &ray) const noexcept;
     [[nodiscard]] luisa::shared_ptr<Interaction> interaction(const Var<Ray> &ray, const Var<Hit> &hit) const noexcept;
@@ -96,6 +256,9 @@ public:
                                                              Expr<float3> bary, Expr<float3> wo) const noexcept;
     [[nodiscard]] Shape::Handle instance(Expr<uint> index) const noexcept;
     [[nodiscard]] Float4x4 instance_to_world(Expr<uint> index) const noexcept;
+    // bindless ids of the area-sampling tables, only valid for emissive instances
+    [[nodiscard]] UInt alias_table_buffer_id(Expr<uint> index) const noexcept;
+    [[nodiscard]] UInt pdf_buffer_id(Expr<uint> index) const noexcept;
     [[nodiscard]] Var<Triangle> triangle(const Shape::Handle &instance, Expr<uint> index) const noexcept;
     [[nodiscard]] GeometryAttribute geometry_point(const Shape::Handle &instance, const Var<Triangle> &triangle,
                                                    const Var<float3> &bary, const Var<float4x4> &shape_to_world) const noexcept;
@@ -2,9 +2,12 @@
 // Created by Mike on 2021/12/14.
 //
 
+#include <luisa/dsl/sugar.h>
 #include <base/scene.h>
 #include <sdl/scene_node_desc.h>
 #include <util/progress_bar.h>
+#include <util/imageio.h>
+#include <util/colorspace.h>
 #include <base/integrator.h>
 #include <base/pipeline.h>
 
@@ -31,6 +34,33 @@ Integrator::Instance::Instance(Pipeline &pipeline, CommandBuffer &command_buffer
                      integrator->light_sampler()->build(pipeline, command_buffer) :
                      nullptr} {}
 
+void Integrator::Instance::update_light_sampler(CommandBuffer &command_buffer) noexcept {
+    if (!_pipeline.has_lighting()) { return; }
+    if (_light_sampler == nullptr || !_light_sampler->update(_pipeline, command_buffer)) {
+        _light_sampler = _integrator->light_sampler()->build(_pipeline, command_buffer);
+        _light_sampler_generation++;
+    }
+}
+
+void Integrator::Instance::render_to_buffer(
+    Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept {
+    LUISA_ERROR_WITH_LOCATION("Device-side rendering is not supported by this integrator.");
+}
+
+void Integrator::Instance::render_to_buffer(
+    Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept {
+    auto offset = 0u;
+    for (auto camera_index : camera_indices) {
+        if (camera_index >= pipeline().camera_count()) [[unlikely]] {
+            LUISA_ERROR("Invalid camera number {}.", camera_index);
+        }
+        auto resolution = pipeline().camera(camera_index)->film()->node()->resolution();
+        auto pixel_count = resolution.x * resolution.y;
+        render_to_buffer(stream, camera_index, framebuffer.subview(offset, pixel_count));
+        offset += pixel_count;
+    }
+}
+
 ProgressiveIntegrator::Instance::Instance(Pipeline &pipeline,
                                           CommandBuffer &command_buffer,
                                           const ProgressiveIntegrator *node) noexcept
@@ -40,9 +70,14 @@ ProgressiveIntegrator::Instance::~Instance() noexcept = default;
 
 void ProgressiveIntegrator::Instance::render(Stream &stream) noexcept {
     CommandBuffer command_buffer{&stream};
+    auto tile_size = node<ProgressiveIntegrator>()->tile_size();
     for (auto i = 0u; i < pipeline().camera_count(); i++) {
         auto camera = pipeline().camera(i);
         auto resolution = camera->film()->node()->resolution();
+        if (tile_size != 0u && any(resolution > tile_size)) {
+            _render_tiled(command_buffer, camera, make_uint2(tile_size));
+            continue;
+        }
         auto pixel_count = resolution.x * resolution.y;
         camera->film()->prepare(command_buffer);
         _render_one_camera(command_buffer, camera);
@@ -55,6 +90,71 @@ void ProgressiveIntegrator::Instance::render(Stream &stream) noexcept {
     }
 }
 
+void ProgressiveIntegrator::Instance::_render_tiled(
+    CommandBuffer &command_buffer, Camera::Instance *camera, uint2 tile_size) noexcept {
+    auto resolution = camera->film()->node()->resolution();
+    auto film_path = camera->node()->file();
+    if (film_path.extension() != ".exr") {
+        LUISA_WARNING_WITH_LOCATION(
+            "Tiled rendering only streams OpenEXR images. "
+            "Writing '{}' with the '.exr' extension instead.",
+            film_path.string());
+        film_path.replace_extension(".exr");
+    }
+    if (!_supports_tiles()) {
+        LUISA_WARNING_WITH_LOCATION(
+            "Integrator '{}' does not support tiled rendering. "
+            "Rendering the whole film as a single tile.",
+            node()->impl_type());
+        tile_size = resolution;
+    }
+    tile_size = min(tile_size, resolution);
+    LUISA_INFO("Rendering to '{}' of resolution {}x{} in {}x{} tiles.",
+               film_path.string(), resolution.x, resolution.y,
+               tile_size.x, tile_size.y);
+    // only one tile lives on the device and one band of tile rows on the host
+    ScanlineExrWriter writer{film_path, resolution};
+    luisa::vector<float4> tile(tile_size.x * tile_size.y);
+    luisa::vector<float4> band(resolution.x * tile_size.y);
+    _render_tiles(command_buffer, camera, tile_size, [&](uint2 offset, uint2 size) noexcept {
+        camera->film()->download(command_buffer, tile.data());
+        command_buffer << compute::synchronize();
+        for (auto y = 0u; y < size.y; y++) {
+            std::memcpy(band.data() + y * resolution.x + offset.x,
+                        tile.data() + y * size.x, size.x * sizeof(float4));
+        }
+        if (offset.x + size.x == resolution.x) {
+            writer.write_rows(offset.y, size.y, reinterpret_cast<const float *>(band.data()));
+        }
+    });
+    camera->film()->release();
+}
+
+luisa::vector<uint4> ProgressiveIntegrator::Instance::_split_into_tiles(uint2 resolution, uint2 tile_size) noexcept {
+    LUISA_ASSERT(all(tile_size > 0u), "Invalid tile size.");
+    luisa::vector<uint4> tiles;
+    auto tile_count = (resolution + tile_size - 1u) / tile_size;
+    tiles.reserve(tile_count.x * tile_count.y);
+    for (auto y = 0u; y < resolution.y; y += tile_size.y) {
+        for (auto x = 0u; x < resolution.x; x += tile_size.x) {
+            auto offset = make_uint2(x, y);
+            tiles.emplace_back(make_uint4(offset, min(tile_size, resolution - offset)));
+        }
+    }
+    return tiles;
+}
+
+void ProgressiveIntegrator::Instance::_render_tiles(
+    CommandBuffer &command_buffer, Camera::Instance *camera,
+    uint2 tile_size, const TileCallback &on_tile_rendered) noexcept {
+    auto resolution = camera->film()->node()->resolution();
+    for (auto tile : _split_into_tiles(resolution, tile_size)) {
+        camera->film()->prepare_window(command_buffer, tile.xy(), tile.zw());
+        _render_one_camera(command_buffer, camera);
+        on_tile_rendered(tile.xy(), tile.zw());
+    }
+}
+
 luisa::unique_ptr<luisa::vector<float4>> ProgressiveIntegrator::Instance::render_to_buffer(
     Stream &stream, uint camera_index) noexcept {
     CommandBuffer command_buffer{&stream};
@@ -73,38 +173,314 @@ luisa::unique_ptr<luisa::vector<float4>> ProgressiveIntegrator::Instance::render
     return buffer;
 }
 
+void ProgressiveIntegrator::Instance::render_to_buffer(
+    Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept {
+    CommandBuffer command_buffer{&stream};
+    if (camera_index >= pipeline().camera_count()) [[unlikely]] {
+        LUISA_ERROR("Invalid camera number {}.", camera_index);
+    }
+    auto camera = pipeline().camera(camera_index);
+    camera->film()->prepare(command_buffer);
+    _render_one_camera(command_buffer, camera);
+    camera->film()->download(command_buffer, framebuffer);
+    command_buffer << compute::synchronize();
+    camera->film()->release();
+}
+
+void ProgressiveIntegrator::Instance::render_to_buffer(
+    Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept {
+    CommandBuffer command_buffer{&stream};
+    luisa::vector<Camera::Instance *> cameras;
+    cameras.reserve(camera_indices.size());
+    for (auto camera_index : camera_indices) {
+        if (camera_index >= pipeline().camera_count()) [[unlikely]] {
+            LUISA_ERROR("Invalid camera number {}.", camera_index);
+        }
+        auto camera = pipeline().camera(camera_index);
+        camera->film()->prepare(command_buffer);
+        cameras.emplace_back(camera);
+    }
+    _render_cameras(command_buffer, cameras);
+    auto offset = 0u;
+    for (auto camera : cameras) {
+        auto resolution = camera->film()->node()->resolution();
+        auto pixel_count = resolution.x * resolution.y;
+        camera->film()->download(command_buffer, framebuffer.subview(offset, pixel_count));
+        offset += pixel_count;
+    }
+    command_buffer << compute::synchronize();
+    for (auto camera : cameras) { camera->film()->release(); }
+}
+
+void ProgressiveIntegrator::Instance::_check_render_shader_generation() noexcept {
+    // camera instances are only replaced together with a new shader generation
+    if (_render_shader_generation != pipeline().shader_generation()) {
+        _render_shaders.clear();
+        _batch_render_shaders.clear();
+        _render_shader_generation = pipeline().shader_generation();
+    }
+}
+
+ProgressiveIntegrator::Instance::RenderShaderKey
+ProgressiveIntegrator::Instance::_render_shader_key(
+    luisa::span<Camera::Instance *const> cameras, uint2 resolution) const noexcept {
+    // film generations only grow, so their sum changes whenever any of them does
+    auto film_generation = 0u;
+    for (auto camera : cameras) { film_generation += camera->film()->generation(); }
+    return RenderShaderKey{
+        .sampler_generation = sampler()->generation(),
+        .film_generation = film_generation,
+        .light_sampler_generation = light_sampler_generation(),
+        .resolution = resolution,
+        .spp = cameras.front()->node()->spp(),
+        .surface_types = luisa::string{pipeline().surface_types()},
+        .light_types = luisa::string{pipeline().light_types()},
+        .medium_types = luisa::string{pipeline().medium_types()}};
+}
+
+ProgressiveIntegrator::Instance::CachedRenderShader &
+ProgressiveIntegrator::Instance::_render_shader(Camera::Instance *camera) noexcept {
+    _check_render_shader_generation();
+    auto key = _render_shader_key(luisa::span{&camera, 1u}, camera->film()->node()->resolution());
+    auto &cached = _render_shaders[camera];
+    if (cached.shader != nullptr && cached.key == key) { return cached; }
+    cached.adaptive_shader = nullptr;
+    cached.convergence_shader = nullptr;
+
+    using namespace luisa::compute;
+    Kernel2D render_kernel = [&](UInt frame_index, Float time, Float shutter_weight, UInt2 tile_offset) noexcept {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = tile_offset + dispatch_id().xy();
+        Geometry::ShutterTime shutter_time{time};
+        auto L = Li(camera, frame_index, pixel_id, time);
+        camera->film()->accumulate_exclusive(pixel_id, shutter_weight * L);
+    };
+    Clock clock_compile;
+    cached.shader = luisa::make_unique<RenderShader>(pipeline().device().compile(render_kernel));
+    cached.key = std::move(key);
+    auto integrator_shader_compilation_time = clock_compile.toc();
+    LUISA_INFO("Integrator shader compile in {} ms.", integrator_shader_compilation_time);
+    return cached;
+}
+
+void ProgressiveIntegrator::Instance::_compile_adaptive_shaders(
+    Camera::Instance *camera, CachedRenderShader &cached) noexcept {
+    if (cached.adaptive_shader != nullptr) { return; }
+    using namespace luisa::compute;
+    Kernel1D adaptive_render_kernel = [&](UInt frame_index, Float time, Float shutter_weight,
+                                          BufferUInt active_pixels, UInt2 tile_offset, UInt tile_width) noexcept {
+        auto index = active_pixels.read(dispatch_x());
+        auto pixel_id = tile_offset + make_uint2(index % tile_width, index / tile_width);
+        Geometry::ShutterTime shutter_time{time};
+        auto L = Li(camera, frame_index, pixel_id, time);
+        camera->film()->accumulate_exclusive(pixel_id, shutter_weight * L);
+    };
+    Kernel2D convergence_kernel = [&](UInt2 tile_offset, Float threshold,
+                                      BufferUInt active_pixels, BufferUInt active_count) noexcept {
+        set_block_size(16u, 16u, 1u);
+        auto p = dispatch_id().xy();
+        auto accum = camera->film()->read(tile_offset + p);
+        // the floor keeps near-black pixels from being sampled forever
+        auto relative_error = sqrt(accum.variance) / (srgb_to_cie_y(accum.average) + 1e-2f);
+        $if(relative_error >= threshold) {
+            auto slot = active_count.atomic(0u).fetch_add(1u);
+            active_pixels.write(slot, p.y * dispatch_size_x() + p.x);
+        };
+    };
+    Clock clock_compile;
+    cached.adaptive_shader = luisa::make_unique<AdaptiveRenderShader>(pipeline().device().compile(adaptive_render_kernel));
+    cached.convergence_shader = luisa::make_unique<ConvergenceShader>(pipeline().device().compile(convergence_kernel));
+    LUISA_INFO("Adaptive sampling shaders compile in {} ms.", clock_compile.toc());
+}
+
+uint ProgressiveIntegrator::Instance::_update_active_pixels(
+    CommandBuffer &command_buffer, Camera::Instance *camera, CachedRenderShader &cached) noexcept {
+    auto tile_offset = camera->film()->window_offset();
+    auto tile_size = camera->film()->window_size();
+    auto pixel_count = tile_size.x * tile_size.y;
+    if (!_active_pixels || _active_pixels.size() < pixel_count) {
+        _active_pixels = pipeline().device().create_buffer<uint>(pixel_count);
+    }
+    if (!_active_pixel_count) {
+        _active_pixel_count = pipeline().device().create_buffer<uint>(1u);
+    }
+    auto active_count = 0u;
+    auto threshold = node<ProgressiveIntegrator>()->adaptive_threshold();
+    command_buffer << _active_pixel_count.copy_from(&active_count)
+                   << (*cached.convergence_shader)(tile_offset, threshold, _active_pixels, _active_pixel_count)
+                          .dispatch(tile_size)
+                   << _active_pixel_count.copy_to(&active_count)
+                   << compute::synchronize();
+    return active_count;
+}
+
+namespace {
+
+// Presents a batch of cameras as a single one, picking the camera by a runtime index.
+class CameraBatch final : public Camera::Instance {
+
+private:
+    luisa::span<Camera::Instance *const> _cameras;
+    UInt _index;
+
+private:
+    [[nodiscard]] std::pair<Var<Ray>, Float>
+    _generate_ray_in_camera_space(Expr<float2>, Expr<float2>, Expr<float>) const noexcept override {
+        LUISA_ERROR_WITH_LOCATION("CameraBatch only forwards to the batched cameras.");
+    }
+
+    template<typename F>
+    void _dispatch(F &&f) const noexcept {
+        $switch(_index) {
+            for (auto i = 0u; i < _cameras.size(); i++) {
+                $case(i) { f(_cameras[i]); };
+            }
+            $default { compute::unreachable(); };
+        };
+    }
+
+public:
+    CameraBatch(luisa::span<Camera::Instance *const> cameras, Expr<uint> index) noexcept
+        : Camera::Instance{cameras.front()->pipeline(), cameras.front()->node()},
+          _cameras{cameras}, _index{index} {}
+    [[nodiscard]] Sample generate_ray(Expr<uint2> pixel_coord, Expr<float> time,
+                                      Expr<float2> u_filter, Expr<float2> u_lens) const noexcept override {
+        Var<Ray> ray;
+        Float2 pixel;
+        Float weight;
+        _dispatch([&](const Camera::Instance *camera) noexcept {
+            auto s = camera->generate_ray(pixel_coord, time, u_filter, u_lens);
+            ray = s.ray;
+            pixel = s.pixel;
+            weight = s.weight;
+        });
+        return {std::move(ray), std::move(pixel), std::move(weight)};
+    }
+    [[nodiscard]] SampleDifferential generate_ray_differential(Expr<uint2> pixel_coord, Expr<float> time,
+                                                               Expr<float2> u_filter, Expr<float2> u_lens) const noexcept override {
+        Var<Ray> ray;
+        Float3 rx_origin, ry_origin, rx_direction, ry_direction;
+        Float2 pixel;
+        Float weight;
+        _dispatch([&](const Camera::Instance *camera) noexcept {
+            auto s = camera->generate_ray_differential(pixel_coord, time, u_filter, u_lens);
+            ray = s.ray_differential.ray;
+            rx_origin = s.ray_differential.rx_origin;
+            ry_origin = s.ray_differential.ry_origin;
+            rx_direction = s.ray_differential.rx_direction;
+            ry_direction = s.ray_differential.ry_direction;
+            pixel = s.pixel;
+            weight = s.weight;
+        });
+        return {.ray_differential = {.ray = std::move(ray),
+                                     .rx_origin = rx_origin,
+                                     .ry_origin = ry_origin,
+                                     .rx_direction = rx_direction,
+                                     .ry_direction = ry_direction},
+                .pixel = pixel,
+                .weight = weight};
+    }
+    [[nodiscard]] Float4x4 camera_to_world() const noexcept override {
+        Float4x4 m;
+        _dispatch([&](const Camera::Instance *camera) noexcept { m = camera->camera_to_world(); });
+        return m;
+    }
+    [[nodiscard]] UInt2 resolution() const noexcept {
+        UInt2 r;
+        _dispatch([&](const Camera::Instance *camera) noexcept { r = camera->film()->node()->resolution(); });
+        return r;
+    }
+    void accumulate(Expr<uint2> pixel, Expr<float3> rgb) const noexcept {
+        _dispatch([&](const Camera::Instance *camera) noexcept { camera->film()->accumulate_exclusive(pixel, rgb); });
+    }
+};
+
+}// namespace
+
+const ProgressiveIntegrator::Instance::BatchRenderShader &
+ProgressiveIntegrator::Instance::_batch_render_shader(
+    luisa::span<Camera::Instance *const> cameras, uint2 resolution) noexcept {
+    _check_render_shader_generation();
+    auto key = _render_shader_key(cameras, resolution);
+    auto iter = std::find_if(
+        _batch_render_shaders.begin(), _batch_render_shaders.end(), [cameras](auto &&cached) noexcept {
+            return std::equal(cached.cameras.cbegin(), cached.cameras.cend(),
+                              cameras.begin(), cameras.end());
+        });
+    if (iter == _batch_render_shaders.end()) {
+        iter = _batch_render_shaders.emplace(_batch_render_shaders.end());
+        iter->cameras = {cameras.begin(), cameras.end()};
+    }
+    if (iter->shader != nullptr && iter->key == key) { return *iter->shader; }
+
+    using namespace luisa::compute;
+    Kernel3D render_kernel = [&](UInt frame_index, Float time, Float shutter_weight) noexcept {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = dispatch_id().xy();
+        CameraBatch batch{cameras, dispatch_id().z};
+        Geometry::ShutterTime shutter_time{time};
+        // smaller cameras in the batch leave part of the dispatch idle
+        $if(all(pixel_id < batch.resolution())) {
+            auto L = Li(std::addressof(batch), frame_index, pixel_id, time);
+            batch.accumulate(pixel_id, shutter_weight * L);
+        };
+    };
+    Clock clock_compile;
+    iter->shader = luisa::make_unique<BatchRenderShader>(pipeline().device().compile(render_kernel));
+    iter->key = std::move(key);
+    auto integrator_shader_compilation_time = clock_compile.toc();
+    LUISA_INFO("Integrator shader for {} camera(s) compile in {} ms.",
+               cameras.size(), integrator_shader_compilation_time);
+    return *iter->shader;
+}
+
 void ProgressiveIntegrator::Instance::_render_one_camera(
     CommandBuffer &command_buffer, Camera::Instance *camera) noexcept {
 
     auto spp = camera->node()->spp();
     auto resolution = camera->film()->node()->resolution();
+    auto tile_offset = camera->film()->window_offset();
+    auto tile_size = camera->film()->window_size();
     auto image_file = camera->node()->file();
 
-    auto pixel_count = resolution.x * resolution.y;
+    // samples are keyed by film coordinates, so tiles match the untiled image
+    auto pixel_count = tile_size.x * tile_size.y;
     sampler()->reset(command_buffer, resolution, pixel_count, spp);
     command_buffer << pipeline().printer().reset();
     command_buffer << compute::synchronize();
 
-    LUISA_INFO(
-        "Rendering to '{}' of resolution {}x{} at {}spp.",
-        image_file.string(),
-        resolution.x, resolution.y, spp);
+    if (all(tile_size == resolution)) {
+        LUISA_INFO(
+            "Rendering to '{}' of resolution {}x{} at {}spp.",
+            image_file.string(),
+            resolution.x, resolution.y, spp);
+    } else {
+        LUISA_INFO(
+            "Rendering tile ({}, {}) of size {}x{} at {}spp.",
+            tile_offset.x, tile_offset.y,
+            tile_size.x, tile_size.y, spp);
+    }
 
     using namespace luisa::compute;
 
-    Kernel2D render_kernel = [&](UInt frame_index, Float time, Float shutter_weight) noexcept {
-        set_block_size(16u, 16u, 1u);
-        auto pixel_id = dispatch_id().xy();
-        auto L = Li(camera, frame_index, pixel_id, time);
-        camera->film()->accumulate(pixel_id, shutter_weight * L);
-    };
-
-    Clock clock_compile;
-    auto render = pipeline().device().compile(render_kernel);
-    auto integrator_shader_compilation_time = clock_compile.toc();
-    LUISA_INFO("Integrator shader compile in {} ms.", integrator_shader_compilation_time);
     auto shutter_samples = camera->node()->shutter_samples();
+    // stopping early would drop the later shutter samples, so only static shutters adapt
+    auto adaptive = node<ProgressiveIntegrator>()->adaptive_threshold() > 0.f;
+    if (adaptive && shutter_samples.size() > 1u) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION(
+            "Adaptive sampling is disabled for cameras with multiple shutter samples.");
+        adaptive = false;
+    }
+    // before the render shader is looked up, as tracking changes the film generation
+    if (adaptive) { camera->film()->track_variance(command_buffer); }
+
+    auto &cached = _render_shader(camera);
+    auto &render = *cached.shader;
     command_buffer << synchronize();
+    if (adaptive) { _compile_adaptive_shaders(camera, cached); }
+    auto adaptive_min_spp = node<ProgressiveIntegrator>()->adaptive_min_spp();
+    auto adaptive_interval = node<ProgressiveIntegrator>()->adaptive_interval();
+    auto active_count = pixel_count;
 
     LUISA_INFO("Rendering started.");
     Clock clock;
@@ -112,10 +488,22 @@ void ProgressiveIntegrator::Instance::_render_one_camera(
     progress.update(0.);
     auto dispatch_count = 0u;
     auto sample_id = 0u;
+    // the shutter samples below are interpolated on the device and trigger no further builds
+    pipeline().update_motion(command_buffer, camera->node()->shutter_span());
     for (auto s : shutter_samples) {
-        auto updated = pipeline().update(command_buffer, s.point.time);     // TODO: UniSim, update is not needed
+        auto updated = pipeline().update(command_buffer, s.point.time);
         for (auto i = 0u; i < s.spp; i++) {
-            command_buffer << render(sample_id++, s.point.time, s.point.weight).dispatch(resolution);
+            if (adaptive && sample_id >= adaptive_min_spp) {
+                if ((sample_id - adaptive_min_spp) % adaptive_interval == 0u) {
+                    active_count = _update_active_pixels(command_buffer, camera, cached);
+                    if (active_count == 0u) { break; }
+                }
+                command_buffer << (*cached.adaptive_shader)(sample_id++, s.point.time, s.point.weight,
+                                                            _active_pixels, tile_offset, tile_size.x)
+                                      .dispatch(active_count);
+            } else {
+                command_buffer << render(sample_id++, s.point.time, s.point.weight, tile_offset).dispatch(tile_size);
+            }
             if (auto &&p = pipeline().printer(); !p.empty()) {
                 command_buffer << p.retrieve();
             }
@@ -131,18 +519,82 @@ void ProgressiveIntegrator::Instance::_render_one_camera(
     progress.done();
 
     auto render_time = clock.toc();
+    if (adaptive && sample_id < spp) {
+        LUISA_INFO("All pixels converged after {} of {} spp.", sample_id, spp);
+    }
     LUISA_INFO("Rendering finished in {} ms.", render_time);
 }
 
+void ProgressiveIntegrator::Instance::_render_cameras(
+    CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept {
+    for (auto camera : cameras) { _render_one_camera(command_buffer, camera); }
+}
+
+void ProgressiveIntegrator::Instance::_render_camera_batch(
+    CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept {
+    if (cameras.empty()) { return; }
+    auto front = cameras.front()->node();
+    auto batchable = std::all_of(cameras.begin(), cameras.end(), [front](auto camera) noexcept {
+        auto node = camera->node();
+        return node->spp() == front->spp() &&
+               all(node->shutter_span() == front->shutter_span()) &&
+               node->requires_lens_sampling() == front->requires_lens_sampling();
+    });
+    if (!batchable) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION(
+            "Cameras with different spp, shutter spans or lens "
+            "sampling cannot be batched. Rendering them one by one.");
+    }
+    if (cameras.size() == 1u || !batchable) {
+        for (auto camera : cameras) { Instance::_render_one_camera(command_buffer, camera); }
+        return;
+    }
+
+    // all cameras share the sample sequence of the largest one
+    auto resolution = make_uint2(0u);
+    for (auto camera : cameras) {
+        resolution = max(resolution, camera->film()->node()->resolution());
+    }
+    auto spp = front->spp();
+    sampler()->reset(command_buffer, resolution, resolution.x * resolution.y, spp);
+    command_buffer << pipeline().printer().reset();
+
+    LUISA_INFO(
+        "Rendering {} cameras of resolution up to {}x{} at {}spp.",
+        cameras.size(), resolution.x, resolution.y, spp);
+
+    auto &render = _batch_render_shader(cameras, resolution);
+    auto dispatch_size = make_uint3(resolution, static_cast<uint>(cameras.size()));
+    auto sample_id = 0u;
+    pipeline().update_motion(command_buffer, front->shutter_span());
+    for (auto s : front->shutter_samples()) {
+        static_cast<void>(pipeline().update(command_buffer, s.point.time));
+        for (auto i = 0u; i < s.spp; i++) {
+            command_buffer << render(sample_id++, s.point.time, s.point.weight).dispatch(dispatch_size);
+            if (auto &&p = pipeline().printer(); !p.empty()) {
+                command_buffer << p.retrieve();
+            }
+        }
+    }
+}
+
 Float3 ProgressiveIntegrator::Instance::Li(const Camera::Instance *camera, Expr<uint> frame_index,
                                            Expr<uint2> pixel_id, Expr<float> time) const noexcept {
     LUISA_ERROR_WITH_LOCATION("ProgressiveIntegrator::Li() is not implemented.");
 }
 
 ProgressiveIntegrator::ProgressiveIntegrator(Scene *scene, const SceneNodeDesc *desc) noexcept
-    : Integrator{scene, desc} {}
+    : Integrator{scene, desc},
+      _tile_size{desc->property_uint_or_default("tile_size", 0u)},
+      _adaptive_threshold{std::max(desc->property_float_or_default("adaptive_threshold", 0.f), 0.f)},
+      _adaptive_min_spp{desc->property_uint_or_default("adaptive_min_spp", 32u)},
+      _adaptive_interval{std::max(desc->property_uint_or_default("adaptive_interval", 16u), 1u)} {}
 
 ProgressiveIntegrator::ProgressiveIntegrator(Scene *scene, const RawIntegratorInfo &integrator_info) noexcept
-    : Integrator{scene, integrator_info} {}
+    : Integrator{scene, integrator_info},
+      _tile_size{0u},
+      _adaptive_threshold{0.f},
+      _adaptive_min_spp{32u},
+      _adaptive_interval{16u} {}
 
 }// namespace luisa::render
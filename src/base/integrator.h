@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <luisa/runtime/shader.h>
 #include <util/command_buffer.h>
 #include <base/scene_node.h>
 #include <base/sampler.h>
@@ -26,6 +27,7 @@ public:
         const Integrator *_integrator;
         luisa::unique_ptr<Sampler::Instance> _sampler;
         luisa::unique_ptr<LightSampler::Instance> _light_sampler;
+        uint _light_sampler_generation{0u};
 
     public:
         explicit Instance(Pipeline &pipeline, CommandBuffer &command_buffer, const Integrator *integrator) noexcept;
@@ -40,9 +42,16 @@ public:
         [[nodiscard]] auto sampler() const noexcept { return _sampler.get(); }
         [[nodiscard]] auto light_sampler() noexcept { return _light_sampler.get(); }
         [[nodiscard]] auto light_sampler() const noexcept { return _light_sampler.get(); }
+        [[nodiscard]] auto light_sampler_generation() const noexcept { return _light_sampler_generation; }
         [[nodiscard]] bool use_progress() const noexcept { return _integrator->use_progress(); }
+        // called when lights, emissive instances or the environment changed
+        virtual void update_light_sampler(CommandBuffer &command_buffer) noexcept;
         virtual void render(Stream &stream) noexcept = 0;
         virtual luisa::unique_ptr<luisa::vector<float4>> render_to_buffer(Stream &stream, uint camera_index) noexcept = 0;
+        // renders into a device buffer; returns once the stream has finished and the film is released
+        virtual void render_to_buffer(Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept;
+        // renders several cameras into one buffer, packed back to back in the given order
+        virtual void render_to_buffer(Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept;
     };
 
 private:
@@ -65,10 +74,77 @@ class ProgressiveIntegrator : public Integrator {
 public:
     class Instance : public Integrator::Instance {
 
+    private:
+        using RenderShader = compute::Shader2D<uint, float, float, uint2>;
+        using BatchRenderShader = compute::Shader3D<uint, float, float>;
+        // renders a compacted list of unconverged pixels of the window
+        using AdaptiveRenderShader = compute::Shader1D<uint, float, float, compute::Buffer<uint>, uint2, uint>;
+        // appends the window pixels whose relative error is above the threshold to the list
+        using ConvergenceShader = compute::Shader2D<uint2, float, compute::Buffer<uint>, compute::Buffer<uint>>;
+        // everything baked into the render kernel besides the integrator itself
+        struct RenderShaderKey {
+            uint sampler_generation;
+            uint film_generation;
+            uint light_sampler_generation;
+            uint2 resolution;
+            uint spp;
+            // the code dispatched to, which does not change with lights or materials joining a batch
+            luisa::string surface_types;
+            luisa::string light_types;
+            luisa::string medium_types;
+            [[nodiscard]] bool operator==(const RenderShaderKey &) const noexcept = default;
+        };
+        struct CachedRenderShader {
+            RenderShaderKey key;
+            luisa::unique_ptr<RenderShader> shader;
+            // compiled on first use by adaptive sampling
+            luisa::unique_ptr<AdaptiveRenderShader> adaptive_shader;
+            luisa::unique_ptr<ConvergenceShader> convergence_shader;
+        };
+        struct CachedBatchRenderShader {
+            luisa::vector<const Camera::Instance *> cameras;
+            RenderShaderKey key;
+            luisa::unique_ptr<BatchRenderShader> shader;
+        };
+        luisa::unordered_map<const Camera::Instance *, CachedRenderShader> _render_shaders;
+        luisa::vector<CachedBatchRenderShader> _batch_render_shaders;
+        uint _render_shader_generation{0u};
+        compute::Buffer<uint> _active_pixels;
+        compute::Buffer<uint> _active_pixel_count;
+
+    private:
+        void _check_render_shader_generation() noexcept;
+        void _render_tiled(CommandBuffer &command_buffer, Camera::Instance *camera, uint2 tile_size) noexcept;
+        [[nodiscard]] RenderShaderKey _render_shader_key(luisa::span<Camera::Instance *const> cameras,
+                                                         uint2 resolution) const noexcept;
+        [[nodiscard]] CachedRenderShader &_render_shader(Camera::Instance *camera) noexcept;
+        void _compile_adaptive_shaders(Camera::Instance *camera, CachedRenderShader &cached) noexcept;
+        // rebuilds the list of unconverged pixels and returns their count
+        [[nodiscard]] uint _update_active_pixels(CommandBuffer &command_buffer, Camera::Instance *camera,
+                                                 CachedRenderShader &cached) noexcept;
+        [[nodiscard]] const BatchRenderShader &_batch_render_shader(luisa::span<Camera::Instance *const> cameras,
+                                                                    uint2 resolution) noexcept;
+
     protected:
+        using TileCallback = luisa::function<void(uint2 /* offset */, uint2 /* size */)>;
+        // splits the resolution into row-major (offset.x, offset.y, size.x, size.y) tiles
+        [[nodiscard]] static luisa::vector<uint4> _split_into_tiles(uint2 resolution, uint2 tile_size) noexcept;
         [[nodiscard]] virtual Float3 Li(const Camera::Instance *camera, Expr<uint> frame_index,
                                         Expr<uint2> pixel_id, Expr<float> time) const noexcept;
+        // renders the current window of the camera's film
         virtual void _render_one_camera(CommandBuffer &command_buffer, Camera::Instance *camera) noexcept;
+        // prepares the film window for each tile in row-major order, renders it and then
+        // invokes the callback while the tile is still on the device
+        virtual void _render_tiles(CommandBuffer &command_buffer, Camera::Instance *camera,
+                                   uint2 tile_size, const TileCallback &on_tile_rendered) noexcept;
+        // integrators that need the whole film at once (e.g. for screen-space
+        // reconstruction or global sample statistics) render it as a single tile
+        [[nodiscard]] virtual bool _supports_tiles() const noexcept { return true; }
+        // renders the cameras one by one, integrators whose Li() only relies on
+        // Camera::Instance::generate_ray() may forward to _render_camera_batch()
+        virtual void _render_cameras(CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept;
+        // one 3D dispatch over (pixel.x, pixel.y, camera) per sample
+        void _render_camera_batch(CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept;
 
     public:
         Instance(Pipeline &pipeline,
@@ -77,11 +153,26 @@ public:
         ~Instance() noexcept override;
         void render(Stream &stream) noexcept override;
         luisa::unique_ptr<luisa::vector<float4>> render_to_buffer(Stream &stream, uint camera_index) noexcept override;
+        void render_to_buffer(Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept override;
+        void render_to_buffer(Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept override;
     };
 
+private:
+    uint _tile_size;
+    float _adaptive_threshold;
+    uint _adaptive_min_spp;
+    uint _adaptive_interval;
+
 public:
     ProgressiveIntegrator(Scene *scene, const SceneNodeDesc *desc) noexcept;
     ProgressiveIntegrator(Scene *scene, const RawIntegratorInfo &integrator_info) noexcept;
+    // films larger than this are rendered tile by tile and streamed to disk, 0 disables tiling
+    [[nodiscard]] auto tile_size() const noexcept { return _tile_size; }
+    // pixels whose relative error drops below the threshold stop receiving samples,
+    // checked every adaptive_interval samples after adaptive_min_spp; 0 disables it
+    [[nodiscard]] auto adaptive_threshold() const noexcept { return _adaptive_threshold; }
+    [[nodiscard]] auto adaptive_min_spp() const noexcept { return _adaptive_min_spp; }
+    [[nodiscard]] auto adaptive_interval() const noexcept { return _adaptive_interval; }
 };
 
 }// namespace luisa::render
@@ -26,7 +26,7 @@ class Light : public SceneNode {
 public:
     struct Handle {
         uint instance_id;
-        uint light_tag;
+        uint light_tag;// light id, see Pipeline::light()
     };
 
     struct Evaluation {
@@ -101,6 +101,9 @@ public:
     Light(Scene *scene, const SceneNodeDesc *desc) noexcept;
     Light(Scene *scene) noexcept;
     [[nodiscard]] virtual bool is_null() const noexcept { return false; }
+    // lights with equal non-empty keys and equally shaped textures share one polymorphic tag,
+    // with constant texture values moved into per-light parameters, see Pipeline::register_light
+    [[nodiscard]] virtual luisa::string batch_key() const noexcept { return {}; }
     [[nodiscard]] virtual luisa::unique_ptr<Instance> build(
         Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept = 0;
 };
@@ -65,6 +65,8 @@ public:
             requires std::is_base_of_v<LightSampler, T>
         [[nodiscard]] auto node() const noexcept { return static_cast<const T *>(_sampler); }
         [[nodiscard]] auto &pipeline() const noexcept { return _pipeline; }
+        // refreshes the sampled lights in place, returns false if the instance has to be rebuilt
+        [[nodiscard]] virtual bool update(Pipeline &pipeline, CommandBuffer &command_buffer) noexcept { return false; }
         [[nodiscard]] virtual Evaluation evaluate_hit(
             const Interaction &it, Expr<float3> p_from,
             const SampledWavelengths &swl, Expr<float> time) const noexcept = 0;
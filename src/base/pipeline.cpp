@@ -9,35 +9,128 @@
 
 namespace luisa::render {
 
+namespace detail {
+
+// a constant texture of a batched surface or light, read from the parameters of the shape being shaded
+class BatchParameterTexture final : public Texture::Instance {
+
+private:
+    uint _offset;
+    bool _emission;
+
+public:
+    BatchParameterTexture(const Pipeline &pipeline, const Texture *texture, uint offset, bool emission) noexcept
+        : Texture::Instance{pipeline, texture}, _offset{offset}, _emission{emission} {}
+    [[nodiscard]] luisa::optional<float4> evaluate_static() const noexcept override { return luisa::nullopt; }
+    [[nodiscard]] Float4 evaluate(const Interaction &it,
+                                  const SampledWavelengths &swl,
+                                  Expr<float> time) const noexcept override {
+        auto base = _emission ? it.shape().light_parameters() : it.shape().surface_parameters();
+        return pipeline().constant(base + _offset);
+    }
+};
+
+}// namespace detail
+
 inline Pipeline::Pipeline(Device &device) noexcept
     : _device{device},
       _bindless_array{device.create_bindless_array(bindless_array_capacity)},
       _general_buffer_arena{luisa::make_unique<BufferArena>(device, 16_M)},
-      _printer{luisa::make_unique<compute::Printer>(device)} {}
+      _material_buffer{device.create_buffer<uint2>(material_capacity)},
+      _light_buffer{device.create_buffer<uint2>(light_capacity)},
+      _printer{luisa::make_unique<compute::Printer>(device)} {
+    // never reallocated, so that pending uploads may point into them
+    _materials.reserve(material_capacity);
+    _light_entries.reserve(light_capacity);
+}
 
 Pipeline::~Pipeline() noexcept = default;
 
+template<typename Node, typename T>
+uint2 Pipeline::_register_batched(CommandBuffer &command_buffer, const Node *node,
+                                  luisa::string_view batch_key, bool emission,
+                                  Polymorphic<T> &instances,
+                                  luisa::unordered_map<luisa::string, uint> &batches,
+                                  luisa::string &types) noexcept {
+    // constant textures become parameters while the node is built
+    auto parameter_texture_count = _parameter_textures.size();
+    _parameter_record.emplace(ParameterRecord{.emission = emission});
+    auto instance = node->build(*this, command_buffer);
+    auto record = std::move(*_parameter_record);
+    _parameter_record.reset();
+    auto key = luisa::format("{}|{}", batch_key, record.signature);
+    auto tag = 0u;
+    if (auto iter = batches.find(key); iter != batches.end()) {
+        // same code as an earlier node, the instance was only built to collect the parameters
+        tag = iter->second;
+        instance = nullptr;
+        _parameter_textures.resize(parameter_texture_count);
+    } else {
+        tag = instances.emplace(std::move(instance));
+        types.append(key).append(";");
+        batches.emplace(std::move(key), tag);
+    }
+    auto parameter_base = 0u;
+    if (!record.parameters.empty()) {
+        // slots are handed out sequentially, so the parameters of a node are contiguous
+        parameter_base = allocate_constant_slot().second;
+        for (auto i = 1u; i < record.parameters.size(); i++) {
+            static_cast<void>(allocate_constant_slot());
+        }
+        auto &parameters = _batch_parameters.emplace_back(std::move(record.parameters));
+        command_buffer << _constant_buffer.view(parameter_base, parameters.size())
+                              .copy_from(parameters.data());
+    }
+    return make_uint2(tag, parameter_base);
+}
+
 uint Pipeline::register_surface(CommandBuffer &command_buffer, const Surface *surface) noexcept {
-    if (auto iter = _surface_tags.find(surface);
-        iter != _surface_tags.end()) { return iter->second; }
-    auto tag = _surfaces.emplace(surface->build(*this, command_buffer));
-    _surface_tags.emplace(surface, tag);
-    return tag;
+    if (auto iter = _material_ids.find(surface);
+        iter != _material_ids.end()) { return iter->second; }
+    auto material_id = static_cast<uint>(_materials.size());
+    LUISA_ASSERT(material_id < material_capacity,
+                 "Too many materials (limit = {}).", material_capacity);
+    if (auto batch_key = surface->batch_key(); batch_key.empty()) {
+        auto tag = _surfaces.emplace(surface->build(*this, command_buffer));
+        _surface_types.append(luisa::format("{}#{};", surface->impl_type(), tag));
+        _materials.emplace_back(make_uint2(tag, 0u));
+    } else {
+        auto key = luisa::format("{}|{}", batch_key, surface->properties());
+        _materials.emplace_back(_register_batched(
+            command_buffer, surface, key, false, _surfaces, _surface_batches, _surface_types));
+    }
+    command_buffer << _material_buffer.view(material_id, 1u)
+                          .copy_from(&_materials[material_id]);
+    _material_ids.emplace(surface, material_id);
+    return material_id;
 }
 
 uint Pipeline::register_light(CommandBuffer &command_buffer, const Light *light) noexcept {
-    if (auto iter = _light_tags.find(light);
-        iter != _light_tags.end()) { return iter->second; }
-    auto tag = _lights.emplace(light->build(*this, command_buffer));
-    _light_tags.emplace(light, tag);
+    if (auto iter = _light_ids.find(light);
+        iter != _light_ids.end()) { return iter->second; }
+    auto light_id = static_cast<uint>(_light_entries.size());
+    LUISA_ASSERT(light_id < light_capacity,
+                 "Too many lights (limit = {}).", light_capacity);
+    if (auto batch_key = light->batch_key(); batch_key.empty()) {
+        auto tag = _lights.emplace(light->build(*this, command_buffer));
+        _light_types.append(luisa::format("{}#{};", light->impl_type(), tag));
+        _light_entries.emplace_back(make_uint2(tag, 0u));
+    } else {
+        _light_entries.emplace_back(_register_batched(
+            command_buffer, light, batch_key, true, _lights, _light_batches, _light_types));
+    }
+    command_buffer << _light_buffer.view(light_id, 1u)
+                          .copy_from(&_light_entries[light_id]);
+    _light_ids.emplace(light, light_id);
     _lights_updated = true;
-    return tag;
+    return light_id;
 }
 
 uint Pipeline::register_medium(CommandBuffer &command_buffer, const Medium *medium) noexcept {
     if (auto iter = _medium_tags.find(medium);
         iter != _medium_tags.end()) { return iter->second; }
     auto tag = _media.emplace(medium->build(*this, command_buffer));
+    _medium_types.append(luisa::format("{}#{};", medium->impl_type(), tag));
     _medium_tags.emplace(medium, tag);
     return tag;
 }
@@ -109,10 +202,11 @@ luisa::unique_ptr<Pipeline> Pipeline::create(
     scene.clear_update();
     
     LUISA_INFO("Created pipeline with {} camera(s), {} shape instance(s), "
-               "{} surface instance(s), and {} light instance(s).",
+               "{} surface instance(s) for {} material(s), and {} light instance(s).",
                pipeline->_cameras.size(),
                pipeline->_geometry->instances().size(),
                pipeline->_surfaces.size(),
+               pipeline->_materials.size(),
                pipeline->_lights.size());
     return pipeline;
 }
@@ -136,24 +230,35 @@ void Pipeline::scene_update(
         for (auto camera : scene.cameras()) {
             _cameras.emplace_back(camera->build(*this, command_buffer));
         }
+        _shader_generation++;
         update_bindless_if_dirty();
     }
 
-    if (scene.shapes_updated()) {
+    bool geometry_rebuilt = false;
+    if (scene.shapes_updated() ||
+        (!scene.dirty_shapes().empty() &&
+         !_geometry->update_shapes(command_buffer, scene.dirty_shapes(), time))) {
         _geometry = luisa::make_unique<Geometry>(*this);
         _geometry->build(command_buffer, scene.shapes(), time);
-        update_bindless_if_dirty();
+        _shader_generation++;
+        geometry_rebuilt = true;
     }
+    // a patched geometry keeps the compiled shaders, lights joining a batch need no new code either
+    auto light_instances_updated = !geometry_rebuilt && !scene.dirty_shapes().empty() &&
+                                   _geometry->light_instances_updated();
+    update_bindless_if_dirty();
     
     bool environment_updated = false;
     if (scene.environment_updated() && !scene.environment()->is_black()) {
         _environment = scene.environment()->build(*this, command_buffer);
+        _shader_generation++;
         environment_updated = true;
         update_bindless_if_dirty();
     }
     
-    if (environment_updated || _lights_updated) {
-        _integrator = scene.integrator()->build(*this, command_buffer);
+    // keep the integrator (and its compiled shaders), only refresh what it samples lights from
+    if (environment_updated || _lights_updated || geometry_rebuilt || light_instances_updated) {
+        _integrator->update_light_sampler(command_buffer);
         _lights_updated = false;
         update_bindless_if_dirty();
     }
@@ -169,6 +274,8 @@ void Pipeline::scene_update(
         update_bindless_if_dirty();
     }
     command_buffer << compute::commit();
+    // the geometries replaced by update_shapes() are freed once the stream has passed them
+    _geometry->release_retired_resources(command_buffer);
     scene.clear_update();
 }
 
@@ -187,6 +294,10 @@ bool Pipeline::update(CommandBuffer &command_buffer, float time) noexcept {
     // }
 }
 
+bool Pipeline::update_motion(CommandBuffer &command_buffer, float2 shutter_span) noexcept {
+    return _geometry->update_motion(command_buffer, shutter_span);
+}
+
 void Pipeline::render(Stream &stream) noexcept {
     _integrator->render(stream);
 }
@@ -195,7 +306,36 @@ luisa::unique_ptr<luisa::vector<float4>> Pipeline::render_to_buffer(Stream &stre
     return _integrator->render_to_buffer(stream, camera_index);
 }
 
+void Pipeline::render_to_buffer(Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept {
+    _integrator->render_to_buffer(stream, camera_index, framebuffer);
+}
+
+void Pipeline::render_to_buffer(Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept {
+    _integrator->render_to_buffer(stream, camera_indices, framebuffer);
+}
+
 const Texture::Instance *Pipeline::build_texture(CommandBuffer &command_buffer, const Texture *texture) noexcept {
+    if (_parameter_record) {
+        auto &record = *_parameter_record;
+        if (texture == nullptr) {
+            record.signature.append("n;");
+            return nullptr;
+        }
+        if (auto v = texture->evaluate_static()) {
+            auto offset = static_cast<uint>(record.parameters.size());
+            record.parameters.emplace_back(*v);
+            record.signature.append(luisa::format(
+                "c{}{};", texture->channels(), texture->is_black() ? "b" : ""));
+            return _parameter_textures.emplace_back(
+                luisa::make_unique<detail::BatchParameterTexture>(*this, texture, offset, record.emission)).get();
+        }
+        // other textures are shared by address and build their own dependencies as usual
+        record.signature.append(luisa::format("t{};", static_cast<const void *>(texture)));
+        auto suspended = std::exchange(_parameter_record, luisa::nullopt);
+        auto t = build_texture(command_buffer, texture);
+        _parameter_record = std::move(suspended);
+        return t;
+    }
     if (texture == nullptr) { return nullptr; }
     if (auto iter = _textures.find(texture); iter != _textures.end()) {
         return iter->second.get();
@@ -213,6 +353,13 @@ const Filter::Instance *Pipeline::build_filter(CommandBuffer &command_buffer, co
     return _filters.emplace(filter, std::move(f)).first->second.get();
 }
 
+AliasTableBuilder &Pipeline::alias_table_builder() noexcept {
+    if (_alias_table_builder == nullptr) {
+        _alias_table_builder = luisa::make_unique<AliasTableBuilder>(_device);
+    }
+    return *_alias_table_builder;
+}
+
 const PhaseFunction::Instance *Pipeline::build_phasefunction(CommandBuffer &command_buffer, const PhaseFunction *phasefunction) noexcept {
     if (phasefunction == nullptr) { return nullptr; }
     if (auto iter = _phasefunctions.find(phasefunction); iter != _phasefunctions.end()) {
@@ -264,4 +411,12 @@ Float4 Pipeline::constant(Expr<uint> index) const noexcept {
     return _constant_buffer->read(index);
 }
 
+UInt2 Pipeline::material(Expr<uint> material_id) const noexcept {
+    return _material_buffer->read(material_id);
+}
+
+UInt2 Pipeline::light(Expr<uint> light_id) const noexcept {
+    return _light_buffer->read(light_id);
+}
+
 }// namespace luisa::render
@@ -12,6 +12,7 @@
 #include <luisa/runtime/rtx/accel.h>
 
 #include <util/spec.h>
+#include <util/alias_table.h>
 #include <base/shape.h>
 #include <base/light.h>
 #include <base/camera.h>
@@ -49,6 +50,7 @@ using compute::Printer;
 using compute::Ray;
 using compute::Resource;
 using compute::Triangle;
+using compute::UInt2;
 using compute::Volume;
 using TextureSampler = compute::Sampler;
 
@@ -60,6 +62,8 @@ public:
     static constexpr auto bindless_array_capacity = 500'000u;// limitation of Metal
     static constexpr auto transform_matrix_buffer_size = 65536u;
     static constexpr auto constant_buffer_size = 256u * 1024u;
+    static constexpr auto material_capacity = Shape::Handle::surface_tag_max + 1u;
+    static constexpr auto light_capacity = Shape::Handle::light_tag_max + 1u;
     using ResourceHandle = luisa::unique_ptr<Resource>;
 
 private:
@@ -75,8 +79,28 @@ private:
     Polymorphic<Surface::Instance> _surfaces;
     Polymorphic<Light::Instance> _lights;
     Polymorphic<Medium::Instance> _media;
-    luisa::unordered_map<const Surface *, uint> _surface_tags;
-    luisa::unordered_map<const Light *, uint> _light_tags;
+    luisa::unordered_map<const Surface *, uint> _material_ids;
+    luisa::unordered_map<luisa::string, uint> _surface_batches;// batch key -> shared surface tag
+    luisa::vector<uint2> _materials;                            // (surface tag, first parameter slot) per material id
+    luisa::vector<luisa::vector<float4>> _batch_parameters;     // host copies kept alive until the upload commits
+    luisa::vector<luisa::unique_ptr<Texture::Instance>> _parameter_textures;
+    Buffer<uint2> _material_buffer;
+    // constant texture values and texture signature of the surface or light being registered
+    struct ParameterRecord {
+        luisa::vector<float4> parameters;
+        luisa::string signature;
+        bool emission;// read from the light parameters of the shape instead of the surface ones
+    };
+    luisa::optional<ParameterRecord> _parameter_record;
+    luisa::unordered_map<const Light *, uint> _light_ids;
+    luisa::unordered_map<luisa::string, uint> _light_batches;// batch key -> shared light tag
+    luisa::vector<uint2> _light_entries;                      // (light tag, first parameter slot) per light id
+    Buffer<uint2> _light_buffer;
+    // batch keys (or implementation types) of the polymorphic instances in tag order,
+    // i.e. the code a compiled shader dispatches to, see ProgressiveIntegrator
+    luisa::string _surface_types;
+    luisa::string _light_types;
+    luisa::string _medium_types;
     luisa::unordered_map<const Medium *, uint> _medium_tags;
     luisa::unordered_map<const Texture *, luisa::unique_ptr<Texture::Instance>> _textures;
     luisa::unordered_map<const Filter *, luisa::unique_ptr<Filter::Instance>> _filters;
@@ -87,6 +111,7 @@ private:
     luisa::unique_ptr<Environment::Instance> _environment;
     uint _environment_medium_tag{Medium::INVALID_TAG};
     luisa::unique_ptr<Geometry> _geometry;
+    luisa::unique_ptr<AliasTableBuilder> _alias_table_builder;// created on first use
 
     // registered transforms
     luisa::unordered_map<const Transform *, uint> _transform_to_id;
@@ -97,12 +122,24 @@ private:
 
     bool _lights_updated{false};
     bool _transforms_updated{false};
+    // bumped whenever resources captured by compiled shaders are replaced
+    uint _shader_generation{0u};
 
     // other things
     luisa::unique_ptr<Printer> _printer;
     float _initial_time{};
     // float _clamp_normal{};   // cos angle > clamp
 
+private:
+    // builds the node with its constant textures recorded as parameters and returns its
+    // (tag, first parameter slot); the instance is only kept if it starts a new batch
+    template<typename Node, typename T>
+    [[nodiscard]] uint2 _register_batched(CommandBuffer &command_buffer, const Node *node,
+                                          luisa::string_view batch_key, bool emission,
+                                          Polymorphic<T> &instances,
+                                          luisa::unordered_map<luisa::string, uint> &batches,
+                                          luisa::string &types) noexcept;
+
 public:
     // for internal use only; use Pipeline::create() instead
     explicit Pipeline(Device &device) noexcept;
@@ -125,6 +162,13 @@ public:
         return register_bindless(buffer.view());
     }
 
+    // rebinds an already registered slot, so that shaders indexing it stay valid
+    template<typename T>
+    void update_bindless(uint buffer_id, BufferView<T> buffer) noexcept {
+        LUISA_ASSERT(buffer_id < _bindless_buffer_count, "Invalid bindless buffer slot {}.", buffer_id);
+        _bindless_array.emplace_on_update(buffer_id, buffer);
+    }
+
     template<typename T>
     [[nodiscard]] auto register_bindless(const Image<T> &image, TextureSampler sampler) noexcept {
         auto tex2d_id = _bindless_tex2d_count++;
@@ -141,7 +185,9 @@ public:
 
     void register_transform(const Transform *transform) noexcept;
 
+    // returns the material id, resolved into a surface tag on the device by material()
     [[nodiscard]] uint register_surface(CommandBuffer &command_buffer, const Surface *surface) noexcept;
+    // returns the light id, resolved into a light tag on the device by light()
     [[nodiscard]] uint register_light(CommandBuffer &command_buffer, const Light *light) noexcept;
     [[nodiscard]] uint register_medium(CommandBuffer &command_buffer, const Medium *medium) noexcept;
 
@@ -215,20 +261,29 @@ public:
     [[nodiscard]] auto &surfaces() const noexcept { return _surfaces; }
     [[nodiscard]] auto &lights() const noexcept { return _lights; }
     [[nodiscard]] auto &media() const noexcept { return _media; }
+    [[nodiscard]] luisa::string_view surface_types() const noexcept { return _surface_types; }
+    [[nodiscard]] luisa::string_view light_types() const noexcept { return _light_types; }
+    [[nodiscard]] luisa::string_view medium_types() const noexcept { return _medium_types; }
     [[nodiscard]] auto environment() const noexcept { return _environment.get(); }
     [[nodiscard]] auto environment_medium_tag() const noexcept { return _environment_medium_tag; }
     [[nodiscard]] auto integrator() const noexcept { return _integrator.get(); }
     [[nodiscard]] auto spectrum() const noexcept { return _spectrum.get(); }
     [[nodiscard]] auto geometry() const noexcept { return _geometry.get(); }
     [[nodiscard]] auto has_lighting() const noexcept { return !_lights.empty() || _environment != nullptr; }
+    [[nodiscard]] auto shader_generation() const noexcept { return _shader_generation; }
     // [[nodiscard]] auto clamp_normal() const noexcept { return _clamp_normal; }
     [[nodiscard]] const Texture::Instance *build_texture(CommandBuffer &command_buffer, const Texture *texture) noexcept;
     [[nodiscard]] const Filter::Instance *build_filter(CommandBuffer &command_buffer, const Filter *filter) noexcept;
     [[nodiscard]] const PhaseFunction::Instance *build_phasefunction(CommandBuffer &command_buffer, const PhaseFunction *phasefunction) noexcept;
+    [[nodiscard]] AliasTableBuilder &alias_table_builder() noexcept;
     void scene_update(Stream &stream, Scene &scene, float time) noexcept;
     [[nodiscard]] bool update(CommandBuffer &command_buffer, float time) noexcept;
+    // one accel build for the whole shutter span; see Geometry::update_motion()
+    bool update_motion(CommandBuffer &command_buffer, float2 shutter_span) noexcept;
     void render(Stream &stream) noexcept;
     [[nodiscard]] luisa::unique_ptr<luisa::vector<float4>> render_to_buffer(Stream &stream, uint camera_index) noexcept;
+    void render_to_buffer(Stream &stream, uint camera_index, BufferView<float4> framebuffer) noexcept;
+    void render_to_buffer(Stream &stream, luisa::span<const uint> camera_indices, BufferView<float4> framebuffer) noexcept;
     [[nodiscard]] auto &printer() noexcept { return *_printer; }
     [[nodiscard]] auto &printer() const noexcept { return *_printer; }
     [[nodiscard]] uint named_id(luisa::string_view name) const noexcept;
@@ -251,6 +306,8 @@ public:
     [[nodiscard]] Float4x4 transform(const Transform *transform) const noexcept;
 
     [[nodiscard]] Float4 constant(Expr<uint> index) const noexcept;
+    [[nodiscard]] UInt2 material(Expr<uint> material_id) const noexcept;
+    [[nodiscard]] UInt2 light(Expr<uint> light_id) const noexcept;
 
     template<uint dim, typename... Args, typename... CallArgs>
     [[nodiscard]] auto shader(luisa::string_view name, CallArgs &&...call_args) const noexcept {
@@ -228,10 +228,10 @@ struct RawShapeInfo {
     [[nodiscard]] StringArr get_type() const noexcept;
 
     void build_spheres(
-        FloatArr centers, float radius, uint subdivision
+        FloatArr centers, float radius, uint subdivision, bool procedural = false
     ) noexcept {
         spheres_info = luisa::make_unique<RawSpheresInfo>(
-            std::move(centers), radius, subdivision
+            std::move(centers), radius, subdivision, procedural
         );
     }
     void build_mesh(
@@ -265,23 +265,39 @@ struct RawShapeInfo {
 struct RawSpheresInfo {
     [[nodiscard]] StringArr get_info() const noexcept {
         return luisa::format(
-            "centers={}, radius={}, subdiv={}",
-            centers.size(), radius, subdivision
+            "centers={}, radius={}, subdiv={}, procedural={}",
+            centers.size(), radius, subdivision, procedural
         );
     }
 
     FloatArr centers;
     float radius;
     uint subdivision;
+    bool procedural;// analytic spheres instead of tessellated ones
+};
+
+/* Non-owning view of mesh arrays, e.g. borrowed from caller-side numpy buffers */
+struct RawMeshView {
+    luisa::span<const float> vertices;
+    luisa::span<const uint> triangles;
+    luisa::span<const float> normals;
+    luisa::span<const float> uvs;
 };
 
 struct RawMeshInfo {
     [[nodiscard]] StringArr get_info() const noexcept {
+        auto v = view();
         return luisa::format(
             "vertices={}, triangles={}, normals={}, uvs={}, is_deformable={}",
-            vertices.size(), triangles.size(), normals.size(), uvs.size(), is_deformable
+            v.vertices.size(), v.triangles.size(), v.normals.size(), v.uvs.size(), is_deformable
         );
     }
+
+    /* Borrowed arrays take precedence over the owned ones; they are only valid during the update */
+    [[nodiscard]] RawMeshView view() const noexcept {
+        return borrowed_view.vertices.data() != nullptr ? borrowed_view :
+               RawMeshView{vertices, triangles, normals, uvs};
+    }
     
     [[nodiscard]] StringArr get_type() const noexcept {
         return is_deformable ? "deformablemesh" : "mesh";
@@ -292,6 +308,8 @@ struct RawMeshInfo {
     FloatArr normals;
     FloatArr uvs;
     bool is_deformable;
+    bool refit{false};  // refit instead of rebuild the BLAS on vertex-only updates
+    RawMeshView borrowed_view{};
 };
 
 struct RawFileInfo {
@@ -26,12 +26,18 @@ public:
     private:
         const Pipeline &_pipeline;
         const Sampler *_sampler;
+        uint _generation{0u};
+
+    protected:
+        // call when device storage captured by compiled kernels is reallocated
+        void _bump_generation() noexcept { _generation++; }
 
     public:
         explicit Instance(const Pipeline &pipeline, const Sampler *sampler) noexcept
             : _pipeline{pipeline}, _sampler{sampler} {}
         virtual ~Instance() noexcept = default;
         [[nodiscard]] auto &pipeline() const noexcept { return _pipeline; }
+        [[nodiscard]] auto generation() const noexcept { return _generation; }
 
         template<typename T = Sampler>
             requires std::is_base_of_v<Sampler, T>
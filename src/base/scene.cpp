@@ -2,8 +2,12 @@
 // Created by Mike on 2021/12/8.
 //
 
+#include <future>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
 
+#include <luisa/core/clock.h>
 #include <util/thread_pool.h>
 #include <sdl/scene_desc.h>
 #include <sdl/scene_node_desc.h>
@@ -27,24 +31,49 @@
 
 namespace luisa::render {
 
+// a named node; the first thread to request a name constructs it,
+// and the others wait on the future instead of holding a lock
+struct Scene::NodeEntry {
+    NodeHandle node{nullptr, nullptr};
+    std::promise<SceneNode *> promise;
+    std::shared_future<SceneNode *> ready{promise.get_future().share()};
+};
+
 struct Scene::Config {
+    static constexpr auto node_shard_count = 64u;
+    struct NodeShard {
+        std::mutex mutex;
+        luisa::unordered_map<luisa::string, luisa::unique_ptr<NodeEntry>> nodes;
+    };
+    static constexpr auto tag_count = static_cast<size_t>(SceneNodeTag::PHASE_FUNCTION) + 1u;
+    struct TagStatistics {
+        std::atomic<uint> count{0u};
+        std::atomic<uint64_t> nanoseconds{0u};// exclusive of nested nodes
+    };
+
     float shadow_terminator{0.f};
     float intersection_offset{0.f};
     float clamp_normal{0.f};
     luisa::vector<NodeHandle> internal_nodes;
-    luisa::unordered_map<luisa::string, NodeHandle> nodes;
+    std::array<NodeShard, node_shard_count> node_shards;
+    std::array<TagStatistics, tag_count> load_statistics;
     Integrator *integrator{nullptr};
     Environment *environment{nullptr};
     Medium *environment_medium{nullptr};
     Spectrum *spectrum{nullptr};
     luisa::vector<Camera *> cameras;
     luisa::vector<Shape *> shapes;
+    luisa::unordered_set<const Shape *> dirty_shapes;
 
     bool environment_updated{false};
     bool film_updated{false};
     bool cameras_updated{false};
     bool shapes_updated{false};
     bool transforms_updated{false};
+
+    [[nodiscard]] auto &shard(luisa::string_view name) noexcept {
+        return node_shards[luisa::hash_value(name) % node_shard_count];
+    }
 };
 
 const Integrator *Scene::integrator() const noexcept { return _config->integrator; }
@@ -59,17 +88,32 @@ float Scene::clamp_normal_factor() const noexcept { return _config->clamp_normal
 
 bool Scene::environment_updated() const noexcept { return _config->environment_updated; }
 bool Scene::shapes_updated() const noexcept { return _config->shapes_updated; }
+const luisa::unordered_set<const Shape *> &Scene::dirty_shapes() const noexcept { return _config->dirty_shapes; }
 bool Scene::cameras_updated() const noexcept { return _config->cameras_updated; }
 bool Scene::film_updated() const noexcept { return _config->film_updated; }
 bool Scene::transforms_updated() const noexcept { return _config->transforms_updated; }
 void Scene::clear_update() noexcept {
     _config->environment_updated = false;
     _config->shapes_updated = false;
+    _config->dirty_shapes.clear();
     _config->cameras_updated = false;
     _config->film_updated = false;
     _config->transforms_updated = false;
 }
 
+void Scene::set_frame(uint frame) noexcept {
+    auto advance = [this, frame](SceneNode *node) noexcept {
+        if (node->tag() != SceneNodeTag::SHAPE) { return; }
+        if (auto shape = dynamic_cast<Shape *>(node); shape != nullptr && shape->set_frame(frame)) {
+            _config->dirty_shapes.emplace(shape);
+        }
+    };
+    for (auto &&node : _config->internal_nodes) { advance(node.get()); }
+    for (auto &&shard : _config->node_shards) {
+        for (auto &&[name, entry] : shard.nodes) { advance(entry->node.get()); }
+    }
+}
+
 namespace detail {
 
 [[nodiscard]] static auto &scene_plugin_registry() noexcept {
@@ -78,16 +122,23 @@ namespace detail {
 }
 
 [[nodiscard]] static auto &scene_plugin_registry_mutex() noexcept {
-    static std::mutex mutex;
+    static std::shared_mutex mutex;
     return mutex;
 }
 
 [[nodiscard]] static auto &scene_plugin_load(
     const std::filesystem::path &runtime_dir, SceneNodeTag tag, luisa::string_view impl_type) noexcept {
-    std::scoped_lock lock{detail::scene_plugin_registry_mutex()};
     auto name = luisa::format("luisa-render-{}-{}", scene_node_tag_description(tag), impl_type);
     for (auto &c : name) { c = static_cast<char>(std::tolower(c)); }
     auto &&registry = detail::scene_plugin_registry();
+    // plugins are only loaded once, so lookups share the lock
+    {
+        std::shared_lock lock{detail::scene_plugin_registry_mutex()};
+        if (auto iter = registry.find(name); iter != registry.end()) {
+            return *iter->second;
+        }
+    }
+    std::unique_lock lock{detail::scene_plugin_registry_mutex()};
     if (auto iter = registry.find(name); iter != registry.end()) {
         return *iter->second;
     }
@@ -95,21 +146,51 @@ namespace detail {
     return *registry.emplace(name, std::move(module)).first->second;
 }
 
+// Runs f(i) for i in [0, n) on dedicated threads, with the caller taking part. Node
+// constructors block on futures of the global thread pool (e.g. mesh loading), so
+// running them as tasks of that pool could starve it.
+template<typename F>
+static void parallel_load(size_t n, F &&f) noexcept {
+    if (n == 0u) { return; }
+    std::atomic<size_t> next{0u};
+    auto run = [&next, n, &f] {
+        for (auto i = next.fetch_add(1u); i < n; i = next.fetch_add(1u)) { f(i); }
+    };
+    auto helper_count = std::min<size_t>(n, std::max(std::thread::hardware_concurrency(), 1u)) - 1u;
+    luisa::vector<std::thread> helpers;
+    helpers.reserve(helper_count);
+    for (auto i = 0u; i < helper_count; i++) { helpers.emplace_back(run); }
+    run();
+    for (auto &&t : helpers) { t.join(); }
+}
+
+// per-thread time spent in nested node constructors, subtracted from the parent's
+static thread_local double nested_load_time = 0.;
+
 }// namespace detail
 
 template <typename... Args, typename Callable>
 std::pair<SceneNode*, bool> Scene::load_from_nodes(
     luisa::string_view name, Callable &&handle_creater, Args&&... args
 ) noexcept {
-    std::scoped_lock lock{_mutex};
-    if (auto iter = _config->nodes.find(name);
-        iter != _config->nodes.end()) {
-        return std::make_pair(iter->second.get(), false);
+    auto &&shard = _config->shard(name);
+    std::shared_future<SceneNode *> ready;
+    NodeEntry *entry = nullptr;
+    {
+        std::scoped_lock lock{shard.mutex};
+        if (auto iter = shard.nodes.find(name);
+            iter != shard.nodes.end()) {
+            ready = iter->second->ready;
+        } else {
+            entry = shard.nodes.emplace(name, luisa::make_unique<NodeEntry>()).first->second.get();
+        }
     }
+    // another thread owns the construction
+    if (entry == nullptr) { return std::make_pair(ready.get(), false); }
 
-    NodeHandle new_node = handle_creater(std::forward<Args>(args)...);
-    auto ptr = new_node.get();
-    _config->nodes.emplace(name, std::move(new_node));
+    entry->node = handle_creater(std::forward<Args>(args)...);
+    auto ptr = entry->node.get();
+    entry->promise.set_value(ptr);
     return std::make_pair(ptr, true);
 }
 
@@ -140,7 +221,20 @@ SceneNode *Scene::load_node(SceneNodeTag tag, const SceneNodeDesc *desc) noexcep
             desc->impl_type());
     }
     
-    auto handle_creater = get_handle_creater<NodeCreaterDesc>(tag, desc->impl_type(), "create");
+    auto plugin_creater = get_handle_creater<NodeCreaterDesc>(tag, desc->impl_type(), "create");
+    // times the construction of each node, excluding the nodes it loads in turn
+    auto handle_creater = [this, tag, &plugin_creater](Scene *scene, const SceneNodeDesc *node_desc) noexcept {
+        auto outer = std::exchange(detail::nested_load_time, 0.);
+        Clock clock;
+        auto node = plugin_creater(scene, node_desc);
+        auto elapsed = clock.toc();
+        auto &&stats = _config->load_statistics[static_cast<size_t>(tag)];
+        stats.count.fetch_add(1u, std::memory_order_relaxed);
+        stats.nanoseconds.fetch_add(static_cast<uint64_t>(std::max(elapsed - detail::nested_load_time, 0.) * 1e6),
+                                    std::memory_order_relaxed);
+        detail::nested_load_time = outer + elapsed;
+        return node;
+    };
 
     if (desc->is_internal()) {
         NodeHandle node = handle_creater(this, desc);
@@ -173,11 +267,16 @@ SceneNode *Scene::load_node_from_name(luisa::string_view name) noexcept {
         return nullptr;
     }
     
-    std::scoped_lock lock{_mutex};
-    if (auto iter = _config->nodes.find(name);
-        iter != _config->nodes.end()) {
-        return iter->second.get();
+    std::shared_future<SceneNode *> ready;
+    {
+        auto &&shard = _config->shard(name);
+        std::scoped_lock lock{shard.mutex};
+        if (auto iter = shard.nodes.find(name);
+            iter != shard.nodes.end()) {
+            ready = iter->second->ready;
+        }
     }
+    if (ready.valid()) { return ready.get(); }
 
     LUISA_ERROR_WITH_LOCATION("Scene node `{}` not founded.", name);
 }
@@ -404,10 +503,11 @@ Shape *Scene::update_shape(const RawShapeInfo &shape_info) noexcept {
 
     if (first_def) {
         _config->shapes.emplace_back(shape);
+        _config->shapes_updated = true;
     } else {
         shape->update_shape(this, shape_info);
+        _config->dirty_shapes.emplace(shape);
     }
-    _config->shapes_updated = true;
     return shape;
 }
 
@@ -430,20 +530,31 @@ luisa::unique_ptr<Scene> Scene::create(const Context &ctx, const SceneDesc *desc
 
     auto cameras = desc->root()->property_node_list_or_default("cameras");
     auto shapes = desc->root()->property_node_list_or_default("shapes");
-    scene->_config->cameras.reserve(cameras.size());
-    scene->_config->shapes.reserve(shapes.size());
-    for (auto c : cameras) {
-        scene->_config->cameras.emplace_back(scene->load_camera(c));
-    }
-    for (auto s : shapes) {
-        scene->_config->shapes.emplace_back(scene->load_shape(s));
-    }
+    // cameras and shapes (with their surfaces, lights and textures) are constructed
+    // concurrently, and stored by index to keep the order of the description
+    scene->_config->cameras.resize(cameras.size());
+    scene->_config->shapes.resize(shapes.size());
+    detail::parallel_load(cameras.size() + shapes.size(), [&](size_t i) noexcept {
+        if (i < cameras.size()) {
+            scene->_config->cameras[i] = scene->load_camera(cameras[i]);
+        } else {
+            scene->_config->shapes[i - cameras.size()] = scene->load_shape(shapes[i - cameras.size()]);
+        }
+    });
 
     scene->_config->cameras_updated = scene->_config->cameras.size() > 0;
     scene->_config->shapes_updated = scene->_config->shapes.size() > 0;
     scene->_config->environment_updated = scene->_config->environment != nullptr;
 
     global_thread_pool().synchronize();
+    for (auto i = 0u; i < Config::tag_count; i++) {
+        auto &&stats = scene->_config->load_statistics[i];
+        if (auto count = stats.count.load(); count != 0u) {
+            LUISA_INFO("Loaded {} {} node(s) in {} ms.",
+                       count, scene_node_tag_description(static_cast<SceneNodeTag>(i)),
+                       static_cast<double>(stats.nanoseconds.load()) * 1e-6);
+        }
+    }
     return scene;
 }
 
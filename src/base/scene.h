@@ -58,11 +58,12 @@ public:
     using NodeHandle = luisa::unique_ptr<SceneNode, NodeDeleter *>;
 
     struct Config;
+    struct NodeEntry;
 
 private:
     const Context &_context;
     luisa::unique_ptr<Config> _config;
-    std::recursive_mutex _mutex;
+    std::mutex _mutex;// guards the internal nodes; named nodes live in a sharded table
 
 public:
     // for internal use only, call Scene::create() instead
@@ -127,10 +128,13 @@ public:
     [[nodiscard]] float clamp_normal_factor() const noexcept;
 
     [[nodiscard]] bool shapes_updated() const noexcept;
+    [[nodiscard]] const luisa::unordered_set<const Shape *> &dirty_shapes() const noexcept;
     [[nodiscard]] bool cameras_updated() const noexcept;
     [[nodiscard]] bool film_updated() const noexcept;
     [[nodiscard]] bool transforms_updated() const noexcept;
     [[nodiscard]] bool environment_updated() const noexcept;
+    // advances animated shapes (e.g. mesh sequences); changed ones are marked dirty for the next scene update
+    void set_frame(uint frame) noexcept;
     void clear_update() noexcept;
 };
 
@@ -35,6 +35,12 @@ void Shape::update_shape(Scene *scene, const RawShapeInfo &shape_info) noexcept
 }
 
 AccelOption Shape::build_option() const noexcept { return {}; }
+bool Shape::topology_updated() const noexcept { return true; }
+bool Shape::is_procedural() const noexcept { return false; }
+luisa::span<const float4> Shape::spheres() const noexcept { return {}; }
+luisa::span<const float4x4> Shape::copies() const noexcept { return {}; }
+bool Shape::set_frame(uint) noexcept { return false; }
+uint64_t Shape::mesh_identity() const noexcept { return 0u; }
 
 bool Shape::visible() const noexcept { return true; }
 float Shape::shadow_terminator_factor() const noexcept { return 0.f; }
@@ -37,12 +37,17 @@ public:
     static constexpr auto property_flag_has_surface = 1u << 2u;
     static constexpr auto property_flag_has_light = 1u << 3u;
     static constexpr auto property_flag_has_medium = 1u << 4u;
+    static constexpr auto property_flag_procedural = 1u << 5u;
 
 private:
     const Surface *_surface;
     const Light *_light;
     const Medium *_medium;
     const Transform *_transform;
+    uint _mesh_version{0u};
+
+protected:
+    void _bump_mesh_version() noexcept { _mesh_version++; }
 
 public:
     Shape(Scene *scene, const SceneNodeDesc *desc) noexcept;
@@ -64,6 +69,13 @@ public:
     [[nodiscard]] virtual MeshView mesh() const noexcept;                           // empty if the shape is not a mesh
     [[nodiscard]] virtual luisa::span<const Shape *const> children() const noexcept;// empty if the shape is a mesh
     [[nodiscard]] virtual AccelOption build_option() const noexcept;                // accel struct build quality, only considered for meshes
+    [[nodiscard]] virtual bool topology_updated() const noexcept;                   // whether the last update changed the triangles, only considered for meshes
+    [[nodiscard]] virtual bool is_procedural() const noexcept;                      // whether the shape is made of analytic spheres instead of triangles
+    [[nodiscard]] virtual luisa::span<const float4> spheres() const noexcept;       // (center, radius) in object space, only considered for procedural shapes
+    [[nodiscard]] virtual luisa::span<const float4x4> copies() const noexcept;      // per-copy object transforms sharing mesh(), empty if the mesh is placed once
+    [[nodiscard]] virtual bool set_frame(uint frame) noexcept;                      // selects the frame of an animated shape, returns whether mesh() changed
+    [[nodiscard]] virtual uint64_t mesh_identity() const noexcept;                  // stable id of the data behind mesh(), equal for shapes sharing it; 0 to deduplicate by content
+    [[nodiscard]] uint mesh_version() const noexcept { return _mesh_version; }      // bumped whenever the shape replaces mesh()
 };
 
 template<typename BaseShape>
@@ -153,8 +165,6 @@ public:
 
     static constexpr auto vertex_buffer_id_offset = 0u;
     static constexpr auto triangle_buffer_id_offset = 1u;
-    static constexpr auto alias_table_buffer_id_offset = 2u;
-    static constexpr auto pdf_buffer_id_offset = 3u;
 
 private:
     UInt _buffer_base;
@@ -166,6 +176,8 @@ private:
     Float _shadow_terminator;
     Float _intersection_offset;
     Float _clamp_normal;
+    UInt _surface_parameters;// first constant slot of the material parameters
+    UInt _light_parameters;  // first constant slot of the light parameters
 
 private:
     Handle(Expr<uint> buffer_base, Expr<uint> flags,
@@ -176,7 +188,9 @@ private:
         _triangle_count{triangle_count},
         _shadow_terminator{shadow_terminator},
         _intersection_offset{intersection_offset},
-        _clamp_normal{clamp_normal} {}
+        _clamp_normal{clamp_normal},
+        _surface_parameters{0u},
+        _light_parameters{0u} {}
 
 public:
     Handle() noexcept = default;
@@ -187,6 +201,16 @@ public:
         uint surface_tag, uint light_tag, uint medium_tag, uint tri_count,
         float shadow_terminator, float intersection_offset, float clamp_normal) noexcept;
     [[nodiscard]] static Shape::Handle decode(Expr<uint4> compressed) noexcept;
+    // replaces the encoded material id with its (surface tag, parameter base) entry, see Pipeline::material()
+    void resolve_material(Expr<uint2> material) noexcept {
+        _surface_tag = material.x;
+        _surface_parameters = material.y;
+    }
+    // replaces the encoded light id with its (light tag, parameter base) entry, see Pipeline::light()
+    void resolve_light(Expr<uint2> light) noexcept {
+        _light_tag = light.x;
+        _light_parameters = light.y;
+    }
 
 public:
     [[nodiscard]] auto geometry_buffer_base() const noexcept { return _buffer_base; }
@@ -194,10 +218,11 @@ public:
     [[nodiscard]] auto vertex_buffer_id() const noexcept { return geometry_buffer_base() + luisa::render::Shape::Handle::vertex_buffer_id_offset; }
     [[nodiscard]] auto triangle_buffer_id() const noexcept { return geometry_buffer_base() + luisa::render::Shape::Handle::triangle_buffer_id_offset; }
     [[nodiscard]] auto triangle_count() const noexcept { return _triangle_count; }
-    [[nodiscard]] auto alias_table_buffer_id() const noexcept { return geometry_buffer_base() + luisa::render::Shape::Handle::alias_table_buffer_id_offset; }
-    [[nodiscard]] auto pdf_buffer_id() const noexcept { return geometry_buffer_base() + luisa::render::Shape::Handle::pdf_buffer_id_offset; }
+    [[nodiscard]] auto sphere_buffer_id() const noexcept { return geometry_buffer_base(); }// procedural shapes only
     [[nodiscard]] auto surface_tag() const noexcept { return _surface_tag; }
+    [[nodiscard]] auto surface_parameters() const noexcept { return _surface_parameters; }
     [[nodiscard]] auto light_tag() const noexcept { return _light_tag; }
+    [[nodiscard]] auto light_parameters() const noexcept { return _light_parameters; }
     [[nodiscard]] auto medium_tag() const noexcept { return _medium_tag; }
     [[nodiscard]] auto test_property_flag(luisa::uint flag) const noexcept { return (property_flags() & flag) != 0u; }
     [[nodiscard]] auto has_vertex_normal() const noexcept { return test_property_flag(luisa::render::Shape::property_flag_has_vertex_normal); }
@@ -205,6 +230,7 @@ public:
     [[nodiscard]] auto has_light() const noexcept { return test_property_flag(luisa::render::Shape::property_flag_has_light); }
     [[nodiscard]] auto has_surface() const noexcept { return test_property_flag(luisa::render::Shape::property_flag_has_surface); }
     [[nodiscard]] auto has_medium() const noexcept { return test_property_flag(luisa::render::Shape::property_flag_has_medium); }
+    [[nodiscard]] auto is_procedural() const noexcept { return test_property_flag(luisa::render::Shape::property_flag_procedural); }
     [[nodiscard]] auto shadow_terminator_factor() const noexcept { return _shadow_terminator; }
     [[nodiscard]] auto intersection_offset_factor() const noexcept { return _intersection_offset; }
     [[nodiscard]] auto clamp_normal_factor() const noexcept { return _clamp_normal; }
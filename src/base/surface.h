@@ -148,6 +148,9 @@ public:
     Surface(Scene *scene) noexcept;
     [[nodiscard]] virtual uint properties() const noexcept = 0;
     [[nodiscard]] virtual bool is_null() const noexcept { return false; }
+    // surfaces with equal non-empty keys and equally shaped textures share one polymorphic tag,
+    // with constant texture values moved into per-material parameters, see Pipeline::register_surface
+    [[nodiscard]] virtual luisa::string batch_key() const noexcept { return {}; }
     [[nodiscard]] auto is_reflective() const noexcept { return static_cast<bool>(properties() & property_reflective); }
     [[nodiscard]] auto is_transmissive() const noexcept { return static_cast<bool>(properties() & property_transmissive); }
     [[nodiscard]] auto is_thin() const noexcept { return static_cast<bool>(properties() & property_thin); }
@@ -350,6 +353,12 @@ protected:
             }(pipeline, command_buffer),
             _strength);
     }
+
+public:
+    [[nodiscard]] luisa::string batch_key() const noexcept override {
+        auto key = BaseSurface::batch_key();
+        return key.empty() ? key : luisa::format("{}|normal_map:{}", key, _strength);
+    }
 };
 
 template<typename BaseSurface,
@@ -400,6 +409,12 @@ protected:
         auto p = BaseSurface::properties();
         return _two_sided ? p & (~Surface::property_transmissive) : p;
     }
+
+public:
+    [[nodiscard]] luisa::string batch_key() const noexcept override {
+        auto key = BaseSurface::batch_key();
+        return key.empty() ? key : luisa::format("{}|two_sided:{}", key, _two_sided);
+    }
 };
 
 }// namespace luisa::render
@@ -24,7 +24,7 @@ luisa::optional<float4> Texture::evaluate_static() const noexcept { return luisa
 Spectrum::Decode Texture::Instance::evaluate_albedo_spectrum(
     const Interaction &it, const SampledWavelengths &swl, Expr<float> time) const noexcept {
     // skip the expensive encoding/decoding if the texture is static
-    if (auto v = node()->evaluate_static()) {
+    if (auto v = evaluate_static()) {
         return _evaluate_static_albedo_spectrum(swl, *v);
     }
 
@@ -38,7 +38,7 @@ Spectrum::Decode Texture::Instance::evaluate_albedo_spectrum(
 Spectrum::Decode Texture::Instance::evaluate_unbounded_spectrum(
     const Interaction &it, const SampledWavelengths &swl, Expr<float> time) const noexcept {
     // skip the expensive encoding/decoding if the texture is static
-    if (auto v = node()->evaluate_static()) {
+    if (auto v = evaluate_static()) {
         return _evaluate_static_unbounded_spectrum(swl, *v);
     }
     // we have got no luck, do the expensive encoding/decoding
@@ -51,7 +51,7 @@ Spectrum::Decode Texture::Instance::evaluate_unbounded_spectrum(
 Spectrum::Decode Texture::Instance::evaluate_illuminant_spectrum(
     const Interaction &it, const SampledWavelengths &swl, Expr<float> time) const noexcept {
     // skip the expensive encoding/decoding if the texture is static
-    if (auto v = node()->evaluate_static()) {
+    if (auto v = evaluate_static()) {
         return _evaluate_static_illuminant_spectrum(swl, *v);
     }
     // we have got no luck, do the expensive encoding/decoding
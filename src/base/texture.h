@@ -50,6 +50,8 @@ public:
             requires std::is_base_of_v<Texture, T>
         [[nodiscard]] auto node() const noexcept { return static_cast<const T *>(_texture); }
         [[nodiscard]] auto &pipeline() const noexcept { return _pipeline; }
+        // value known at build time, nullopt to always evaluate on the device
+        [[nodiscard]] virtual luisa::optional<float4> evaluate_static() const noexcept { return node()->evaluate_static(); }
         [[nodiscard]] virtual Float4 evaluate(
             const Interaction &it, const SampledWavelengths &swl, Expr<float> time) const noexcept = 0;
         [[nodiscard]] virtual Spectrum::Decode evaluate_albedo_spectrum(
@@ -61,6 +61,7 @@ public:
     InstancedTransform(const TransformTree::Node *node, size_t inst) noexcept
         : _node{node}, _instance_id{inst} {}
     [[nodiscard]] auto instance_id() const noexcept { return _instance_id; }
+    [[nodiscard]] auto node() const noexcept { return _node; }
     [[nodiscard]] auto matrix(float time) const noexcept {
         return _node == nullptr ? make_float4x4(1.0f) : _node->matrix(time);
     }
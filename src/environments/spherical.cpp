@@ -162,9 +162,17 @@ luisa::unique_ptr<Environment::Instance> Spherical::build(
         command_buffer << pipeline.bindless_array().update() << commit();
         auto &&device = pipeline.device();
         constexpr auto pixel_count = sample_map_size.x * sample_map_size.y;
-        luisa::vector<float> scale_map(pixel_count);
-        auto scale_map_device = device.create_buffer<float>(pixel_count);
-        Kernel2D generate_weight_map_kernel = [&] {
+        constexpr auto row_count = sample_map_size.y;
+        // the tables are built on the device: the marginal table over rows is followed by the
+        // conditional tables of each row; the pdf buffer holds the per-pixel pdfs, followed by
+        // the row sums, the marginal pdfs and the total weight used during construction
+        auto [alias_buffer_view, _, alias_buffer_id] = pipeline.bindless_buffer<AliasEntry>(row_count + pixel_count);
+        auto [pdf_buffer_view, __, pdf_buffer_id] = pipeline.bindless_buffer<float>(pixel_count + 2u * row_count + 1u);
+        auto weight_map = pdf_buffer_view.subview(0u, pixel_count);
+        auto row_sums = pdf_buffer_view.subview(pixel_count, row_count);
+        auto marginal_pdf = pdf_buffer_view.subview(pixel_count + row_count, row_count);
+        auto total_weight = pdf_buffer_view.subview(pixel_count + 2u * row_count, 1u);
+        Kernel2D generate_weight_map_kernel = [&](BufferFloat weights) noexcept {
             auto pixel = dispatch_id().xy();
             auto center = make_float2(pixel) + .5f;
             auto sum_weight = def(0.f);
@@ -188,54 +196,34 @@ luisa::unique_ptr<Environment::Instance> Spherical::build(
                 };
             };
             auto pixel_id = pixel.y * sample_map_size.x + pixel.x;
-            scale_map_device->write(pixel_id, sum_scale / sum_weight);
+            weights.write(pixel_id, sum_scale / sum_weight);
+        };
+        Kernel1D compensate_mis_kernel = [](BufferFloat weights, BufferFloat total) noexcept {
+            auto i = dispatch_x();
+            auto average = total.read(0u) * (1.f / static_cast<float>(pixel_count));
+            weights.write(i, max(weights.read(i) - average, 0.f));
+        };
+        Kernel1D combine_pdf_kernel = [](BufferFloat pdf, BufferFloat marginal) noexcept {
+            auto i = dispatch_x();
+            auto y = i / sample_map_size.x;
+            pdf.write(i, pdf.read(i) * marginal.read(y) * static_cast<float>(pixel_count));
         };
         auto generate_weight_map = device.compile(generate_weight_map_kernel);
-        Clock clk;
-        command_buffer << generate_weight_map().dispatch(sample_map_size)
-                       << scale_map_device.copy_to(scale_map.data())
-                       << synchronize();
-        LUISA_INFO_WITH_LOCATION(
-            "Spherical::build: Generated weight map in {} ms.", clk.toc());
+        command_buffer << generate_weight_map(weight_map).dispatch(sample_map_size);
+        auto &&builder = pipeline.alias_table_builder();
         if (compensate_mis()) {
-            auto sum_scale = 0.;
-            for (auto s : scale_map) { sum_scale += s; }
-            auto average_scale = static_cast<float>(sum_scale / pixel_count);
-            for (auto &&s : scale_map) { s = std::max(s - average_scale, 0.f); }
-        }
-        luisa::vector<float> row_averages(sample_map_size.y);
-        luisa::vector<float> pdfs(pixel_count);
-        luisa::vector<AliasEntry> aliases(sample_map_size.y + pixel_count);
-        // construct conditional alias table
-        for (auto i = 0u; i < sample_map_size.y; i++) {
-            auto sum = 0.;
-            auto values = luisa::span{scale_map}.subspan(
-                i * sample_map_size.x, sample_map_size.x);
-            for (auto v : values) { sum += v; }
-            row_averages[i] = static_cast<float>(sum * (1.0 / sample_map_size.x));
-            auto [alias_table, pdf_table] = create_alias_table(values);
-            std::copy_n(
-                pdf_table.data(), sample_map_size.x,
-                pdfs.data() + i * sample_map_size.x);
-            std::copy_n(
-                alias_table.data(), sample_map_size.x,
-                aliases.data() + sample_map_size.y + i * sample_map_size.x);
-        }
-        // construct marginal alias table
-        auto [alias_table, pdf_table] = create_alias_table(row_averages);
-        std::copy_n(alias_table.data(), sample_map_size.y, aliases.data());
-        for (auto y = 0u; y < sample_map_size.y; y++) {
-            auto offset = y * sample_map_size.x;
-            auto pdf_y = pdf_table[y];
-            auto scale = static_cast<float>(pdf_y * pixel_count);
-            for (auto x = 0u; x < sample_map_size.x; x++) {
-                pdfs[offset + x] *= scale;
-            }
+            auto compensate = device.compile(compensate_mis_kernel);
+            builder.sum(command_buffer, weight_map, row_sums, sample_map_size.x);
+            builder.sum(command_buffer, row_sums, total_weight, row_count);
+            command_buffer << compensate(weight_map, total_weight).dispatch(pixel_count);
         }
-        auto [alias_buffer_view, _, alias_buffer_id] = pipeline.bindless_buffer<AliasEntry>(aliases.size());
-        auto [pdf_buffer_view, __, pdf_buffer_id] = pipeline.bindless_buffer<float>(pdfs.size());
-        command_buffer << alias_buffer_view.copy_from(aliases.data())
-                       << pdf_buffer_view.copy_from(pdfs.data())
+        // conditional tables per row (in place over the weights), then the marginal one over the row sums
+        builder.build(command_buffer, weight_map, alias_buffer_view.subview(row_count, pixel_count),
+                      weight_map, sample_map_size.x, row_sums);
+        builder.build(command_buffer, row_sums, alias_buffer_view.subview(0u, row_count),
+                      marginal_pdf, row_count);
+        auto combine_pdf = device.compile(combine_pdf_kernel);
+        command_buffer << combine_pdf(weight_map, marginal_pdf).dispatch(pixel_count)
                        << commit();
         alias_id.emplace(alias_buffer_id);
         pdf_id.emplace(pdf_buffer_id);
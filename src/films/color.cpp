@@ -9,6 +9,7 @@
 #include <base/pipeline.h>
 #include <util/colorspace.h>
 #include <util/thread_pool.h>
+#include <util/warp_splat.h>
 
 namespace luisa::render {
 
@@ -51,24 +52,59 @@ class ColorFilmInstance final : public Film::Instance {
 private:
     mutable Buffer<float4> _image;
     mutable Buffer<float4> _converted;
+    // per-pixel sum of squared sample luminance, only if the variance is tracked
+    mutable Buffer<float> _moments;
+    // (offset.x, offset.y, size.x, size.y) of the window backed by _image
+    Buffer<uint4> _window;
+    uint4 _host_window;
     std::shared_future<Shader1D<Buffer<float4>>> _clear_image;
+    std::shared_future<Shader1D<Buffer<float>>> _clear_moments;
     std::shared_future<Shader1D<Buffer<float4>, Buffer<float4>>> _convert_image;
 
 private:
     void _check_prepared() const noexcept {
-        LUISA_ASSERT(_image && _converted, "Film is not prepared.");
+        LUISA_ASSERT(_image && _converted && (_moments || !tracks_variance()), "Film is not prepared.");
+    }
+    [[nodiscard]] auto _window_pixel_count() const noexcept {
+        auto size = window_size();
+        return size.x * size.y;
+    }
+    [[nodiscard]] Float3 _clamp_sample(Expr<float3> rgb, Expr<float> effective_spp) const noexcept {
+        auto threshold = node<ColorFilm>()->clamp() * max(effective_spp, 1.f);
+        auto strength = max(max(max(rgb.x, rgb.y), rgb.z), 0.f);
+        return rgb * (threshold / max(strength, threshold));
+    }
+    // samples are weighted by effective_spp, so y^2 / w sums to the weighted second moment
+    [[nodiscard]] static Float _second_moment(Expr<float3> c, Expr<float> effective_spp) noexcept {
+        auto y = srgb_to_cie_y(c);
+        return ite(effective_spp > 0.f, sqr(y) / effective_spp, 0.f);
+    }
+    void _mark_invalid(Expr<uint> pixel_id) const noexcept {
+        if (node<ColorFilm>()->warn_nan()) {
+            auto inf = std::numeric_limits<float>::infinity();
+            _image->write(pixel_id, make_float4(inf, 0.f, 0.f, 1.f));
+        }
+    }
+    [[nodiscard]] UInt _pixel_index(Expr<uint2> pixel) const noexcept {
+        auto window = _window->read(0u);
+        auto p = pixel - window.xy();
+        return p.y * window.z + p.x;
     }
 
 public:
     ColorFilmInstance(Device &device, Pipeline &pipeline, const ColorFilm *film) noexcept;
     void prepare(CommandBuffer &command_buffer) noexcept override;
+    void prepare_window(CommandBuffer &command_buffer, uint2 offset, uint2 size) noexcept override;
     void download(CommandBuffer &command_buffer, float4 *framebuffer) const noexcept override;
+    void download(CommandBuffer &command_buffer, BufferView<float4> framebuffer) const noexcept override;
     [[nodiscard]] Film::Accumulation read(Expr<uint2> pixel) const noexcept override;
     void release() const noexcept override;
     void clear(CommandBuffer &command_buffer) noexcept override;
+    void track_variance(CommandBuffer &command_buffer) noexcept override;
 
 protected:
     void _accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept override;
+    void _accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept override;
 };
 
 ColorFilmInstance::ColorFilmInstance(Device &device, Pipeline &pipeline, const ColorFilm *film) noexcept
@@ -81,6 +117,13 @@ ColorFilmInstance::ColorFilmInstance(Device &device, Pipeline &pipeline, const C
         return device.compile(clear_image_kernel);
     });
 
+    Kernel1D clear_moments_kernel = [](BufferFloat moments) noexcept {
+        moments.write(dispatch_x(), 0.f);
+    };
+    _clear_moments = global_thread_pool().async([&device, clear_moments_kernel] {
+        return device.compile(clear_moments_kernel);
+    });
+
     Kernel1D convert_image_kernel = [this](BufferFloat4 accum, BufferFloat4 output) noexcept {
         auto i = dispatch_x();
         auto c = accum.read(i);
@@ -95,59 +138,120 @@ ColorFilmInstance::ColorFilmInstance(Device &device, Pipeline &pipeline, const C
 
 void ColorFilmInstance::download(CommandBuffer &command_buffer, float4 *framebuffer) const noexcept {
     _check_prepared();
-    auto resolution = node()->resolution();
-    auto pixel_count = resolution.x * resolution.y;
+    auto pixel_count = _window_pixel_count();
     command_buffer << _convert_image.get()(_image, _converted).dispatch(pixel_count)
-                   << _converted.copy_to(framebuffer);
+                   << _converted.view(0u, pixel_count).copy_to(framebuffer);
+}
+
+void ColorFilmInstance::download(CommandBuffer &command_buffer, BufferView<float4> framebuffer) const noexcept {
+    _check_prepared();
+    auto pixel_count = _window_pixel_count();
+    LUISA_ASSERT(framebuffer.size() >= pixel_count, "Framebuffer is too small.");
+    command_buffer << _convert_image.get()(_image, framebuffer).dispatch(pixel_count);
 }
 
 void ColorFilmInstance::_accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept {
     _check_prepared();
-    auto pixel_id = pixel.y * node()->resolution().x + pixel.x;
+    auto pixel_id = _pixel_index(pixel);
     $if(!any(isnan(rgb) || isinf(rgb))) {
-        auto threshold = node<ColorFilm>()->clamp() * max(effective_spp, 1.f);
-        auto strength = max(max(max(rgb.x, rgb.y), rgb.z), 0.f);
-        auto c = rgb * (threshold / max(strength, threshold));
-        _image->atomic(pixel_id).x.fetch_add(c.x);
-        _image->atomic(pixel_id).y.fetch_add(c.y);
-        _image->atomic(pixel_id).z.fetch_add(c.z);
-        _image->atomic(pixel_id).w.fetch_add(effective_spp);
+        auto c = _clamp_sample(rgb, effective_spp);
+        // lanes splatting to the same pixel share the atomics, see warp_aggregated_splat()
+        auto add = [&](uint channel, Expr<float> value) noexcept {
+            switch (channel) {
+                case 0u: _image->atomic(pixel_id).x.fetch_add(value); break;
+                case 1u: _image->atomic(pixel_id).y.fetch_add(value); break;
+                case 2u: _image->atomic(pixel_id).z.fetch_add(value); break;
+                case 3u: _image->atomic(pixel_id).w.fetch_add(value); break;
+                default: _moments->atomic(pixel_id).fetch_add(value); break;
+            }
+        };
+        if (tracks_variance()) {
+            warp_aggregated_splat(pixel_id, std::array<Float, 5u>{c.x, c.y, c.z, effective_spp,
+                                                                  _second_moment(c, effective_spp)}, add);
+        } else {
+            warp_aggregated_splat(pixel_id, std::array<Float, 4u>{c.x, c.y, c.z, effective_spp}, add);
+        }
     }
     $else {
-        if (node<ColorFilm>()->warn_nan()) {
-            auto inf = std::numeric_limits<float>::infinity();
-            _image->write(pixel_id, make_float4(inf, 0.f, 0.f, 1.f));
-        }
+        _mark_invalid(pixel_id);
+    };
+}
+
+void ColorFilmInstance::_accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept {
+    _check_prepared();
+    auto pixel_id = _pixel_index(pixel);
+    $if(!any(isnan(rgb) || isinf(rgb))) {
+        auto c = _clamp_sample(rgb, effective_spp);
+        _image->write(pixel_id, _image->read(pixel_id) + make_float4(c, effective_spp));
+        if (tracks_variance()) { _moments->write(pixel_id, _moments->read(pixel_id) + _second_moment(c, effective_spp)); }
+    }
+    $else {
+        _mark_invalid(pixel_id);
     };
 }
 
 void ColorFilmInstance::prepare(CommandBuffer &command_buffer) noexcept {
-    auto resolution = node()->resolution();
-    auto pixel_count = resolution.x * resolution.y;
-    if (!_image) { _image = pipeline().device().create_buffer<float4>(pixel_count); }
-    if (!_converted) { _converted = pipeline().device().create_buffer<float4>(pixel_count); }
+    prepare_window(command_buffer, make_uint2(0u), node()->resolution());
+}
+
+void ColorFilmInstance::prepare_window(CommandBuffer &command_buffer, uint2 offset, uint2 size) noexcept {
+    _set_window(offset, size);
+    auto pixel_count = size.x * size.y;
+    // storage only grows, so moving between equally-sized tiles keeps compiled kernels valid
+    if (!_image || _image.size() < pixel_count) {
+        _image = pipeline().device().create_buffer<float4>(pixel_count);
+        _converted = pipeline().device().create_buffer<float4>(pixel_count);
+        _bump_generation();
+    }
+    if (tracks_variance() && (!_moments || _moments.size() < _image.size())) {
+        _moments = pipeline().device().create_buffer<float>(_image.size());
+        _bump_generation();
+    }
+    if (!_window) {
+        _window = pipeline().device().create_buffer<uint4>(1u);
+        _bump_generation();
+    }
+    _host_window = make_uint4(offset, size);
+    command_buffer << _window.copy_from(&_host_window);
     clear(command_buffer);
 }
 
 void ColorFilmInstance::clear(CommandBuffer &command_buffer) noexcept {
-    auto resolution = node()->resolution();
-    auto pixel_count = resolution.x * resolution.y;
+    auto pixel_count = _window_pixel_count();
     command_buffer << _clear_image.get()(_image).dispatch(pixel_count);
+    if (tracks_variance()) { command_buffer << _clear_moments.get()(_moments).dispatch(pixel_count); }
+}
+
+void ColorFilmInstance::track_variance(CommandBuffer &command_buffer) noexcept {
+    if (tracks_variance()) { return; }
+    Film::Instance::track_variance(command_buffer);
+    // a prepared film starts tracking with the samples still to come
+    if (_image) {
+        _moments = pipeline().device().create_buffer<float>(_image.size());
+        command_buffer << _clear_moments.get()(_moments).dispatch(_window_pixel_count());
+    }
 }
 
 Film::Accumulation ColorFilmInstance::read(Expr<uint2> pixel) const noexcept {
     _check_prepared();
-    auto width = node()->resolution().x;
-    auto i = pixel.y * width + pixel.x;
+    auto i = _pixel_index(pixel);
     auto c = _image->read(i);
     auto inv_n = (1.f / max(c.w, 1e-6f));
     auto scale = inv_n * node<ColorFilm>()->scale();
-    return {.average = scale * c.xyz(), .sample_count = c.w};
+    auto variance = def(0.f);
+    if (tracks_variance()) {
+        auto mean_y = srgb_to_cie_y(c.xyz()) * inv_n;
+        auto second_moment = _moments->read(i) * inv_n;
+        auto exposure_y = srgb_to_cie_y(node<ColorFilm>()->scale());
+        variance = max(second_moment - sqr(mean_y), 0.f) / max(c.w, 1.f) * sqr(exposure_y);
+    }
+    return {.average = scale * c.xyz(), .sample_count = c.w, .variance = variance};
 }
 
 void ColorFilmInstance::release() const noexcept {
     _image = {};
     _converted = {};
+    _moments = {};
 }
 
 luisa::unique_ptr<Film::Instance> ColorFilm::build(
@@ -63,6 +63,15 @@ protected:
         Instance::_render_one_camera(command_buffer, camera);
     }
 
+    void _render_cameras(CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept override {
+        if (!pipeline().has_lighting()) [[unlikely]] {
+            LUISA_WARNING_WITH_LOCATION(
+                "No lights in scene. Rendering aborted.");
+            return;
+        }
+        _render_camera_batch(command_buffer, cameras);
+    }
+
     [[nodiscard]] Float3 Li(const Camera::Instance *camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time) const noexcept override {
         sampler()->start(pixel_id, frame_index);
         auto u_filter = sampler()->generate_pixel_2d();
@@ -21,6 +21,7 @@
 #include <util/medium_tracker.h>
 #include <util/progress_bar.h>
 #include <util/sampling.h>
+#include <util/warp_splat.h>
 #include <base/pipeline.h>
 #include <base/integrator.h>
 #include <base/scene.h>
@@ -36,6 +37,9 @@ private:
     float _rr_threshold;
     float _shift_threshold;
     bool _central_radiance;
+    float _reconstruction_alpha;
+    uint _reconstruction_iterations;
+    uint _reconstruction_interval;
 
 public:
     GradientPathTracing(Scene *scene, const SceneNodeDesc *desc) noexcept
@@ -44,12 +48,21 @@ public:
           _rr_depth{std::max(desc->property_uint_or_default("rr_depth", 0u), 0u)},
           _rr_threshold{std::max(desc->property_float_or_default("rr_threshold", 0.95f), 0.05f)},
           _shift_threshold{std::max(desc->property_float_or_default("shift_threshold", 0.1f), 0.0f)},
-          _central_radiance{desc->property_bool_or_default("central_radiance", false)} {}
+          _central_radiance{desc->property_bool_or_default("central_radiance", false)},
+          _reconstruction_alpha{std::max(desc->property_float_or_default("reconstruction_alpha", 0.2f), 1e-3f)},
+          _reconstruction_iterations{desc->property_uint_or_default("reconstruction_iterations", 50u)},
+          _reconstruction_interval{desc->property_uint_or_default("reconstruction_interval", 0u)} {}
     [[nodiscard]] auto max_depth() const noexcept { return _max_depth; }
     [[nodiscard]] auto rr_depth() const noexcept { return _rr_depth; }
     [[nodiscard]] auto rr_threshold() const noexcept { return _rr_threshold; }
     [[nodiscard]] auto shift_threshold() const noexcept { return _shift_threshold; }
     [[nodiscard]] auto central_radiance() const noexcept { return _central_radiance; }
+    // weight of the primal image against the gradients in the screened-Poisson reconstruction
+    [[nodiscard]] auto reconstruction_alpha() const noexcept { return _reconstruction_alpha; }
+    // conjugate gradient iterations, 0 to keep the primal image and only save the gradients
+    [[nodiscard]] auto reconstruction_iterations() const noexcept { return _reconstruction_iterations; }
+    // samples per pixel between preview reconstructions; with 0 the film is only written at the end
+    [[nodiscard]] auto reconstruction_interval() const noexcept { return _reconstruction_interval; }
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] luisa::unique_ptr<Integrator::Instance> build(
         Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept override;
@@ -162,6 +175,8 @@ private:
     [[nodiscard]] SampledSpectrum evaluate(RayState &main, RayState *shifteds, SampledWavelengths &swl, Expr<float> time, Expr<uint2> pixel_id) const noexcept;
 
 protected:
+    // the screened-Poisson reconstruction needs the whole film
+    [[nodiscard]] bool _supports_tiles() const noexcept override { return false; }
     void _render_one_camera(CommandBuffer &command_buffer,
                             Camera::Instance *camera) noexcept override;
 
@@ -214,19 +229,179 @@ public:
             save_image(path.string(), reinterpret_cast<const float *>(host_image->data()), size, 4);
         };
     }
+    // (average, total weight) of the pixel
+    [[nodiscard]] Float4 read(Expr<uint2> p) const noexcept {
+        auto v = def(make_float4(0.f));
+        if (_image) {
+            auto index = p.y * _resolution.x + p.x;
+            for (auto ch = 0u; ch < 4u; ch++) {
+                v[ch] = _image->read(index * 4u + ch);
+            }
+        }
+        return make_float4(ite(v.w > 0.f, v.xyz() / v.w, 0.f), v.w);
+    }
     void accumulate(Expr<uint2> p, Expr<float3> value, Expr<float> effective_spp = 1.f) noexcept {
         if (_image) {
             $if(!any(isnan(value))) {
                 auto index = p.y * _resolution.x + p.x;
-                auto v = make_float4(value, effective_spp);
-                for (auto ch = 0u; ch < 4u; ch++) {
-                    _image.atomic(index * 4u + ch).fetch_add(v[ch]);
-                }
+                warp_aggregated_splat(index, std::array<Float, 4u>{value.x, value.y, value.z, effective_spp},
+                                      [&](uint ch, Expr<float> v) noexcept {
+                                          _image.atomic(index * 4u + ch).fetch_add(v);
+                                      });
             };
         }
     }
 };
 
+// L2 screened-Poisson reconstruction of the primal image from the forward-difference gradients,
+// i.e. (alpha^2 + Dx^T Dx + Dy^T Dy) I = alpha^2 P + Dx^T Gx + Dy^T Gy with Neumann boundaries,
+// solved by conjugate gradients without leaving the device
+class ScreenedPoissonSolver {
+
+private:
+    static constexpr auto chunk_size = 64u;// pixels per thread, so that dot products need few atomics
+    static constexpr auto pap_slot = 3u;   // squared residuals of three consecutive iterations precede it
+
+private:
+    uint _pixel_count;
+    uint _iterations;
+    Buffer<float4> _x;// xyz: solution, w: weight of the primal image
+    Buffer<float4> _r;
+    Buffer<float4> _p;
+    Buffer<float4> _ap;
+    Buffer<float> _dots;
+    Shader1D<uint> _reset;
+    Shader1D<> _setup;
+    Shader1D<> _apply;
+    Shader1D<uint> _update;
+    Shader1D<uint> _direction;
+    Shader2D<> _resolve;
+
+public:
+    ScreenedPoissonSolver(Device &device, const Film::Instance *film,
+                          uint2 resolution, float alpha, uint iterations,
+                          const ImageBuffer &primal,
+                          const ImageBuffer &gradient_x,
+                          const ImageBuffer &gradient_y) noexcept
+        : _pixel_count{resolution.x * resolution.y}, _iterations{iterations},
+          _x{device.create_buffer<float4>(_pixel_count)},
+          _r{device.create_buffer<float4>(_pixel_count)},
+          _p{device.create_buffer<float4>(_pixel_count)},
+          _ap{device.create_buffer<float4>(_pixel_count)},
+          _dots{device.create_buffer<float>(4u)} {
+
+        auto alpha2 = alpha * alpha;
+        auto pixel_count = _pixel_count;
+        auto coord = [resolution](Expr<uint> i) noexcept {
+            return make_uint2(i % resolution.x, i / resolution.x);
+        };
+        auto for_each_pixel = [pixel_count](auto &&f) noexcept {
+            auto begin = dispatch_x() * chunk_size;
+            auto end = min(begin + chunk_size, pixel_count);
+            $for (i, begin, end) { f(i); };
+        };
+        // the system matrix applied to the image read by v
+        auto system = [alpha2, resolution](auto &&v, Expr<uint2> q) noexcept {
+            auto c = v(q);
+            auto result = def(alpha2 * c);
+            $if (q.x > 0u) { result += c - v(q - make_uint2(1u, 0u)); };
+            $if (q.x + 1u < resolution.x) { result += c - v(q + make_uint2(1u, 0u)); };
+            $if (q.y > 0u) { result += c - v(q - make_uint2(0u, 1u)); };
+            $if (q.y + 1u < resolution.y) { result += c - v(q + make_uint2(0u, 1u)); };
+            return result;
+        };
+        auto image = [resolution](const Buffer<float4> &buffer) noexcept {
+            return [&buffer, resolution](Expr<uint2> q) noexcept {
+                return buffer->read(q.y * resolution.x + q.x).xyz();
+            };
+        };
+        auto primal_image = [&primal](Expr<uint2> q) noexcept { return primal.read(q).xyz(); };
+
+        Kernel1D reset_kernel = [&](UInt slot) noexcept {
+            _dots->write(slot, 0.f);
+            _dots->write(pap_slot, 0.f);
+        };
+        // starts from the primal image, x = P, r = p = b - A P
+        Kernel1D setup_kernel = [&]() noexcept {
+            auto rr = def(0.f);
+            for_each_pixel([&](Expr<uint> i) noexcept {
+                auto q = coord(i);
+                auto p = primal.read(q);
+                auto b = def(alpha2 * p.xyz());
+                $if (q.x > 0u) { b += gradient_x.read(q - make_uint2(1u, 0u)).xyz(); };
+                $if (q.x + 1u < resolution.x) { b -= gradient_x.read(q).xyz(); };
+                $if (q.y > 0u) { b += gradient_y.read(q - make_uint2(0u, 1u)).xyz(); };
+                $if (q.y + 1u < resolution.y) { b -= gradient_y.read(q).xyz(); };
+                auto r = b - system(primal_image, q);
+                _x->write(i, p);
+                _r->write(i, make_float4(r, 0.f));
+                _p->write(i, make_float4(r, 0.f));
+                rr += dot(r, r);
+            });
+            _dots->atomic(0u).fetch_add(rr);
+        };
+        Kernel1D apply_kernel = [&]() noexcept {
+            auto pap = def(0.f);
+            for_each_pixel([&](Expr<uint> i) noexcept {
+                auto ap = system(image(_p), coord(i));
+                _ap->write(i, make_float4(ap, 0.f));
+                pap += dot(_p->read(i).xyz(), ap);
+            });
+            _dots->atomic(pap_slot).fetch_add(pap);
+        };
+        Kernel1D update_kernel = [&](UInt k) noexcept {
+            auto rr = _dots->read(k % 3u);
+            auto pap = _dots->read(pap_slot);
+            auto a = ite(pap > 0.f, rr / pap, 0.f);
+            auto rr_next = def(0.f);
+            for_each_pixel([&](Expr<uint> i) noexcept {
+                auto x = _x->read(i);
+                _x->write(i, make_float4(x.xyz() + a * _p->read(i).xyz(), x.w));
+                auto r = _r->read(i).xyz() - a * _ap->read(i).xyz();
+                _r->write(i, make_float4(r, 0.f));
+                rr_next += dot(r, r);
+            });
+            _dots->atomic((k + 1u) % 3u).fetch_add(rr_next);
+        };
+        Kernel1D direction_kernel = [&](UInt k) noexcept {
+            auto rr = _dots->read(k % 3u);
+            auto beta = ite(rr > 0.f, _dots->read((k + 1u) % 3u) / rr, 0.f);
+            for_each_pixel([&](Expr<uint> i) noexcept {
+                _p->write(i, make_float4(_r->read(i).xyz() + beta * _p->read(i).xyz(), 0.f));
+            });
+        };
+        // replaces the film with the solution, keeping the weight of each pixel
+        Kernel2D resolve_kernel = [&]() noexcept {
+            auto q = dispatch_id().xy();
+            auto x = _x->read(q.y * resolution.x + q.x);
+            $if (x.w > 0.f) {
+                film->accumulate_exclusive(q, max(x.xyz(), 0.f) * x.w, x.w);
+            };
+        };
+        _reset = device.compile(reset_kernel);
+        _setup = device.compile(setup_kernel);
+        _apply = device.compile(apply_kernel);
+        _update = device.compile(update_kernel);
+        _direction = device.compile(direction_kernel);
+        _resolve = device.compile(resolve_kernel);
+    }
+
+    void solve(CommandBuffer &command_buffer, Film::Instance *film) const noexcept {
+        auto threads = (_pixel_count + chunk_size - 1u) / chunk_size;
+        command_buffer << _reset(0u).dispatch(1u)
+                       << _setup().dispatch(threads);
+        for (auto k = 0u; k < _iterations; k++) {
+            command_buffer << _reset((k + 1u) % 3u).dispatch(1u)
+                           << _apply().dispatch(threads)
+                           << _update(k).dispatch(threads)
+                           << _direction(k).dispatch(threads);
+        }
+        film->clear(command_buffer);
+        auto resolution = film->node()->resolution();
+        command_buffer << _resolve().dispatch(resolution);
+    }
+};
+
 luisa::unique_ptr<Integrator::Instance> GradientPathTracing::build(
     Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept {
     return luisa::make_unique<GradientPathTracingInstance>(
@@ -1036,9 +1211,20 @@ void GradientPathTracingInstance::_render_one_camera(
     auto image_file = camera->node()->file();
 
     luisa::unordered_map<luisa::string, luisa::unique_ptr<ImageBuffer>> image_buffers;
+    luisa::unique_ptr<ScreenedPoissonSolver> solver;
     if (!node<GradientPathTracing>()->central_radiance()) {
         image_buffers.emplace("gradient_x", luisa::make_unique<ImageBuffer>(pipeline(), resolution));
         image_buffers.emplace("gradient_y", luisa::make_unique<ImageBuffer>(pipeline(), resolution));
+        // the film is overwritten by the reconstruction, so the primal image is accumulated aside
+        if (auto iterations = node<GradientPathTracing>()->reconstruction_iterations(); iterations != 0u) {
+            image_buffers.emplace("primal", luisa::make_unique<ImageBuffer>(pipeline(), resolution));
+            Clock clock_solver;
+            solver = luisa::make_unique<ScreenedPoissonSolver>(
+                pipeline().device(), camera->film(), resolution,
+                node<GradientPathTracing>()->reconstruction_alpha(), iterations,
+                *image_buffers.at("primal"), *image_buffers.at("gradient_x"), *image_buffers.at("gradient_y"));
+            LUISA_INFO("Screened-Poisson solver compiled in {} ms.", clock_solver.toc());
+        }
     }
 
     auto clear_image_buffer = [&] {
@@ -1065,25 +1251,38 @@ void GradientPathTracingInstance::_render_one_camera(
         auto eval = evaluate_point(pixel_id, frame_index, time, diff_scale_factor, camera);
         if (node<GradientPathTracing>()->central_radiance()) {
             auto L = pipeline().spectrum()->srgb(eval.swl, eval.very_direct + eval.throughput);
-            camera->film()->accumulate(pixel_id, shutter_weight * L);
+            camera->film()->accumulate_exclusive(pixel_id, shutter_weight * L);
         } else {
+            // with a solver, the film only ever holds the latest reconstruction
+            auto primal = image_buffers.find("primal");
+            auto splat = [&](Expr<uint2> p, Expr<float3> L, float effective_spp) noexcept {
+                if (primal != image_buffers.end()) {
+                    primal->second->accumulate(p, L, effective_spp);
+                } else {
+                    camera->film()->accumulate(p, L, effective_spp);
+                }
+            };
+            // neighbours splat into each other's pixels, so these stay atomic
             for (int i = 0; i < 4; i++) {
                 auto current_pixel = pixel_id + pixel_shifts[i];
                 $if(all(current_pixel >= 0u && current_pixel < resolution)) {
                     auto L = pipeline().spectrum()->srgb(eval.swl, 2.f * eval.neighbor_throughput[i]);
-                    camera->film()->accumulate(current_pixel, shutter_weight * L, 1.f);
+                    splat(current_pixel, shutter_weight * L, 1.f);
                 };
             }
             auto L = pipeline().spectrum()->srgb(eval.swl, 8.f * eval.very_direct + 2.f * eval.throughput);
-            camera->film()->accumulate(pixel_id, shutter_weight * L, 4.f);
+            splat(pixel_id, shutter_weight * L, 4.f);
 
+            // forward differences, i.e. gradient_x at p is I(p + (1, 0)) - I(p), so the
+            // right and bottom shifts land on this pixel and the left and top ones on the neighbour
             for (int i = 0; i < 4; i++) {
                 auto current_pixel = pixel_id + pixel_shifts[i];
                 auto key = i % 2 == 0 ? "gradient_x" : "gradient_y";
                 auto sign = i < 2 ? 1.f : -1.f;
                 $if(all(current_pixel >= 0u && current_pixel < resolution)) {
                     auto L = pipeline().spectrum()->srgb(eval.swl, sign * (2.f * eval.gradients[i] - eval.very_direct));
-                    image_buffers.at(key)->accumulate(current_pixel, shutter_weight * L, 1.f);
+                    auto target = pixel_id + (i < 2 ? make_uint2(0u) : pixel_shifts[i]);
+                    image_buffers.at(key)->accumulate(target, shutter_weight * L, 1.f);
                 };
             }
         }
@@ -1102,12 +1301,18 @@ void GradientPathTracingInstance::_render_one_camera(
     progress.update(0.);
     auto dispatch_count = 0u;
     auto sample_id = 0u;
+    auto reconstruction_interval = node<GradientPathTracing>()->reconstruction_interval();
     clear_image_buffer();
     for (auto s : shutter_samples) {
         auto updated = pipeline().update(command_buffer, s.point.time);
         for (auto i = 0u; i < s.spp; i++) {
             command_buffer << render(sample_id++, s.point.time, s.point.weight)
                                   .dispatch(resolution);
+            // preview: the film is replaced by the reconstruction from the passes so far
+            if (solver != nullptr && reconstruction_interval != 0u &&
+                sample_id % reconstruction_interval == 0u && sample_id < spp) {
+                solver->solve(command_buffer, camera->film());
+            }
             if (auto &&p = pipeline().printer(); !p.empty()) {
                 command_buffer << p.retrieve();
             }
@@ -1129,6 +1334,7 @@ void GradientPathTracingInstance::_render_one_camera(
     auto parent_path = camera->node()->file().parent_path();
     auto filename = camera->node()->file().stem().string();
     auto ext = camera->node()->file().extension().string();
+    if (solver != nullptr) { solver->solve(command_buffer, camera->film()); }
     command_buffer << synchronize();
     for (auto &[key, buffer] : image_buffers) {
         auto path = parent_path / fmt::format("{}_{}{}", filename, key, ext);
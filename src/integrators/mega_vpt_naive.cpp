@@ -65,6 +65,15 @@ protected:
         Instance::_render_one_camera(command_buffer, camera);
     }
 
+    void _render_cameras(CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept override {
+        if (!pipeline().has_lighting()) [[unlikely]] {
+            LUISA_WARNING_WITH_LOCATION(
+                "No lights in scene. Rendering aborted.");
+            return;
+        }
+        _render_camera_batch(command_buffer, cameras);
+    }
+
     [[nodiscard]] UInt _event(const SampledWavelengths &swl, luisa::shared_ptr<Interaction> it, Expr<float> time,
                               Expr<float3> wo, Expr<float3> wi) const noexcept {
         Float3 wo_local, wi_local;
@@ -5,6 +5,7 @@
 #include <util/sampling.h>
 #include <util/medium_tracker.h>
 #include <util/progress_bar.h>
+#include <util/warp_splat.h>
 #include <base/pipeline.h>
 #include <base/integrator.h>
 
@@ -14,7 +15,7 @@ using namespace compute;
 /* Procedure :
     1.emit photons and save them
     2.(first time only) initialize pixelinfo and get the proper initial radius based on emitted photons
-    3.put photons in the hashmap grids
+    3.put photons in the hashmap grids, or counting-sort them by grid cell when grid is "sorted"
     4.render direct light seperately, stop at high roughness, find nearby 3*3*3 grids for photons and save the informations
     5.using shared(SPPM)/PPM update procedure for pixels
     6.if shared, a seperate update is performed, and the grid_len is also updated according to radius
@@ -30,6 +31,8 @@ private:
     float _initial_radius;
     bool _separate_direct;
     bool _shared_radius;
+    bool _sorted_grid;
+    bool _benchmark_grid;
 
 public:
     MegakernelPhotonMapping(Scene *scene, const SceneNodeDesc *desc) noexcept
@@ -40,7 +43,17 @@ public:
           _initial_radius{std::max(desc->property_float_or_default("initial_radius", -200.f), -10000.f)},//<0 for world_size/-radius (-grid count)
           _photon_per_iter{std::max(desc->property_uint_or_default("photon_per_iter", 200000u), 10u)},
           _separate_direct{true},                                                  //when false, use photon mapping for all flux and gathering at first intersection. Just for debug
-          _shared_radius{desc->property_bool_or_default("shared_radius", true)} {};//whether or not use the shared radius trick in SPPM paper. True is better in performance.
+          _shared_radius{desc->property_bool_or_default("shared_radius", true)},//whether or not use the shared radius trick in SPPM paper. True is better in performance.
+          _sorted_grid{[desc] {//"hash" for per-cell linked lists, "sorted" for photons sorted by cell
+              auto grid = desc->property_string_or_default("grid", "hash");
+              for (auto &c : grid) { c = static_cast<char>(tolower(c)); }
+              if (grid != "hash" && grid != "sorted") [[unlikely]] {
+                  LUISA_WARNING_WITH_LOCATION(
+                      "Unknown photon grid \"{}\". Using \"hash\" instead.", grid);
+              }
+              return grid == "sorted";
+          }()},
+          _benchmark_grid{desc->property_bool_or_default("benchmark_grid", false)} {};//time grid build and gather of every iteration
     [[nodiscard]] auto max_depth() const noexcept { return _max_depth; }
     [[nodiscard]] auto photon_per_iter() const noexcept { return _photon_per_iter; }
     [[nodiscard]] auto rr_depth() const noexcept { return _rr_depth; }
@@ -48,6 +61,8 @@ public:
     [[nodiscard]] auto rr_threshold() const noexcept { return _rr_threshold; }
     [[nodiscard]] auto separate_direct() const noexcept { return _separate_direct; }
     [[nodiscard]] auto shared_radius() const noexcept { return _shared_radius; }
+    [[nodiscard]] auto sorted_grid() const noexcept { return _sorted_grid; }
+    [[nodiscard]] auto benchmark_grid() const noexcept { return _benchmark_grid; }
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] luisa::unique_ptr<Integrator::Instance> build(
         Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept override;
@@ -62,6 +77,9 @@ public:
     //The fetchmax functions have wrong implementation in Luisa compute, so related feature are wrong now
     //(Including uint grid index, and inital_radius<0)
     class PhotonMap {
+    private:
+        static constexpr auto scan_chunk = 256u;//cells scanned sequentially by one thread
+
     private:
         Buffer<uint> _grid_head;
         Buffer<float> _beta;
@@ -76,12 +94,27 @@ public:
         Buffer<float> _grid_len;//the length of a single grid (float1)
         Buffer<float> _swl_lambda;
         Buffer<float> _swl_pdf;
+        //sorted mode: photons are counting-sorted by cell into the _sorted_* copies,
+        //and cell k owns the range [_cell_start[k], _cell_start[k + 1])
+        bool _sorted;
+        Buffer<uint> _key;
+        Buffer<uint> _cell_count;
+        Buffer<uint> _cell_start;
+        luisa::vector<Buffer<uint>> _scan_levels;//chunk totals of each level of the prefix sum
+        Buffer<float> _sorted_beta;
+        Buffer<float3> _sorted_wi;
+        Buffer<float3> _sorted_position;
+        Buffer<float> _sorted_swl_lambda;
+        Buffer<float> _sorted_swl_pdf;
+        Shader1D<> _count_cells;
+        Shader1D<Buffer<uint>, Buffer<uint>, Buffer<uint>, uint> _scan_chunks;
+        Shader1D<Buffer<uint>, Buffer<uint>, uint> _add_offsets;
+        Shader1D<> _scatter;
 
     public:
         Buffer<uint> tot_test;
-        PhotonMap(uint photon_count, const Spectrum::Instance *spectrum) {
+        PhotonMap(uint photon_count, const Spectrum::Instance *spectrum, bool sorted) {
             auto &&device = spectrum->pipeline().device();
-            _grid_head = device.create_buffer<uint>(photon_count);
             _beta = device.create_buffer<float>(photon_count * spectrum->node()->dimension());
             _wi = device.create_buffer<float3>(photon_count);
             _position = device.create_buffer<float3>(photon_count);
@@ -92,10 +125,16 @@ public:
             _grid_max = device.create_buffer<float>(3u);
             _size = photon_count;
             _spectrum = spectrum;
+            _sorted = sorted;
             if (!_spectrum->node()->is_fixed()) {
                 _swl_lambda = device.create_buffer<float>(photon_count * spectrum->node()->dimension());
                 _swl_pdf = device.create_buffer<float>(photon_count * spectrum->node()->dimension());
             }
+            if (sorted) {
+                _create_sorted_storage(device);
+            } else {
+                _grid_head = device.create_buffer<uint>(photon_count);
+            }
             tot_test = device.create_buffer<uint>(1u);
         }
         auto tot_photon() const noexcept {
@@ -107,17 +146,22 @@ public:
         auto size() const noexcept {
             return _size;
         }
+        auto sorted() const noexcept {
+            return _sorted;
+        }
+        //photon accessors read the sorted copies in sorted mode
         auto position(Expr<uint> index) const noexcept {
-            return _position->read(index);
+            return _sorted ? _sorted_position->read(index) : _position->read(index);
         }
         auto wi(Expr<uint> index) const noexcept {
-            return _wi->read(index);
+            return _sorted ? _sorted_wi->read(index) : _wi->read(index);
         }
         auto beta(Expr<uint> index) const noexcept {
             auto dimension = _spectrum->node()->dimension();
+            auto &&beta = _sorted ? _sorted_beta : _beta;
             SampledSpectrum s{dimension};
             for (auto i = 0u; i < dimension; ++i)
-                s[i] = _beta->read(index * dimension + i);
+                s[i] = beta->read(index * dimension + i);
             return s;
         }
         auto nxt(Expr<uint> index) const noexcept {
@@ -128,10 +172,12 @@ public:
         }
         auto swl(Expr<uint> index) const noexcept {
             auto dimension = _spectrum->node()->dimension();
+            auto &&lambda = _sorted ? _sorted_swl_lambda : _swl_lambda;
+            auto &&pdf = _sorted ? _sorted_swl_pdf : _swl_pdf;
             SampledWavelengths swl(dimension);
             for (auto i = 0u; i < dimension; ++i) {
-                swl.set_lambda(i, _swl_lambda->read(index * dimension + i));
-                swl.set_pdf(i, _swl_pdf->read(index * dimension + i));
+                swl.set_lambda(i, lambda->read(index * dimension + i));
+                swl.set_pdf(i, pdf->read(index * dimension + i));
             }
             return swl;
         }
@@ -179,8 +225,28 @@ public:
             auto head = _grid_head->atomic(grid_index).exchange(index);
             _nxt->write(index, head);
         }
+        //calls f with the index of every photon hashed to the cell
+        template<typename F>
+        void for_each_photon(Expr<int3> cell, F &&f) const noexcept {
+            auto key = grid_to_index(cell);
+            if (_sorted) {
+                $for(photon_index, _cell_start->read(key), _cell_start->read(key + 1u)) {
+                    f(photon_index);
+                };
+            } else {
+                auto photon_index = def(grid_head(key));
+                $while(photon_index != ~0u) {
+                    f(photon_index);
+                    photon_index = nxt(photon_index);
+                };
+            }
+        }
         void reset(Expr<uint> index) {
-            _grid_head->write(index, ~0u);
+            if (_sorted) {
+                _cell_count->write(index, 0u);
+            } else {
+                _grid_head->write(index, ~0u);
+            }
             _tot->write(0, 0u);
             _nxt->write(index, ~0u);
             for (auto i = 0u; i < 3u; ++i) {
@@ -188,6 +254,27 @@ public:
                 _grid_max->write(i, -std::numeric_limits<float>::max());
             }
         }
+        //sorted mode only: counting sort of the emitted photons by cell, i.e. a single-digit radix sort
+        void sort(CommandBuffer &command_buffer) const noexcept {
+            command_buffer << _count_cells().dispatch(_size);
+            auto n = _size + 1u;
+            auto data = &_cell_start;
+            auto source = &_cell_count;
+            for (auto &level : _scan_levels) {
+                command_buffer << _scan_chunks(*source, *data, level, n).dispatch((n + scan_chunk - 1u) / scan_chunk);
+                source = &level;
+                data = &level;
+                n = (n + scan_chunk - 1u) / scan_chunk;
+            }
+            //the last level only holds the grand total, every other one offsets the level below
+            for (auto level = static_cast<int>(_scan_levels.size()) - 2; level >= 0; level--) {
+                auto &offsets = _scan_levels[level];
+                auto &scanned = level == 0 ? _cell_start : _scan_levels[level - 1];
+                auto size = static_cast<uint>(scanned.size());
+                command_buffer << _add_offsets(scanned, offsets, size).dispatch(size);
+            }
+            command_buffer << _scatter().dispatch(_size);
+        }
         void write_grid_len(Expr<float> len) {
             _grid_len->write(0u, len);
         }
@@ -203,6 +290,74 @@ public:
             auto _grid_size = _spectrum->pipeline().geometry()->world_max() - _spectrum->pipeline().geometry()->world_min();
             return min(min(_grid_size.x / grid_count, _grid_size.y / grid_count), _grid_size.z / grid_count);
         }
+
+    private:
+        void _create_sorted_storage(Device &device) noexcept {
+            auto dimension = _spectrum->node()->dimension();
+            _key = device.create_buffer<uint>(_size);
+            _cell_count = device.create_buffer<uint>(_size + 1u);
+            _cell_start = device.create_buffer<uint>(_size + 1u);
+            for (auto n = _size + 1u; n > 1u;) {
+                n = (n + scan_chunk - 1u) / scan_chunk;
+                _scan_levels.emplace_back(device.create_buffer<uint>(n));
+            }
+            _sorted_beta = device.create_buffer<float>(_size * dimension);
+            _sorted_wi = device.create_buffer<float3>(_size);
+            _sorted_position = device.create_buffer<float3>(_size);
+            if (!_spectrum->node()->is_fixed()) {
+                _sorted_swl_lambda = device.create_buffer<float>(_size * dimension);
+                _sorted_swl_pdf = device.create_buffer<float>(_size * dimension);
+            }
+            Kernel1D count_cells_kernel = [&]() noexcept {
+                auto index = dispatch_x();
+                $if(index == 0u) { _cell_count->write(_size, 0u); };
+                $if(index < tot_photon()) {
+                    auto key = cast<uint>(point_to_index(_position->read(index)));
+                    _key->write(index, key);
+                    _cell_count->atomic(key).fetch_add(1u);
+                };
+            };
+            //exclusive scan of each chunk, whose total goes to the next level
+            Kernel1D scan_chunks_kernel = [](BufferUInt source, BufferUInt data, BufferUInt totals, UInt n) noexcept {
+                auto chunk = dispatch_x();
+                auto begin = chunk * scan_chunk;
+                auto end = min(begin + scan_chunk, n);
+                auto sum = def(0u);
+                $for(i, begin, end) {
+                    auto x = source.read(i);
+                    data.write(i, sum);
+                    sum += x;
+                };
+                totals.write(chunk, sum);
+            };
+            Kernel1D add_offsets_kernel = [](BufferUInt data, BufferUInt offsets, UInt n) noexcept {
+                auto i = dispatch_x();
+                $if(i < n) { data.write(i, data.read(i) + offsets.read(i / scan_chunk)); };
+            };
+            //the counts are consumed here, so they are zero again for the next iteration
+            Kernel1D scatter_kernel = [&]() noexcept {
+                auto index = dispatch_x();
+                $if(index < tot_photon()) {
+                    auto key = _key->read(index);
+                    auto slot = _cell_start->read(key) + _cell_count->atomic(key).fetch_sub(1u) - 1u;
+                    _sorted_position->write(slot, _position->read(index));
+                    _sorted_wi->write(slot, _wi->read(index));
+                    for (auto i = 0u; i < dimension; ++i) {
+                        _sorted_beta->write(slot * dimension + i, _beta->read(index * dimension + i));
+                    }
+                    if (!_spectrum->node()->is_fixed()) {
+                        for (auto i = 0u; i < dimension; ++i) {
+                            _sorted_swl_lambda->write(slot * dimension + i, _swl_lambda->read(index * dimension + i));
+                            _sorted_swl_pdf->write(slot * dimension + i, _swl_pdf->read(index * dimension + i));
+                        }
+                    }
+                };
+            };
+            _count_cells = device.compile(count_cells_kernel);
+            _scan_chunks = device.compile(scan_chunks_kernel);
+            _add_offsets = device.compile(add_offsets_kernel);
+            _scatter = device.compile(scatter_kernel);
+        }
     };
     //Store the information of pixel updates
     class PixelIndirect {
@@ -346,8 +501,10 @@ public:
             auto resolution = _film->node()->resolution();
             auto offset = pixel_id.y * resolution.x + pixel_id.x;
             auto dimension = 3u;
-            for (auto i = 0u; i < dimension; ++i)
-                _phi->atomic(offset * dimension + i).fetch_add(phi[i]);
+            warp_aggregated_splat(offset, std::array<Float, 3u>{phi.x, phi.y, phi.z},
+                                  [&](uint i, Expr<float> value) noexcept {
+                                      _phi->atomic(offset * dimension + i).fetch_add(value);
+                                  });
         }
         void pixel_info_update(Expr<uint2> pixel_id) {
             $if(cur_n(pixel_id) > 0) {
@@ -378,6 +535,8 @@ public:
     };
 
 protected:
+    // photon statistics are gathered over the whole film
+    [[nodiscard]] bool _supports_tiles() const noexcept override { return false; }
     void _render_one_camera(CommandBuffer &command_buffer, Camera::Instance *camera) noexcept override {
         if (!pipeline().has_lighting()) [[unlikely]] {
             LUISA_WARNING_WITH_LOCATION(
@@ -409,7 +568,8 @@ protected:
         }
         auto clamp = camera->film()->node()->clamp() * photon_per_iter * pi * radius * radius;
         PixelIndirect indirect(photon_per_iter, spectrum, camera->film(), clamp, node<MegakernelPhotonMapping>()->shared_radius());
-        PhotonMap photons(photon_per_iter * node<MegakernelPhotonMapping>()->max_depth(), spectrum);
+        PhotonMap photons(photon_per_iter * node<MegakernelPhotonMapping>()->max_depth(), spectrum,
+                          node<MegakernelPhotonMapping>()->sorted_grid());
 
         //initialize PixelIndirect
         Kernel2D indirect_initialize_kernel = [&]() noexcept {
@@ -438,13 +598,14 @@ protected:
             auto index = static_cast<UInt>(dispatch_x());
             photons.reset(index);
         };
-        //put the photons into hash table
+        //put the photons into hash table (hash grid only, the sorted one is built by PhotonMap::sort)
         Kernel1D photon_grid_kernel = [&]() noexcept {
             auto index = static_cast<UInt>(dispatch_x());
-            auto radius = node<MegakernelPhotonMapping>()->initial_radius();
-            $if(photons.nxt(index) == 0u) {
-                photons.link(index);
-            };
+            if (!photons.sorted()) {
+                $if(photons.nxt(index) == 0u) {
+                    photons.link(index);
+                };
+            }
         };
         //emit photons
         Kernel2D photon_emit_kernel = [&](UInt frame_index, Float time) noexcept {
@@ -459,7 +620,7 @@ protected:
             //set_block_size(16u, 16u, 1u);
             auto pixel_id = dispatch_id().xy();
             auto L = Li(photons, indirect, camera, frame_index, pixel_id, time, shutter_weight);
-            camera->film()->accumulate(pixel_id, L, 0.5f);
+            camera->film()->accumulate_exclusive(pixel_id, L, 0.5f);
         };
         //update the radius/light information per pixel
         Kernel2D indirect_update_kernel = [&]() noexcept {
@@ -476,7 +637,7 @@ protected:
             set_block_size(16u, 16u, 1u);
             auto pixel_id = dispatch_id().xy();
             auto L = get_indirect(indirect, camera->pipeline().spectrum(), pixel_id, tot_photon);
-            camera->film()->accumulate(pixel_id, L, 0.5f * spp);
+            camera->film()->accumulate_exclusive(pixel_id, L, 0.5f * spp);
         };
         Clock clock_compile;
         auto render = pipeline().device().compile(render_kernel);
@@ -501,6 +662,11 @@ protected:
         auto sample_id = 0u;
         bool initial_flag = false;
         uint runtime_spp = 0u;
+        //serializes every iteration to time the grid build and the render pass that gathers from it
+        auto benchmark = node<MegakernelPhotonMapping>()->benchmark_grid();
+        Clock benchmark_clock;
+        auto build_time = 0.;
+        auto gather_time = 0.;
         //TODO: maybe swap the for order for better radius convergence
         for (auto s : shutter_samples) {
             auto updated = pipeline().update(command_buffer, s.point.time);
@@ -516,9 +682,23 @@ protected:
                     initial_flag = true;
                     command_buffer << indirect_initialize().dispatch(resolution);
                 }
-                command_buffer << photon_grid().dispatch(photons.size());
+                if (benchmark) { command_buffer << synchronize(); benchmark_clock.tic(); }
+                if (photons.sorted()) {
+                    photons.sort(command_buffer);
+                } else {
+                    command_buffer << photon_grid().dispatch(photons.size());
+                }
+                if (benchmark) {
+                    command_buffer << synchronize();
+                    build_time += benchmark_clock.toc();
+                    benchmark_clock.tic();
+                }
                 command_buffer << render(sample_id++, s.point.time, s.point.weight)
                                       .dispatch(resolution);
+                if (benchmark) {
+                    command_buffer << synchronize();
+                    gather_time += benchmark_clock.toc();
+                }
                 command_buffer << update().dispatch(resolution);
                 if (node<MegakernelPhotonMapping>()->shared_radius()) {
                     command_buffer << shared_update().dispatch(1u);
@@ -533,6 +713,11 @@ protected:
             command_buffer << pipeline().printer().retrieve();
         }
         LUISA_INFO("total spp:{}", runtime_spp);
+        if (benchmark && runtime_spp != 0u) {
+            LUISA_INFO("Photon grid ({}): {} ms build and {} ms render with gather per iteration.",
+                       photons.sorted() ? "sorted" : "hash",
+                       build_time / runtime_spp, gather_time / runtime_spp);
+        }
         //tot_photon is photon_per_iter not photon_per_iter*spp because of unnormalized samples
         command_buffer << indirect_draw(node<MegakernelPhotonMapping>()->photon_per_iter(), runtime_spp).dispatch(resolution);
         command_buffer << synchronize();
@@ -682,8 +867,7 @@ protected:
                             $for(y, grid.y - 1, grid.y + 2) {
                                 $for(z, grid.z - 1, grid.z + 2) {
                                     Int3 check_grid{x, y, z};
-                                    auto photon_index = photons.grid_head(photons.grid_to_index(check_grid));
-                                    $while(photon_index != ~0u) {
+                                    photons.for_each_photon(check_grid, [&](Expr<uint> photon_index) noexcept {
                                         auto position = photons.position(photon_index);
                                         auto dis = distance(position, it->p());
                                         //pipeline().printer().info("check_grid:{},{},{};test_grid:{},{},{}; limit:{}", x, y, z, test_grid[0], test_grid[1], test_grid[2], indirect.radius(pixel_id));
@@ -705,9 +889,7 @@ protected:
                                             indirect.add_cur_n(pixel_id, 1u);
                                             //pipeline().printer().info("render:{}", indirect.cur_n(pixel_id));
                                         };
-
-                                        photon_index = photons.nxt(photon_index);
-                                    };
+                                    });
                                 };
                             };
                         };
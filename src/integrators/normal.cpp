@@ -33,6 +33,10 @@ public:
     using ProgressiveIntegrator::Instance::Instance;
 
 protected:
+    void _render_cameras(CommandBuffer &command_buffer, luisa::span<Camera::Instance *const> cameras) noexcept override {
+        _render_camera_batch(command_buffer, cameras);
+    }
+
     [[nodiscard]] Float3 Li(const Camera::Instance *camera, Expr<uint> frame_index,
                             Expr<uint2> pixel_id, Expr<float> time) const noexcept override {
         sampler()->start(pixel_id, frame_index);
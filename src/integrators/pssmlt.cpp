@@ -7,6 +7,7 @@
 #include <util/sampling.h>
 #include <util/progress_bar.h>
 #include <util/counter_buffer.h>
+#include <util/warp_splat.h>
 #include <base/pipeline.h>
 #include <base/integrator.h>
 
@@ -266,6 +267,9 @@ private:
     float _sigma;
     bool _statistics;
 
+public:
+    static constexpr auto max_bootstrap_samples = 1u << 24u;
+
 public:
     PSSMLT(Scene *scene, const SceneNodeDesc *desc) noexcept
         : ProgressiveIntegrator{scene, desc},
@@ -287,7 +291,15 @@ public:
           _statistics{desc->property_bool_or_default(
               "statistics", lazy_construct([desc] {
                   return desc->property_bool_or_default("stat", false);
-              }))} {}
+              }))} {
+        // the bootstrap table is sampled with a single float, which resolves at most 2^24 entries
+        if (_bootstrap_samples > max_bootstrap_samples) [[unlikely]] {
+            LUISA_ERROR(
+                "PSSMLT bootstrap_samples ({}) exceeds the maximum of {}. [{}]",
+                _bootstrap_samples, max_bootstrap_samples,
+                desc->source_location().string());
+        }
+    }
     [[nodiscard]] auto max_depth() const noexcept { return _max_depth; }
     [[nodiscard]] auto rr_depth() const noexcept { return _rr_depth; }
     [[nodiscard]] auto rr_threshold() const noexcept { return _rr_threshold; }
@@ -451,11 +463,18 @@ private:
     }
 
 private:
-    [[nodiscard]] auto _bootstrap(CommandBuffer &command_buffer,
+    // everything stays on the device, so that chain creation follows without waiting for the bootstrap
+    struct Bootstrap {
+        Buffer<float> weights;// overwritten by the pdf, kept alive until the chains are created
+        Buffer<AliasEntry> sampling_table;
+        Buffer<float> weight_sum;
+    };
+
+    [[nodiscard]] Bootstrap _bootstrap(CommandBuffer &command_buffer,
                                   Camera::Instance *camera, float initial_time) noexcept {
         auto bootstrap_count = node<PSSMLT>()->bootstrap_samples();
         auto bootstrap_weights = pipeline().device().create_buffer<float>(bootstrap_count);
-        command_buffer << synchronize();
+        auto bootstrap_sum = pipeline().device().create_buffer<float>(1u);
 
         Clock clk;
         LUISA_INFO("PSSMLT: compiling bootstrap kernel.");
@@ -467,31 +486,24 @@ private:
             auto [_, L, is_light] = Li(*_sampler, seed, camera, time);
             bootstrap_weights->write(bootstrap_id, _s(L, is_light));
         });
-        LUISA_INFO("PSSMLT: running bootstrap kernel.");
-        luisa::vector<float> bw(bootstrap_count);
+        LUISA_INFO("PSSMLT: compiled bootstrap kernel in {} ms.", clk.toc());
         auto chains = node<PSSMLT>()->chains();
         auto dispatches = (bootstrap_count + chains - 1u) / chains;
         for (auto i = 0u; i < dispatches; i++) {
             auto chains_to_dispatch = std::min((i + 1u) * chains, bootstrap_count) - i * chains;
             command_buffer << bootstrap(i * chains, initial_time).dispatch(chains_to_dispatch);
         }
-        command_buffer << bootstrap_weights.copy_to(bw.data()) << synchronize();
-        LUISA_INFO("PSSMLT: Generated {} bootstrap sample(s) in {} ms.",
-                   bootstrap_count, clk.toc());
-        auto b = 0.;
-        for (auto w : bw) { b += w; }
-        b /= bootstrap_count;
-        LUISA_INFO("PSSMLT: normalization factor is {}.", b);
-        auto [alias_table, _] = create_alias_table(bw);
-        auto bootstrap_sampling_table = pipeline().device().create_buffer<AliasEntry>(alias_table.size());
-        command_buffer << bootstrap_sampling_table.copy_from(alias_table.data())
-                       << commit();
-        return std::make_pair(std::move(bootstrap_sampling_table), b);
+        auto bootstrap_sampling_table = pipeline().device().create_buffer<AliasEntry>(bootstrap_count);
+        pipeline().alias_table_builder().build(
+            command_buffer, bootstrap_weights.view(), bootstrap_sampling_table.view(),
+            bootstrap_weights.view(), bootstrap_count, bootstrap_sum.view());
+        command_buffer << commit();
+        return {std::move(bootstrap_weights), std::move(bootstrap_sampling_table), std::move(bootstrap_sum)};
     }
 
     void _render(CommandBuffer &command_buffer, Camera::Instance *camera,
                  luisa::span<const Camera::ShutterSample> shutter_samples,
-                 Buffer<AliasEntry> bootstrap_sampling_table, double b) noexcept {
+                 Bootstrap bootstrap) noexcept {
         auto pss_dim = _compute_pss_dimension(camera->node());
         auto sigma = node<PSSMLT>()->sigma();
         auto p_large = node<PSSMLT>()->large_step_probability();
@@ -530,8 +542,8 @@ private:
         auto create_chains = pipeline().device().compile<1u>([&](Float time, Float shutter_weight) noexcept {
             auto chain_id = dispatch_x();
             auto u_bootstrap = uniform_uint_to_float(xxhash32(make_uint2(chain_id, 0x19980810u)));
-            auto [bootstrap_id, _] = sample_alias_table(bootstrap_sampling_table,
-                                                        static_cast<uint>(bootstrap_sampling_table.size()),
+            auto [bootstrap_id, _] = sample_alias_table(bootstrap.sampling_table,
+                                                        static_cast<uint>(bootstrap.sampling_table.size()),
                                                         u_bootstrap);
             _sampler->create(chain_id, bootstrap_id);
             auto seed = xxhash32(make_uint2(bootstrap_id, 0xdeadbeefu));
@@ -546,8 +558,11 @@ private:
 
         clk.tic();
         LUISA_INFO("PSSMLT: compiling render kernel...");
-        auto propose = pipeline().device().compile<1u>([&](Float time, Float shutter_weight, Float b) noexcept {
+        auto bootstrap_count = static_cast<float>(bootstrap.sampling_table.size());
+        auto propose = pipeline().device().compile<1u>([&](Float time, Float shutter_weight) noexcept {
             auto chain_id = dispatch_id().x;
+            // normalization factor, i.e. the average bootstrap contribution
+            auto b = bootstrap.weight_sum->read(0u) / bootstrap_count;
             auto u_wavelength = def(0.f);
             auto seed = rng_state_buffer->read(chain_id);
             _sampler->load(chain_id);
@@ -562,11 +577,12 @@ private:
             auto y_old = L_and_y_old.w;
 
             auto accum = [&accumulate_buffer, resolution](Expr<uint2> p, Expr<float3> L) noexcept {
-                auto offset = (p.y * resolution.x + p.x) * 3u;
+                auto pixel_index = p.y * resolution.x + p.x;
                 $if(!any(isnan(L))) {
-                    for (auto i = 0u; i < 3u; i++) {
-                        accumulate_buffer->atomic(offset + i).fetch_add(L[i]);
-                    }
+                    warp_aggregated_splat(pixel_index, std::array<Float, 3u>{L.x, L.y, L.z},
+                                          [&](uint i, Expr<float> value) noexcept {
+                                              accumulate_buffer->atomic(pixel_index * 3u + i).fetch_add(value);
+                                          });
                 };
             };
 
@@ -616,17 +632,20 @@ private:
             auto L = make_float3(accumulate_buffer->read(offset + 0u),
                                  accumulate_buffer->read(offset + 1u),
                                  accumulate_buffer->read(offset + 2u));
-            camera->film()->accumulate(p, L, effective_spp);
+            camera->film()->accumulate_exclusive(p, L, effective_spp);
         });
         LUISA_INFO("PSSMLT: compiled blit kernel in {} ms.", clk.toc());
 
         clk.tic();
+        auto b = 0.f;
         command_buffer << create_chains(shutter_samples.front().point.time,
                                         shutter_samples.front().point.weight)
                               .dispatch(chains)
                        << clear().dispatch(pixel_count)
+                       << bootstrap.weight_sum.copy_to(&b)
                        << synchronize();
-        LUISA_INFO("PSSMLT: created {} chain(s) in {} ms.", chains, clk.toc());
+        LUISA_INFO("PSSMLT: bootstrapped and created {} chain(s) in {} ms.", chains, clk.toc());
+        LUISA_INFO("PSSMLT: normalization factor is {}.", b / bootstrap_count);
 
         clk.tic();
         LUISA_INFO("Rendering started.");
@@ -642,7 +661,7 @@ private:
             auto mutations_per_chain = (mutations + chains - 1u) / chains;
             for (auto i = static_cast<uint64_t>(0u); i < mutations_per_chain; i++) {
                 auto chains_to_dispatch = std::min((i + 1u) * chains, mutations) - i * chains;
-                command_buffer << propose(s.point.time, s.point.weight, static_cast<float>(b))
+                command_buffer << propose(s.point.time, s.point.weight)
                                       .dispatch(chains_to_dispatch);
                 mutation_count += chains_to_dispatch;
                 auto dispatches_per_commit = 16u;
@@ -706,6 +725,8 @@ private:
     }
 
 protected:
+    // Markov chains splat anywhere on the film
+    [[nodiscard]] bool _supports_tiles() const noexcept override { return false; }
     void _render_one_camera(CommandBuffer &command_buffer, Camera::Instance *camera) noexcept override {
         if (!pipeline().has_lighting()) [[unlikely]] {
             LUISA_WARNING_WITH_LOCATION(
@@ -721,10 +742,10 @@ protected:
         // bootstrap
         auto initial_time = shutter_samples.front().point.time;
         auto updated = pipeline().update(command_buffer, initial_time);
-        auto [bs, b] = _bootstrap(command_buffer, camera, initial_time);
+        auto bootstrap = _bootstrap(command_buffer, camera, initial_time);
 
         // perform actual rendering
-        _render(command_buffer, camera, shutter_samples, std::move(bs), b);
+        _render(command_buffer, camera, shutter_samples, std::move(bootstrap));
     }
 };
 
@@ -2,6 +2,8 @@
 // Created by Mike Smith on 2022/1/10.
 //
 
+#include <limits>
+
 #include <util/sampling.h>
 #include <util/medium_tracker.h>
 #include <util/progress_bar.h>
@@ -214,11 +216,19 @@ public:
 
 class WavefrontPathTracingInstance final : public ProgressiveIntegrator::Instance {
 
+private:
+    // compiles the kernels once with path states for tiles up to max_tile_size and renders the
+    // tiles in order; the film windows are only prepared when a callback is given
+    void _render(CommandBuffer &command_buffer, Camera::Instance *camera, uint2 max_tile_size,
+                 luisa::span<const uint4> tiles, const TileCallback *on_tile_rendered) noexcept;
+
 public:
     using ProgressiveIntegrator::Instance::Instance;
 
 protected:
     void _render_one_camera(CommandBuffer &command_buffer, Camera::Instance *camera) noexcept override;
+    void _render_tiles(CommandBuffer &command_buffer, Camera::Instance *camera,
+                       uint2 tile_size, const TileCallback &on_tile_rendered) noexcept override;
 };
 
 luisa::unique_ptr<Integrator::Instance> WavefrontPathTracing::build(Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept {
@@ -227,6 +237,23 @@ luisa::unique_ptr<Integrator::Instance> WavefrontPathTracing::build(Pipeline &pi
 
 void WavefrontPathTracingInstance::_render_one_camera(
     CommandBuffer &command_buffer, Camera::Instance *camera) noexcept {
+    auto film = camera->film();
+    auto tile = make_uint4(film->window_offset(), film->window_size());
+    _render(command_buffer, camera, film->window_size(), luisa::span{&tile, 1u}, nullptr);
+}
+
+void WavefrontPathTracingInstance::_render_tiles(
+    CommandBuffer &command_buffer, Camera::Instance *camera,
+    uint2 tile_size, const TileCallback &on_tile_rendered) noexcept {
+    auto resolution = camera->film()->node()->resolution();
+    tile_size = min(tile_size, resolution);
+    auto tiles = _split_into_tiles(resolution, tile_size);
+    _render(command_buffer, camera, tile_size, tiles, &on_tile_rendered);
+}
+
+void WavefrontPathTracingInstance::_render(
+    CommandBuffer &command_buffer, Camera::Instance *camera, uint2 max_tile_size,
+    luisa::span<const uint4> tiles, const TileCallback *on_tile_rendered) noexcept {
 
     auto &&device = camera->pipeline().device();
     if (!pipeline().has_lighting()) [[unlikely]] {
@@ -238,15 +265,22 @@ void WavefrontPathTracingInstance::_render_one_camera(
     // determine configurations
     auto spp = camera->node()->spp();
     auto resolution = camera->film()->node()->resolution();
-    auto pixel_count = resolution.x * resolution.y;
+    auto pixel_count = max_tile_size.x * max_tile_size.y;
     auto max_samples_per_pass = ((1ull << 30u) + pixel_count - 1u) / pixel_count;
     auto samples_per_pass = std::min(node<WavefrontPathTracing>()->samples_per_pass(),
                                      static_cast<uint32_t>(max_samples_per_pass));
     auto state_count = static_cast<uint64_t>(samples_per_pass) *
                        static_cast<uint64_t>(pixel_count);
     LUISA_INFO("Wavefront path tracing configurations: "
-               "resolution = {}x{}, spp = {}, state_count = {}, samples_per_pass = {}.",
-               resolution.x, resolution.y, spp, state_count, samples_per_pass);
+               "resolution = {}x{}, tile_size = {}x{}, tile_count = {}, "
+               "spp = {}, state_count = {}, samples_per_pass = {}.",
+               resolution.x, resolution.y, max_tile_size.x, max_tile_size.y,
+               tiles.size(), spp, state_count, samples_per_pass);
+
+    // the first tile is the largest, so the film storage captured below is never reallocated
+    if (on_tile_rendered != nullptr) {
+        camera->film()->prepare_window(command_buffer, tiles.front().xy(), tiles.front().zw());
+    }
 
     auto spectrum = pipeline().spectrum();
     PathStateSOA path_states{spectrum, state_count};
@@ -259,12 +293,13 @@ void WavefrontPathTracingInstance::_render_one_camera(
 
     LUISA_INFO("Compiling ray generation kernel.");
     Clock clock_compile;
-    auto generate_rays_shader = compile_async<1>(device, [&](BufferUInt path_indices, BufferRay rays,
-                                                             UInt base_sample_id, Float time) noexcept {
+    auto generate_rays_shader = compile_async<1>(device, [&](BufferUInt path_indices, BufferRay rays, UInt base_sample_id,
+                                                             Float time, UInt2 tile_offset, UInt2 tile_size) noexcept {
         auto state_id = dispatch_x();
-        auto pixel_id = state_id % pixel_count;
-        auto sample_id = base_sample_id + state_id / pixel_count;
-        auto pixel_coord = make_uint2(pixel_id % resolution.x, pixel_id / resolution.x);
+        auto tile_pixel_count = tile_size.x * tile_size.y;
+        auto pixel_id = state_id % tile_pixel_count;
+        auto sample_id = base_sample_id + state_id / tile_pixel_count;
+        auto pixel_coord = tile_offset + make_uint2(pixel_id % tile_size.x, pixel_id / tile_size.x);
         sampler()->start(pixel_coord, sample_id);
         auto u_filter = sampler()->generate_pixel_2d();
         // TODO: No need for u_lens
@@ -280,9 +315,16 @@ void WavefrontPathTracingInstance::_render_one_camera(
         path_indices.write(state_id, state_id);
     });
 
+    // surface hits are bucketed by surface tag with a counting sort; each bucket is
+    // covered by whole blocks of the evaluation kernel, so every block shades one surface type
+    auto surface_tag_count = static_cast<uint>(pipeline().surfaces().size());
+    auto surface_bucket_count = std::max(surface_tag_count, 1u);
+    auto invalid_surface_tag = ~0u;
+    constexpr auto surface_block_size = 64u;
+
     LUISA_INFO("Compiling intersection kernel.");
     auto intersect_shader = compile_async<1>(device, [&](BufferUInt ray_count, BufferRay rays, BufferHit hits,
-                                                         BufferUInt surface_queue, BufferUInt surface_queue_size,
+                                                         BufferUInt ray_surface_tags, BufferUInt surface_tag_counts,
                                                          BufferUInt light_queue, BufferUInt light_queue_size,
                                                          BufferUInt escape_queue, BufferUInt escape_queue_size) noexcept {
         auto ray_id = dispatch_x();
@@ -290,11 +332,12 @@ void WavefrontPathTracingInstance::_render_one_camera(
             auto ray = rays.read(ray_id);
             auto hit = pipeline().geometry()->trace_closest(ray);
             hits.write(ray_id, hit);
+            auto surface_tag = def(invalid_surface_tag);
             $if(!hit->miss()) {
                 auto shape = pipeline().geometry()->instance(hit.inst);
                 $if(shape.has_surface()) {
-                    auto queue_id = surface_queue_size.atomic(0u).fetch_add(1u);
-                    surface_queue.write(queue_id, ray_id);
+                    surface_tag = shape.surface_tag();
+                    surface_tag_counts.atomic(surface_tag).fetch_add(1u);
                 };
                 $if(shape.has_light()) {
                     auto queue_id = light_queue_size.atomic(0u).fetch_add(1u);
@@ -307,6 +350,79 @@ void WavefrontPathTracingInstance::_render_one_camera(
                     escape_queue.write(queue_id, ray_id);
                 }
             };
+            ray_surface_tags.write(ray_id, surface_tag);
+        };
+    });
+
+    LUISA_INFO("Compiling surface sorting kernels.");
+    auto clear_surface_tag_counts_shader = compile_async<1>(device, [](BufferUInt surface_tag_counts) noexcept {
+        surface_tag_counts.write(dispatch_x(), 0u);
+    });
+    // a single block scans the tags: each thread sums a run of tags, the run sums
+    // are scanned in shared memory, and each thread then writes back its own run
+    constexpr auto scan_block_size = 256u;
+    auto tags_per_thread = std::max((surface_tag_count + scan_block_size - 1u) / scan_block_size, 1u);
+    auto scan_surface_tags_shader = compile_async<1>(device, [&](BufferUInt surface_tag_counts, BufferUInt surface_tag_offsets,
+                                                                 BufferUInt surface_tag_cursors, BufferUInt surface_block_offsets,
+                                                                 BufferUInt surface_queue_size, BufferUInt surface_tag_totals) noexcept {
+        set_block_size(scan_block_size, 1u, 1u);
+        auto tid = thread_x();
+        auto begin = tid * tags_per_thread;
+        auto end = min(begin + tags_per_thread, surface_tag_count);
+        auto count_sum = def(0u);
+        auto block_sum = def(0u);
+        $for(tag, begin, end) {
+            auto count = surface_tag_counts.read(tag);
+            count_sum += count;
+            block_sum += (count + surface_block_size - 1u) / surface_block_size;
+        };
+        Shared<uint> counts{scan_block_size};
+        Shared<uint> blocks{scan_block_size};
+        counts.write(tid, count_sum);
+        blocks.write(tid, block_sum);
+        sync_block();
+        for (auto stride = 1u; stride < scan_block_size; stride <<= 1u) {
+            auto count = def(0u);
+            auto block = def(0u);
+            $if(tid >= stride) {
+                count = counts.read(tid - stride);
+                block = blocks.read(tid - stride);
+            };
+            sync_block();
+            counts.write(tid, counts.read(tid) + count);
+            blocks.write(tid, blocks.read(tid) + block);
+            sync_block();
+        }
+        auto offset = def(counts.read(tid) - count_sum);
+        auto block_offset = def(blocks.read(tid) - block_sum);
+        $for(tag, begin, end) {
+            auto count = surface_tag_counts.read(tag);
+            surface_tag_offsets.write(tag, offset);
+            surface_tag_cursors.write(tag, offset);
+            surface_block_offsets.write(tag, block_offset);
+            // 64-bit running totals stored as (low, high) pairs for the final report
+            auto total_low = surface_tag_totals.read(tag * 2u);
+            surface_tag_totals.write(tag * 2u, total_low + count);
+            $if(total_low + count < total_low) {
+                surface_tag_totals.write(tag * 2u + 1u, surface_tag_totals.read(tag * 2u + 1u) + 1u);
+            };
+            offset += count;
+            block_offset += (count + surface_block_size - 1u) / surface_block_size;
+        };
+        $if(tid == scan_block_size - 1u) {
+            surface_queue_size.write(0u, counts.read(tid));
+            surface_block_offsets.write(surface_tag_count, blocks.read(tid));
+        };
+    });
+    auto scatter_surfaces_shader = compile_async<1>(device, [&](BufferUInt ray_count, BufferUInt ray_surface_tags,
+                                                                BufferUInt surface_tag_cursors, BufferUInt surface_queue) noexcept {
+        auto ray_id = dispatch_x();
+        $if(ray_id < ray_count.read(0u)) {
+            auto surface_tag = ray_surface_tags.read(ray_id);
+            $if(surface_tag != invalid_surface_tag) {
+                auto queue_id = surface_tag_cursors.atomic(surface_tag).fetch_add(1u);
+                surface_queue.write(queue_id, ray_id);
+            };
         };
     });
 
@@ -380,122 +496,169 @@ void WavefrontPathTracingInstance::_render_one_camera(
     });
 
     LUISA_INFO("Compiling surface evaluation kernel.");
-    auto evaluate_surface_shader = compile_async<1>(device, [&](BufferUInt path_indices, UInt trace_depth, BufferUInt queue, BufferUInt queue_size,
+    auto evaluate_surface_shader = compile_async<1>(device, [&](BufferUInt path_indices, UInt trace_depth, BufferUInt queue,
+                                                                BufferUInt surface_tag_counts, BufferUInt surface_tag_offsets,
+                                                                BufferUInt surface_block_offsets,
                                                                 BufferRay in_rays, BufferHit in_hits, BufferRay out_rays,
                                                                 BufferUInt out_queue, BufferUInt out_queue_size, Float time) noexcept {
-        auto queue_id = dispatch_x();
-        $if(queue_id < queue_size.read(0u)) {
-            auto ray_id = queue.read(queue_id);
-            auto path_id = path_indices.read(ray_id);
-            sampler()->load_state(path_id);
-            auto u_lobe = sampler()->generate_1d();
-            auto u_bsdf = sampler()->generate_2d();
-            auto u_rr = def(0.f);
-
-            auto rr_depth = node<WavefrontPathTracing>()->rr_depth();
-            $if(trace_depth + 1u >= rr_depth) { u_rr = sampler()->generate_1d(); };
-            sampler()->save_state(path_id);
-            auto ray = in_rays.read(ray_id);
-            auto hit = in_hits.read(ray_id);
-            auto it = pipeline().geometry()->interaction(ray, hit);
-            auto u_wl_and_swl = path_states.read_swl(path_id);
-            auto &&u_wl = u_wl_and_swl.first;
-            auto &&swl = u_wl_and_swl.second;
-            auto beta = path_states.read_beta(path_id);
-            auto surface_tag = it->shape().surface_tag();
-            auto eta_scale = def(1.f);
-            auto wo = -ray->direction();
-
-            PolymorphicCall<Surface::Closure> call;
-            pipeline().surfaces().dispatch(surface_tag, [&](auto surface) noexcept {
-                surface->closure(call, *it, swl, wo, 1.f, time);
-            });
-
-            call.execute([&](const Surface::Closure *closure) noexcept {
-                // apply opacity map
-                auto alpha_skip = def(false);
-                if (auto o = closure->opacity()) {
-                    auto opacity = saturate(*o);
-                    alpha_skip = u_lobe >= opacity;
-                    u_lobe = ite(alpha_skip, (u_lobe - opacity) / (1.f - opacity), u_lobe / opacity);
-                }
-
-                $if(alpha_skip) {
-                    ray = it->spawn_ray(ray->direction());
-                    path_states.write_pdf_bsdf(path_id, 1e16f);
+        // nothing to record without surfaces, and the shader is never dispatched then
+        if (surface_tag_count == 0u) { return; }
+        set_block_size(surface_block_size, 1u, 1u);
+        auto block_id = dispatch_x() / surface_block_size;
+        $if(block_id < surface_block_offsets.read(surface_tag_count)) {
+            // the tag owning this block is the last one whose blocks start at or before it
+            auto surface_tag = def(0u);
+            auto upper = def(surface_tag_count);
+            $while(surface_tag + 1u < upper) {
+                auto mid = (surface_tag + upper) / 2u;
+                $if(surface_block_offsets.read(mid) <= block_id) {
+                    surface_tag = mid;
                 }
                 $else {
-                    if (auto dispersive = closure->is_dispersive()) {
-                        $if(*dispersive) {
-                            swl.terminate_secondary();
-                            path_states.terminate_secondary_wavelengths(path_id, u_wl);
-                        };
+                    upper = mid;
+                };
+            };
+            auto bucket_id = dispatch_x() - surface_block_offsets.read(surface_tag) * surface_block_size;
+            $if(bucket_id < surface_tag_counts.read(surface_tag)) {
+                auto queue_id = surface_tag_offsets.read(surface_tag) + bucket_id;
+                auto ray_id = queue.read(queue_id);
+                auto path_id = path_indices.read(ray_id);
+                sampler()->load_state(path_id);
+                auto u_lobe = sampler()->generate_1d();
+                auto u_bsdf = sampler()->generate_2d();
+                auto u_rr = def(0.f);
+
+                auto rr_depth = node<WavefrontPathTracing>()->rr_depth();
+                $if(trace_depth + 1u >= rr_depth) { u_rr = sampler()->generate_1d(); };
+                sampler()->save_state(path_id);
+                auto ray = in_rays.read(ray_id);
+                auto hit = in_hits.read(ray_id);
+                auto it = pipeline().geometry()->interaction(ray, hit);
+                auto u_wl_and_swl = path_states.read_swl(path_id);
+                auto &&u_wl = u_wl_and_swl.first;
+                auto &&swl = u_wl_and_swl.second;
+                auto beta = path_states.read_beta(path_id);
+                auto eta_scale = def(1.f);
+                auto wo = -ray->direction();
+
+                PolymorphicCall<Surface::Closure> call;
+                // uniform within a block, so the dispatch does not diverge
+                pipeline().surfaces().dispatch(surface_tag, [&](auto surface) noexcept {
+                    surface->closure(call, *it, swl, wo, 1.f, time);
+                });
+
+                call.execute([&](const Surface::Closure *closure) noexcept {
+                    // apply opacity map
+                    auto alpha_skip = def(false);
+                    if (auto o = closure->opacity()) {
+                        auto opacity = saturate(*o);
+                        alpha_skip = u_lobe >= opacity;
+                        u_lobe = ite(alpha_skip, (u_lobe - opacity) / (1.f - opacity), u_lobe / opacity);
+                    }
+
+                    $if(alpha_skip) {
+                        ray = it->spawn_ray(ray->direction());
+                        path_states.write_pdf_bsdf(path_id, 1e16f);
                     }
-                    // direct lighting
-                    auto light_wi_and_pdf = light_samples.read_wi_and_pdf(queue_id);
-                    auto pdf_light = light_wi_and_pdf.w;
-                    $if(light_wi_and_pdf.w > 0.f) {
-                        auto eval = closure->evaluate(wo, light_wi_and_pdf.xyz());
-                        auto mis_weight = balance_heuristic(pdf_light, eval.pdf);
-                        // update Li
-                        auto Ld = light_samples.read_emission(queue_id);
-                        auto Li = path_states.read_radiance(path_id);
-                        Li += mis_weight / pdf_light * beta * eval.f * Ld;
-                        path_states.write_radiance(path_id, Li);
+                    $else {
+                        if (auto dispersive = closure->is_dispersive()) {
+                            $if(*dispersive) {
+                                swl.terminate_secondary();
+                                path_states.terminate_secondary_wavelengths(path_id, u_wl);
+                            };
+                        }
+                        // direct lighting
+                        auto light_wi_and_pdf = light_samples.read_wi_and_pdf(queue_id);
+                        auto pdf_light = light_wi_and_pdf.w;
+                        $if(light_wi_and_pdf.w > 0.f) {
+                            auto eval = closure->evaluate(wo, light_wi_and_pdf.xyz());
+                            auto mis_weight = balance_heuristic(pdf_light, eval.pdf);
+                            // update Li
+                            auto Ld = light_samples.read_emission(queue_id);
+                            auto Li = path_states.read_radiance(path_id);
+                            Li += mis_weight / pdf_light * beta * eval.f * Ld;
+                            path_states.write_radiance(path_id, Li);
+                        };
+                        // sample material
+                        auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
+                        path_states.write_pdf_bsdf(path_id, surface_sample.eval.pdf);
+                        ray = it->spawn_ray(surface_sample.wi);
+                        auto w = ite(surface_sample.eval.pdf > 0.0f, 1.f / surface_sample.eval.pdf, 0.f);
+                        beta *= w * surface_sample.eval.f;
+                        // eta scale
+                        auto eta = closure->eta().value_or(1.f);
+                        $switch(surface_sample.event) {
+                            $case(Surface::event_enter) { eta_scale = sqr(eta); };
+                            $case(Surface::event_exit) { eta_scale = 1.f / sqr(eta); };
+                        };
                     };
-                    // sample material
-                    auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
-                    path_states.write_pdf_bsdf(path_id, surface_sample.eval.pdf);
-                    ray = it->spawn_ray(surface_sample.wi);
-                    auto w = ite(surface_sample.eval.pdf > 0.0f, 1.f / surface_sample.eval.pdf, 0.f);
-                    beta *= w * surface_sample.eval.f;
-                    // eta scale
-                    auto eta = closure->eta().value_or(1.f);
-                    $switch(surface_sample.event) {
-                        $case(Surface::event_enter) { eta_scale = sqr(eta); };
-                        $case(Surface::event_exit) { eta_scale = 1.f / sqr(eta); };
+                });
+
+                // prepare for next bounce
+                auto terminated = def(false);
+                beta = zero_if_any_nan(beta);
+                $if(beta.all([](auto b) noexcept { return b <= 0.f; })) {
+                    terminated = true;
+                }
+                $else {
+                    // rr
+                    auto rr_threshold = node<WavefrontPathTracing>()->rr_threshold();
+                    auto q = max(beta.max() * eta_scale, 0.05f);
+                    $if(trace_depth + 1u >= rr_depth) {
+                        terminated = q < rr_threshold & u_rr >= q;
+                        beta *= ite(q < rr_threshold, 1.f / q, 1.f);
                     };
                 };
-            });
-
-            // prepare for next bounce
-            auto terminated = def(false);
-            beta = zero_if_any_nan(beta);
-            $if(beta.all([](auto b) noexcept { return b <= 0.f; })) {
-                terminated = true;
-            }
-            $else {
-                // rr
-                auto rr_threshold = node<WavefrontPathTracing>()->rr_threshold();
-                auto q = max(beta.max() * eta_scale, 0.05f);
-                $if(trace_depth + 1u >= rr_depth) {
-                    terminated = q < rr_threshold & u_rr >= q;
-                    beta *= ite(q < rr_threshold, 1.f / q, 1.f);
+                $if(!terminated) {
+                    auto out_queue_id = out_queue_size.atomic(0u).fetch_add(1u);
+                    out_queue.write(out_queue_id, path_id);
+                    out_rays.write(out_queue_id, ray);
+                    path_states.write_beta(path_id, beta);
                 };
             };
-            $if(!terminated) {
-                auto out_queue_id = out_queue_size.atomic(0u).fetch_add(1u);
-                out_queue.write(out_queue_id, path_id);
-                out_rays.write(out_queue_id, ray);
-                path_states.write_beta(path_id, beta);
-            };
         };
     });
 
     LUISA_INFO("Compiling accumulation kernel.");
-    auto accumulate_shader = compile_async<1>(device, [&](Float shutter_weight) noexcept {
-        auto state_id = dispatch_x();
-        auto pixel_id = state_id % pixel_count;
-        auto pixel_coord = make_uint2(pixel_id % resolution.x, pixel_id / resolution.x);
-        auto [u_wl, swl] = path_states.read_swl(state_id);
-        auto Li = path_states.read_radiance(state_id);
-        camera->film()->accumulate(pixel_coord, spectrum->srgb(swl, Li * shutter_weight));
+    // one thread per pixel gathers all samples of the pass, so the film needs no atomics
+    auto accumulate_shader = compile_async<1>(device, [&](Float shutter_weight, UInt2 tile_offset,
+                                                          UInt2 tile_size, UInt launch_spp) noexcept {
+        auto pixel_id = dispatch_x();
+        auto tile_pixel_count = tile_size.x * tile_size.y;
+        auto pixel_coord = tile_offset + make_uint2(pixel_id % tile_size.x, pixel_id / tile_size.x);
+        // summed in registers, with the film's per-sample clamping, so the film is written once
+        auto threshold = camera->film()->node()->clamp();
+        auto sum = def(make_float3(0.f));
+        auto count = def(0.f);
+        auto invalid = def(false);
+        $for(sample, launch_spp) {
+            auto state_id = sample * tile_pixel_count + pixel_id;
+            auto [u_wl, swl] = path_states.read_swl(state_id);
+            auto Li = path_states.read_radiance(state_id);
+            auto c = spectrum->srgb(swl, Li * shutter_weight);
+            $if(any(isnan(c) || isinf(c))) {
+                invalid = true;
+            }
+            $else {
+                auto strength = max(max(max(c.x, c.y), c.z), 0.f);
+                sum += c * (threshold / max(strength, threshold));
+                count += 1.f;
+            };
+        };
+        camera->film()->accumulate_exclusive(pixel_coord, sum, count);
+        // invalid samples are dropped by the film, which may also flag the pixel
+        $if(invalid) {
+            camera->film()->accumulate_exclusive(pixel_coord, make_float3(std::numeric_limits<float>::quiet_NaN()), 0.f);
+        };
     });
 
     // wait for the compilation of all shaders
     generate_rays_shader.wait();
     intersect_shader.wait();
     evaluate_miss_shader.wait();
+    clear_surface_tag_counts_shader.wait();
+    scan_surface_tags_shader.wait();
+    scatter_surfaces_shader.wait();
     evaluate_surface_shader.wait();
     evaluate_light_shader.wait();
     sample_light_shader.wait();
@@ -513,76 +676,119 @@ void WavefrontPathTracingInstance::_render_one_camera(
     auto ray_buffer = device.create_buffer<Ray>(state_count);
     auto ray_buffer_out = device.create_buffer<Ray>(state_count);
     auto hit_buffer = device.create_buffer<Hit>(state_count);
+    auto ray_surface_tag_buffer = device.create_buffer<uint>(state_count);
+    auto surface_tag_counts = device.create_buffer<uint>(surface_bucket_count);
+    auto surface_tag_offsets = device.create_buffer<uint>(surface_bucket_count);
+    auto surface_tag_cursors = device.create_buffer<uint>(surface_bucket_count);
+    auto surface_block_offsets = device.create_buffer<uint>(surface_bucket_count + 1u);
+    auto surface_tag_totals = device.create_buffer<uint>(surface_bucket_count * 2u);
+    command_buffer << clear_surface_tag_counts_shader.get()(surface_tag_totals).dispatch(surface_bucket_count * 2u);
     auto state_count_buffer = device.create_buffer<uint>(samples_per_pass);
     luisa::vector<uint> precomputed_state_counts(samples_per_pass);
-    for (auto i = 0u; i < samples_per_pass; i++) {
-        precomputed_state_counts[i] = (i + 1u) * pixel_count;
-    }
     auto shutter_samples = camera->node()->shutter_samples();
-    command_buffer << state_count_buffer.copy_from(precomputed_state_counts.data())
-                   << synchronize();
 
-    auto sample_id = 0u;
-    auto last_committed_sample_id = 0u;
     Clock clock;
     ProgressBar progress_bar(!use_progress());
     progress_bar.update(0.0);
-    for (auto s : shutter_samples) {
-        auto time = s.point.time;
-        auto updated = pipeline().update(command_buffer, time);
-        for (auto i = 0u; i < s.spp; i += samples_per_pass) {
-            auto launch_spp = std::min(s.spp - i, samples_per_pass);
-            auto launch_state_count = launch_spp * pixel_count;
-            auto path_indices = path_queue.prepare_index_buffer(command_buffer);
-            auto path_count = state_count_buffer.view(launch_spp - 1u, 1u);
-            auto rays = ray_buffer.view();
-            auto hits = hit_buffer.view();
-            auto out_rays = ray_buffer_out.view();
-            command_buffer << generate_rays_shader.get()(path_indices, rays, sample_id, time).dispatch(launch_state_count);
-            for (auto depth = 0u; depth < node<WavefrontPathTracing>()->max_depth(); depth++) {
-                auto surface_indices = surface_queue.prepare_index_buffer(command_buffer);
-                auto surface_count = surface_queue.prepare_counter_buffer(command_buffer);
-                auto light_indices = light_queue.prepare_index_buffer(command_buffer);
-                auto light_count = light_queue.prepare_counter_buffer(command_buffer);
-                auto miss_indices = miss_queue.prepare_index_buffer(command_buffer);
-                auto miss_count = miss_queue.prepare_counter_buffer(command_buffer);
-                auto out_path_indices = out_path_queue.prepare_index_buffer(command_buffer);
-                auto out_path_count = out_path_queue.prepare_counter_buffer(command_buffer);
-                command_buffer << intersect_shader.get()(path_count, rays, hits, surface_indices, surface_count,
-                                                         light_indices, light_count, miss_indices, miss_count)
+    for (auto tile_index = 0u; tile_index < tiles.size(); tile_index++) {
+        auto tile_offset = tiles[tile_index].xy();
+        auto tile_size = tiles[tile_index].zw();
+        auto tile_pixel_count = tile_size.x * tile_size.y;
+        if (on_tile_rendered != nullptr && tile_index != 0u) {
+            camera->film()->prepare_window(command_buffer, tile_offset, tile_size);
+        }
+        for (auto i = 0u; i < samples_per_pass; i++) {
+            precomputed_state_counts[i] = (i + 1u) * tile_pixel_count;
+        }
+        command_buffer << state_count_buffer.copy_from(precomputed_state_counts.data())
+                       << synchronize();
+
+        auto sample_id = 0u;
+        auto last_committed_sample_id = 0u;
+        for (auto s : shutter_samples) {
+            auto time = s.point.time;
+            auto updated = pipeline().update(command_buffer, time);
+            for (auto i = 0u; i < s.spp; i += samples_per_pass) {
+                auto launch_spp = std::min(s.spp - i, samples_per_pass);
+                auto launch_state_count = launch_spp * tile_pixel_count;
+                auto path_indices = path_queue.prepare_index_buffer(command_buffer);
+                auto path_count = state_count_buffer.view(launch_spp - 1u, 1u);
+                auto rays = ray_buffer.view();
+                auto hits = hit_buffer.view();
+                auto out_rays = ray_buffer_out.view();
+                command_buffer << generate_rays_shader.get()(path_indices, rays, sample_id, time, tile_offset, tile_size)
                                       .dispatch(launch_state_count);
-                if (pipeline().environment()) {
-                    command_buffer << evaluate_miss_shader.get()(path_indices, rays, miss_indices, miss_count, time)
+                for (auto depth = 0u; depth < node<WavefrontPathTracing>()->max_depth(); depth++) {
+                    auto surface_indices = surface_queue.prepare_index_buffer(command_buffer);
+                    auto surface_count = surface_queue.prepare_counter_buffer(command_buffer);
+                    auto light_indices = light_queue.prepare_index_buffer(command_buffer);
+                    auto light_count = light_queue.prepare_counter_buffer(command_buffer);
+                    auto miss_indices = miss_queue.prepare_index_buffer(command_buffer);
+                    auto miss_count = miss_queue.prepare_counter_buffer(command_buffer);
+                    auto out_path_indices = out_path_queue.prepare_index_buffer(command_buffer);
+                    auto out_path_count = out_path_queue.prepare_counter_buffer(command_buffer);
+                    command_buffer << clear_surface_tag_counts_shader.get()(surface_tag_counts).dispatch(surface_bucket_count)
+                                   << intersect_shader.get()(path_count, rays, hits, ray_surface_tag_buffer, surface_tag_counts,
+                                                             light_indices, light_count, miss_indices, miss_count)
+                                          .dispatch(launch_state_count)
+                                   << scan_surface_tags_shader.get()(surface_tag_counts, surface_tag_offsets, surface_tag_cursors,
+                                                                     surface_block_offsets, surface_count, surface_tag_totals)
+                                          .dispatch(scan_block_size)
+                                   << scatter_surfaces_shader.get()(path_count, ray_surface_tag_buffer,
+                                                                    surface_tag_cursors, surface_indices)
                                           .dispatch(launch_state_count);
-                }
-                if (!pipeline().lights().empty()) {
-                    command_buffer << evaluate_light_shader.get()(path_indices, rays, hits,
-                                                                  light_indices, light_count, time)
+                    if (pipeline().environment()) {
+                        command_buffer << evaluate_miss_shader.get()(path_indices, rays, miss_indices, miss_count, time)
+                                              .dispatch(launch_state_count);
+                    }
+                    if (!pipeline().lights().empty()) {
+                        command_buffer << evaluate_light_shader.get()(path_indices, rays, hits,
+                                                                      light_indices, light_count, time)
+                                              .dispatch(launch_state_count);
+                    }
+                    command_buffer << sample_light_shader.get()(path_indices, rays, hits, surface_indices, surface_count, time)
                                           .dispatch(launch_state_count);
+                    // each tag rounds its bucket up to whole blocks, adding at most one block per tag
+                    auto surface_dispatch_size = ((launch_state_count + surface_block_size - 1u) / surface_block_size +
+                                                  surface_tag_count) * surface_block_size;
+                    if (surface_tag_count != 0u) {
+                        command_buffer << evaluate_surface_shader.get()(path_indices, depth, surface_indices,
+                                                                        surface_tag_counts, surface_tag_offsets,
+                                                                        surface_block_offsets, rays, hits, out_rays,
+                                                                        out_path_indices, out_path_count, time)
+                                              .dispatch(surface_dispatch_size);
+                    }
+                    path_indices = out_path_indices;
+                    path_count = out_path_count;
+                    std::swap(rays, out_rays);
+                    std::swap(path_queue, out_path_queue);
+                }
+                command_buffer << accumulate_shader.get()(s.point.weight, tile_offset, tile_size, launch_spp)
+                                      .dispatch(tile_pixel_count);
+                sample_id += launch_spp;
+                auto launches_per_commit = 4u;
+                if (sample_id - last_committed_sample_id >= launches_per_commit) {
+                    last_committed_sample_id = sample_id;
+                    auto p = (tile_index + sample_id / static_cast<double>(spp)) /
+                             static_cast<double>(tiles.size());
+                    command_buffer << [p, &progress_bar] { progress_bar.update(p); };
                 }
-                command_buffer << sample_light_shader.get()(path_indices, rays, hits, surface_indices, surface_count, time)
-                                      .dispatch(launch_state_count)
-                               << evaluate_surface_shader.get()(path_indices, depth, surface_indices,
-                                                                surface_count, rays, hits, out_rays,
-                                                                out_path_indices, out_path_count, time)
-                                      .dispatch(launch_state_count);
-                path_indices = out_path_indices;
-                path_count = out_path_count;
-                std::swap(rays, out_rays);
-                std::swap(path_queue, out_path_queue);
-            }
-            command_buffer << accumulate_shader.get()(s.point.weight).dispatch(launch_state_count);
-            sample_id += launch_spp;
-            auto launches_per_commit = 4u;
-            if (sample_id - last_committed_sample_id >= launches_per_commit) {
-                last_committed_sample_id = sample_id;
-                auto p = sample_id / static_cast<double>(spp);
-                command_buffer << [p, &progress_bar] { progress_bar.update(p); };
             }
         }
+        if (on_tile_rendered != nullptr) {
+            (*on_tile_rendered)(tile_offset, tile_size);
+        }
     }
-    command_buffer << synchronize();
+    luisa::vector<uint> surface_tag_totals_host(surface_bucket_count * 2u);
+    command_buffer << surface_tag_totals.copy_to(surface_tag_totals_host.data())
+                   << synchronize();
     progress_bar.done();
+    for (auto tag = 0u; tag < surface_tag_count; tag++) {
+        auto total = (static_cast<uint64_t>(surface_tag_totals_host[tag * 2u + 1u]) << 32u) |
+                     surface_tag_totals_host[tag * 2u];
+        LUISA_INFO("Surface queue {} ({}): {} evaluations.", tag,
+                   pipeline().surfaces().impl(tag)->node()->impl_type(), total);
+    }
 
     auto render_time = clock.toc();
     LUISA_INFO("Rendering finished in {} ms.", render_time);
@@ -326,6 +326,7 @@ public:
     using ProgressiveIntegrator::Instance::Instance;
 
 protected:
+    [[nodiscard]] bool _supports_tiles() const noexcept override { return false; }
     void _render_one_camera(CommandBuffer &command_buffer, Camera::Instance *camera) noexcept override;
 };
 
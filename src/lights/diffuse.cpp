@@ -34,6 +34,9 @@ public:
     [[nodiscard]] auto two_sided() const noexcept { return _two_sided; }
     [[nodiscard]] bool is_null() const noexcept override { return _scale == 0.0f || _emission->is_black(); }
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
+    [[nodiscard]] luisa::string batch_key() const noexcept override {
+        return luisa::format("{}|scale:{}|two_sided:{}", impl_type(), _scale, _two_sided);
+    }
     [[nodiscard]] luisa::unique_ptr<Instance> build(
         Pipeline &pipeline, CommandBuffer &command_buffer) const noexcept override;
 };
@@ -75,7 +78,7 @@ private:
         using namespace luisa::compute;
         auto light = instance<DiffuseLightInstance>();
         auto &&pipeline = light->pipeline();
-        auto pdf_triangle = pipeline.buffer<float>(it_light.shape().pdf_buffer_id()).read(it_light.triangle_id());
+        auto pdf_triangle = pipeline.buffer<float>(pipeline.geometry()->pdf_buffer_id(it_light.instance_id())).read(it_light.triangle_id());
         auto pdf_area = pdf_triangle / it_light.triangle_area();
         auto cos_wo = abs_dot(normalize(p_from - it_light.p()), it_light.ng());
         auto L = light->texture()->evaluate_illuminant_spectrum(it_light, swl(), time()).value *
@@ -92,7 +95,7 @@ private:
         using namespace luisa::compute;
         auto light = instance<DiffuseLightInstance>();
         auto &&pipeline = light->pipeline();
-        auto pdf_triangle = pipeline.buffer<float>(it_light.shape().pdf_buffer_id()).read(it_light.triangle_id());
+        auto pdf_triangle = pipeline.buffer<float>(pipeline.geometry()->pdf_buffer_id(it_light.instance_id())).read(it_light.triangle_id());
         auto pdf_area = pdf_triangle / it_light.triangle_area();
         auto L = light->texture()->evaluate_illuminant_spectrum(it_light, swl(), time()).value *
                  light->node<DiffuseLight>()->scale();
@@ -116,7 +119,7 @@ public:
         auto &&pipeline = light->pipeline();
         auto light_inst = pipeline.geometry()->instance(light_inst_id);
         auto light_to_world = pipeline.geometry()->instance_to_world(light_inst_id);
-        auto alias_table_buffer_id = light_inst.alias_table_buffer_id();
+        auto alias_table_buffer_id = pipeline.geometry()->alias_table_buffer_id(light_inst_id);
         auto [triangle_id, ux] = sample_alias_table(
             pipeline.buffer<AliasEntry>(alias_table_buffer_id),
             light_inst.triangle_count(), u_in.x);
@@ -137,7 +140,7 @@ public:
         auto &&pipeline = light->pipeline();
         auto light_inst = pipeline.geometry()->instance(light_inst_id);
         auto light_to_world = pipeline.geometry()->instance_to_world(light_inst_id);
-        auto alias_table_buffer_id = light_inst.alias_table_buffer_id();
+        auto alias_table_buffer_id = pipeline.geometry()->alias_table_buffer_id(light_inst_id);
         auto [triangle_id, ux] = sample_alias_table(
             pipeline.buffer<AliasEntry>(alias_table_buffer_id),
             light_inst.triangle_count(), u_light.x);
@@ -25,26 +25,59 @@ public:
 class UniformLightSamplerInstance final : public LightSampler::Instance {
 
 private:
+    // the light buffer keeps its bindless slot and the light count is read at
+    // runtime, so that adding light instances does not invalidate compiled shaders
+    BufferView<Light::Handle> _light_buffer;
+    uint _light_buffer_index{0u};// pipeline resource, retired once outgrown
     uint _light_buffer_id{0u};
+    BufferView<float4> _light_count_view;
+    uint _light_count_slot{0u};
+    float4 _light_count{};
     float _env_prob{0.f};
 
+private:
+    [[nodiscard]] Float _light_instance_count() const noexcept {
+        return pipeline().constant(_light_count_slot).x;
+    }
+
 public:
     UniformLightSamplerInstance(const UniformLightSampler *sampler, Pipeline &pipeline, CommandBuffer &command_buffer) noexcept
         : LightSampler::Instance{pipeline, sampler} {
-        if (!pipeline.lights().empty()) {
-            auto [view, _, buffer_id] = pipeline.bindless_buffer<Light::Handle>(pipeline.lights().size());
-            _light_buffer_id = buffer_id;
-            command_buffer << view.copy_from(pipeline.geometry()->light_instances().data())
-                           << compute::commit();
+        std::tie(_light_count_view, _light_count_slot) = pipeline.allocate_constant_slot();
+        static_cast<void>(update(pipeline, command_buffer));
+    }
+
+    [[nodiscard]] bool update(Pipeline &pipeline, CommandBuffer &command_buffer) noexcept override {
+        auto light_instances = pipeline.geometry()->light_instances();
+        if (light_instances.size() > _light_buffer.size()) {
+            auto [buffer, index] = pipeline.create_with_index<Buffer<Light::Handle>>(
+                next_pow2(light_instances.size()));
+            if (_light_buffer.size() != 0u) {
+                pipeline.update_bindless(_light_buffer_id, buffer->view());
+                pipeline.geometry()->retire_resource(_light_buffer_index);
+            } else {
+                _light_buffer_id = pipeline.register_bindless(buffer->view());
+            }
+            _light_buffer = buffer->view();
+            _light_buffer_index = index;
+        }
+        if (!light_instances.empty()) {
+            command_buffer << _light_buffer.subview(0u, light_instances.size())
+                                  .copy_from(light_instances.data());
         }
+        _light_count = make_float4(static_cast<float>(light_instances.size()), 0.f, 0.f, 0.f);
+        command_buffer << _light_count_view.copy_from(&_light_count)
+                       << compute::commit();
+        _env_prob = 0.f;
         if (auto env = pipeline.environment()) {
             if (pipeline.lights().empty()) {
                 _env_prob = 1.f;
             } else {
                 _env_prob = std::clamp(
-                    sampler->environment_weight(), 0.01f, 0.99f);
+                    node<UniformLightSampler>()->environment_weight(), 0.01f, 0.99f);
             }
         }
+        return true;
     }
 
     [[nodiscard]] Light::Evaluation evaluate_hit(
@@ -59,7 +92,7 @@ public:
             auto closure = light->closure(swl, time);
             eval = closure->evaluate(it, p_from);
         });
-        auto n = static_cast<float>(pipeline().lights().size());
+        auto n = _light_instance_count();
         eval.pdf *= (1.f - _env_prob) / n;
         return eval;
     }
@@ -79,7 +112,7 @@ public:
         const Interaction &it_from, Expr<float> u,
         const SampledWavelengths &swl, Expr<float> time) const noexcept override {
         LUISA_ASSERT(pipeline().has_lighting(), "No lights in scene.");
-        auto n = static_cast<float>(pipeline().lights().size());
+        auto n = _light_instance_count();
         if (_env_prob == 1.f) { return {.tag = LightSampler::selection_environment, .prob = 1.f}; }
         if (_env_prob == 0.f) { return {.tag = cast<uint>(clamp(u * n, 0.f, n - 1.f)), .prob = 1.f / n}; }
         auto uu = (u - _env_prob) / (1.f - _env_prob);
@@ -92,7 +125,7 @@ public:
         Expr<float> u,
         const SampledWavelengths &swl, Expr<float> time) const noexcept override {
         LUISA_ASSERT(pipeline().has_lighting(), "No lights in scene.");
-        auto n = static_cast<float>(pipeline().lights().size());
+        auto n = _light_instance_count();
         if (_env_prob == 1.f) { return {.tag = LightSampler::selection_environment, .prob = 1.f}; }
         if (_env_prob == 0.f) { return {.tag = cast<uint>(clamp(u * n, 0.f, n - 1.f)), .prob = 1.f / n}; }
         auto uu = (u - _env_prob) / (1.f - _env_prob);
@@ -110,7 +143,7 @@ private:
         auto handle = pipeline().buffer<Light::Handle>(_light_buffer_id).read(tag);
         auto light_inst = pipeline().geometry()->instance(handle.instance_id);
         auto light_to_world = pipeline().geometry()->instance_to_world(handle.instance_id);
-        auto alias_table_buffer_id = light_inst.alias_table_buffer_id();
+        auto alias_table_buffer_id = pipeline().geometry()->alias_table_buffer_id(handle.instance_id);
         auto [triangle_id, ux] = sample_alias_table(
             pipeline().buffer<AliasEntry>(alias_table_buffer_id),
             light_inst.triangle_count(), u_in.x);
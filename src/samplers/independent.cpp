@@ -53,6 +53,7 @@ void IndependentSamplerInstance::reset(
     if (!_states || state_count > _states.size()) {
         _states = pipeline().device().create_buffer<uint>(
             next_pow2(state_count));
+        _bump_generation();
     }
 }
 
@@ -107,6 +107,7 @@ public:
         if (_state_buffer.size() < state_count) {
             _state_buffer = pipeline().device().create_buffer<uint4>(
                 next_pow2(state_count));
+            _bump_generation();
         }
         _spp = spp;
     }
@@ -125,9 +125,11 @@ public:
         auto pixel_sample_count = _pixel_tile_size * _pixel_tile_size * spp;
         if (!_pixel_samples || _pixel_samples.size() < pixel_sample_count) {
             _pixel_samples = pipeline().device().create_buffer<float2>(next_pow2(pixel_sample_count));
+            _bump_generation();
         }
         if (!_state_buffer || _state_buffer.size() < state_count) {
             _state_buffer = pipeline().device().create_buffer<uint4>(next_pow2(state_count));
+            _bump_generation();
         }
         luisa::vector<float2> pixel_samples(pixel_sample_count, make_float2(0.f));
         luisa::vector<uint> stored_counts(_pixel_tile_size * _pixel_tile_size, 0u);
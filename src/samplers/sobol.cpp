@@ -114,6 +114,7 @@ public:
         if (_state_buffer.size() < state_count) {
             _state_buffer = pipeline().device().create_buffer<uint4>(
                 next_pow2(state_count));
+            _bump_generation();
         }
         _scale = next_pow2(std::max(resolution.x, resolution.y));
         LUISA_ASSERT(_scale <= 0xffffu, "Sobol sampler scale is too large.");
@@ -48,7 +48,9 @@ public:
         _tile_size = luisa::min(resolution, node<TileSharedSampler>()->tile_size());
         _resolution = resolution;
         auto tile_count = (resolution + _tile_size - 1u) / _tile_size;
+        auto base_generation = _base->generation();
         _base->reset(command_buffer, tile_count, state_count, spp);
+        if (_base->generation() != base_generation) { _bump_generation(); }
     }
     void start(Expr<uint2> pixel, Expr<uint> sample_index) noexcept override {
         auto p = def(pixel);
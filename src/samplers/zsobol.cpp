@@ -91,6 +91,7 @@ public:
         if (_state_buffer.size() < state_count) {
             _state_buffer = pipeline().device().create_buffer<uint3>(
                 next_pow2(state_count));
+            _bump_generation();
         }
         static constexpr auto log2 = [](auto x) noexcept {
             return std::bit_width(next_pow2(x)) - 1u;
@@ -11,26 +11,40 @@ class DeformableMesh : public Shape {
 
 private:
     std::shared_future<MeshGeometry> _geometry;
+    bool _refit;
+    bool _topology_updated{true};
+
+private:
+    [[nodiscard]] bool _same_topology(luisa::span<const uint> triangles) const noexcept {
+        auto &&old_triangles = _geometry.get().triangles();
+        return triangles.size() == old_triangles.size() * 3u &&
+               std::memcmp(triangles.data(), old_triangles.data(), triangles.size() * sizeof(uint)) == 0;
+    }
 
 public:
     DeformableMesh(Scene *scene, const SceneNodeDesc *desc) noexcept :
         Shape{scene, desc},
-        _geometry{MeshGeometry::create(
-            desc->property_float_list("positions"),
-            desc->property_uint_list("indices"),
-            desc->property_float_list_or_default("normals"),
-            desc->property_float_list_or_default("uvs")
-        )} { }
+        _refit{desc->property_bool_or_default("refit", false)} {
+        // the geometry only borrows the lists, so keep them alive until it is built
+        auto positions = desc->property_float_list("positions");
+        auto indices = desc->property_uint_list("indices");
+        auto normals = desc->property_float_list_or_default("normals");
+        auto uvs = desc->property_float_list_or_default("uvs");
+        _geometry = MeshGeometry::create(positions, indices, normals, uvs);
+        _geometry.wait();
+    }
 
     DeformableMesh(Scene *scene, const RawShapeInfo &shape_info) noexcept
         : Shape{scene, shape_info} {
         LUISA_ASSERT(shape_info.get_type() == "deformablemesh", "Invalid deformable info.");
         auto mesh_info = shape_info.mesh_info.get();
+        auto mesh_view = mesh_info->view();
+        _refit = mesh_info->refit;
         _geometry = MeshGeometry::create(
-            mesh_info->vertices, 
-            mesh_info->triangles,
-            mesh_info->normals,
-            mesh_info->uvs
+            mesh_view.vertices,
+            mesh_view.triangles,
+            mesh_view.normals,
+            mesh_view.uvs
         );
         _geometry.wait();
     }
@@ -38,31 +52,55 @@ public:
     void update_shape(Scene *scene, const RawShapeInfo &shape_info) noexcept override {
         Shape::update_shape(scene, shape_info);
         LUISA_ASSERT(shape_info.get_type() == "deformablemesh", "Invalid deformable info.");
-        auto mesh_info = shape_info.mesh_info.get();
-        _geometry = MeshGeometry::create(
-            mesh_info->vertices, 
-            mesh_info->triangles,
-            mesh_info->normals,
-            mesh_info->uvs
-        );
+        auto mesh_view = shape_info.mesh_info->view();
+        // an empty index list keeps the previous topology
+        _topology_updated = !mesh_view.triangles.empty() &&
+                            !_same_topology(mesh_view.triangles);
+        if (_topology_updated) {
+            _geometry = MeshGeometry::create(
+                mesh_view.vertices,
+                mesh_view.triangles,
+                mesh_view.normals,
+                mesh_view.uvs
+            );
+        } else {
+            _geometry = MeshGeometry::create(
+                _geometry,
+                mesh_view.vertices,
+                mesh_view.normals,
+                mesh_view.uvs
+            );
+        }
         _geometry.wait();
+        _bump_mesh_version();
     }
 
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] bool is_mesh() const noexcept override { return true; }
-    [[nodiscard]] bool empty() const noexcept override { 
+    [[nodiscard]] bool empty() const noexcept override {
         const MeshGeometry &g = _geometry.get();
         return g.vertices().empty() || g.triangles().empty();
     }
-    [[nodiscard]] MeshView mesh() const noexcept override {     
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _geometry.get().identity(); }
+    [[nodiscard]] MeshView mesh() const noexcept override {
         const MeshGeometry &g = _geometry.get();
         return { g.vertices(), g.triangles() };
     }
-    [[nodiscard]] uint vertex_properties() const noexcept override { 
+    [[nodiscard]] uint vertex_properties() const noexcept override {
         const MeshGeometry &g = _geometry.get();
-        return (g.has_normal() ? Shape::property_flag_has_vertex_normal : 0u) | 
+        return (g.has_normal() ? Shape::property_flag_has_vertex_normal : 0u) |
                (g.has_uv() ? Shape::property_flag_has_vertex_uv : 0u);
     }
+    [[nodiscard]] AccelOption build_option() const noexcept override {
+        // refittable BLASes trade trace performance for cheap vertex-only updates
+        AccelOption option;
+        if (_refit) {
+            option.allow_compaction = false;
+            option.allow_update = true;
+        }
+        return option;
+    }
+    [[nodiscard]] bool topology_updated() const noexcept override { return _topology_updated; }
 };
 
 using DeformableMeshWrapper = VisibilityShapeWrapper<ShadingShapeWrapper<DeformableMesh>>;
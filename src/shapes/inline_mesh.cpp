@@ -3,6 +3,7 @@
 //
 
 #include <base/shape.h>
+#include <util/mesh_base.h>
 
 namespace luisa::render {
 
@@ -12,6 +13,7 @@ private:
     luisa::vector<Vertex> _vertices;
     luisa::vector<Triangle> _triangles;
     uint _properties{};
+    uint64_t _identity{};// 0 if the mesh is deduplicated by content
 
 public:
     InlineMesh(Scene *scene, const SceneNodeDesc *desc) noexcept
@@ -30,6 +32,9 @@ public:
             (!uvs.empty() && uvs.size() / 2u != positions.size() / 3u)) [[unlikely]] {
             LUISA_ERROR_WITH_LOCATION("Invalid vertex or triangle count.");
         }
+        if (!desc->property_bool_or_default("deduplicate", false)) {
+            _identity = ShapeGeometry::make_identity();
+        }
         _properties = (!uvs.empty() ? Shape::property_flag_has_vertex_uv : 0u) |
                       (!normals.empty() ? Shape::property_flag_has_vertex_normal : 0u);
 
@@ -61,6 +66,7 @@ public:
     [[nodiscard]] bool empty() const noexcept override { return _vertices.empty() || _triangles.empty(); }
     [[nodiscard]] MeshView mesh() const noexcept override { return {_vertices, _triangles}; }
     [[nodiscard]] uint vertex_properties() const noexcept override { return _properties; }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _identity; }
 };
 
 using InlineMeshWrapper = VisibilityShapeWrapper<ShadingShapeWrapper<InlineMesh>>;
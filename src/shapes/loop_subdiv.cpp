@@ -7,6 +7,7 @@
 #include <base/scene.h>
 #include <util/thread_pool.h>
 #include <util/loop_subdiv.h>
+#include <util/mesh_base.h>
 
 namespace luisa::render {
 
@@ -18,6 +19,7 @@ class LoopSubdiv : public Shape {
 private:
     const Shape *_mesh;
     std::shared_future<std::pair<luisa::vector<Vertex>, luisa::vector<Triangle>>> _geometry;
+    uint64_t _identity{ShapeGeometry::make_identity()};
 
 public:
     LoopSubdiv(Scene *scene, const SceneNodeDesc *desc) noexcept
@@ -64,6 +66,9 @@ public:
                _mesh->vertex_properties();
     }
     [[nodiscard]] AccelOption build_option() const noexcept override { return _mesh->build_option(); }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override {
+        return _geometry.valid() ? _identity : _mesh->mesh_identity();
+    }
 };
 
 using LoopSubdivWrapper = VisibilityShapeWrapper<ShadingShapeWrapper<LoopSubdiv>>;
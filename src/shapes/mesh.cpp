@@ -54,6 +54,7 @@ public:
         const MeshGeometry &g = _geometry.get();
         return g.vertices().empty() || g.triangles().empty();
     }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _geometry.get().identity(); }
     [[nodiscard]] MeshView mesh() const noexcept override {
         const MeshGeometry &g = _geometry.get();
         return { g.vertices(), g.triangles() }; 
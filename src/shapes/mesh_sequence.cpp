@@ -0,0 +1,131 @@
+#include <util/thread_pool.h>
+#include <util/mesh_base.h>
+#include <base/shape.h>
+
+namespace luisa::render {
+
+// A per-frame mesh sequence (e.g. exported fluid simulations). Frames are loaded on
+// the background thread pool into a bounded ring, so that only the current, the
+// previous (whose upload may still be in flight), and the prefetched frames are resident.
+class MeshSequence : public Shape {
+
+private:
+    struct Frame {
+        uint index{~0u};
+        std::shared_future<MeshGeometry> geometry;
+    };
+
+private:
+    luisa::string _pattern;// file path with a run of '#' replaced by the zero-padded frame number
+    size_t _digits_offset{};
+    size_t _digits_count{};
+    uint _first;
+    uint _count;
+    uint _subdivision;
+    bool _loop;
+    bool _flip_uv;
+    bool _drop_normal;
+    bool _drop_uv;
+    luisa::vector<Frame> _ring;
+    uint _playback_frame{~0u};
+    std::shared_future<MeshGeometry> _geometry;
+    // a jump may reuse the previous frame's slot, so its geometry is held here until the next frame
+    std::shared_future<MeshGeometry> _previous_geometry;
+
+private:
+    [[nodiscard]] uint _sequence_index(uint frame) const noexcept {
+        return _loop ? frame % _count : std::min(frame, _count - 1u);
+    }
+
+    [[nodiscard]] std::filesystem::path _frame_path(uint index) const noexcept {
+        auto number = luisa::format("{:0{}}", _first + index, _digits_count);
+        auto path = _pattern;
+        path.replace(_digits_offset, _digits_count, number);
+        return std::filesystem::path{path};
+    }
+
+    // the ring is addressed by the playback frame, so that a window of
+    // consecutive frames never collides even if the sequence wraps around
+    const std::shared_future<MeshGeometry> &_request(uint playback_frame) noexcept {
+        auto index = _sequence_index(playback_frame);
+        auto &slot = _ring[playback_frame % _ring.size()];
+        if (slot.index != index || !slot.geometry.valid()) {
+            slot.index = index;
+            slot.geometry = background_thread_pool().async(
+                [path = _frame_path(index), subdiv = _subdivision,
+                 flip_uv = _flip_uv, drop_normal = _drop_normal, drop_uv = _drop_uv] {
+                    return MeshGeometry{path, subdiv, flip_uv, drop_normal, drop_uv};
+                });
+        }
+        return slot.geometry;
+    }
+
+    [[nodiscard]] const MeshGeometry &_current() const noexcept { return _geometry.get(); }
+
+public:
+    MeshSequence(Scene *scene, const SceneNodeDesc *desc) noexcept
+        : Shape{scene, desc},
+          _pattern{desc->property_path("pattern").string()},
+          _first{desc->property_uint_or_default("first", 0u)},
+          _count{desc->property_uint("count")},
+          _subdivision{desc->property_uint_or_default("subdivision", 0u)},
+          _loop{desc->property_bool_or_default("loop", false)},
+          _flip_uv{desc->property_bool_or_default("flip_uv", false)},
+          _drop_normal{desc->property_bool_or_default("drop_normal", false)},
+          _drop_uv{desc->property_bool_or_default("drop_uv", false)} {
+        auto file_name_offset = _pattern.size() - std::filesystem::path{_pattern}.filename().string().size();
+        auto last = _pattern.find_last_of('#');
+        if (last == luisa::string::npos || last < file_name_offset || _count == 0u) [[unlikely]] {
+            LUISA_ERROR_WITH_LOCATION(
+                "Invalid mesh sequence '{}' with {} frame(s). "
+                "Mark the frame number in the file name with '#'s, e.g. 'frame_####.obj'.",
+                _pattern, _count);
+        }
+        auto first = _pattern.find_last_not_of('#', last);
+        _digits_offset = first == luisa::string::npos ? 0u : first + 1u;
+        _digits_count = last + 1u - _digits_offset;
+        // prefetched frames, plus the current and the previous one
+        auto prefetch = std::min(desc->property_uint_or_default("prefetch", 2u), _count);
+        _ring.resize(prefetch + 2u);
+        static_cast<void>(set_frame(desc->property_uint_or_default("frame", 0u)));
+    }
+
+    bool set_frame(uint frame) noexcept override {
+        if (frame == _playback_frame) { return false; }
+        auto old_index = _playback_frame == ~0u ? ~0u : _sequence_index(_playback_frame);
+        _playback_frame = frame;
+        _previous_geometry = std::move(_geometry);
+        _geometry = _request(frame);
+        // queue the upcoming frames behind the current one; stop early once clamped at the end
+        for (auto i = 1u; i + 2u <= _ring.size(); i++) {
+            if (_sequence_index(frame + i) == _sequence_index(frame + i - 1u)) { break; }
+            static_cast<void>(_request(frame + i));
+        }
+        if (_sequence_index(frame) == old_index) { return false; }
+        _bump_mesh_version();
+        return true;
+    }
+
+    [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
+    [[nodiscard]] bool is_mesh() const noexcept override { return true; }
+    [[nodiscard]] bool empty() const noexcept override {
+        auto &&g = _current();
+        return g.vertices().empty() || g.triangles().empty();
+    }
+    [[nodiscard]] MeshView mesh() const noexcept override {
+        auto &&g = _current();
+        return {g.vertices(), g.triangles()};
+    }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _current().identity(); }
+    [[nodiscard]] uint vertex_properties() const noexcept override {
+        auto &&g = _current();
+        return (g.has_normal() ? Shape::property_flag_has_vertex_normal : 0u) |
+               (g.has_uv() ? Shape::property_flag_has_vertex_uv : 0u);
+    }
+};
+
+using MeshSequenceWrapper = VisibilityShapeWrapper<ShadingShapeWrapper<MeshSequence>>;
+
+}// namespace luisa::render
+
+LUISA_RENDER_MAKE_SCENE_NODE_PLUGIN(luisa::render::MeshSequenceWrapper)
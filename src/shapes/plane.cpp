@@ -30,6 +30,7 @@ public:
         const PlaneGeometry &g = _geometry.get();
         return g.vertices().empty() || g.triangles().empty();
     }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _geometry.get().identity(); }
     [[nodiscard]] MeshView mesh() const noexcept override {
         const PlaneGeometry &g = _geometry.get();
         return { g.vertices(), g.triangles() };
@@ -27,6 +27,7 @@ public:
         const SphereGeometry &g = _geometry.get();
         return g.vertices().empty() || g.triangles().empty();
     }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override { return _geometry.get().identity(); }
     [[nodiscard]] MeshView mesh() const noexcept override {
         const SphereGeometry &g = _geometry.get();
         return { g.vertices(), g.triangles() };
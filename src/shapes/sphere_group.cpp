@@ -5,6 +5,7 @@
 #include <future>
 
 #include <base/shape.h>
+#include <base/light.h>
 #include <util/mesh_base.h>
 #include <util/loop_subdiv.h>
 
@@ -12,34 +13,88 @@ namespace luisa::render {
 
 class SphereGroup : public Shape {
 
+public:
+    enum struct Mode {
+        MESH,      // every sphere baked into one tessellated mesh
+        PROCEDURAL,// analytic spheres, see Geometry::_intersect_sphere
+        INSTANCED, // one shared sphere mesh, one instance per sphere
+    };
+
 private:
     std::shared_future<SphereGroupGeometry> _geometry;
+    std::shared_future<SphereGeometry> _sphere;
+    luisa::vector<float4> _spheres;
+    luisa::vector<float4x4> _copies;
+    Mode _mode;
 
 private:
-    void _build_mesh(
+    void _build(
         const luisa::vector<float> &centers,
         float radius, uint subdiv
     ) noexcept {
+        LUISA_ASSERT(centers.size() % 3u == 0u, "Invalid sphere centers.");
+        auto sphere_count = centers.size() / 3u;
+        auto center = [&centers](size_t i) noexcept {
+            return make_float3(centers[i * 3u + 0u], centers[i * 3u + 1u], centers[i * 3u + 2u]);
+        };
+        if (_mode == Mode::PROCEDURAL) {
+            // one (center, radius) per sphere; intersected analytically in Geometry
+            _spheres.resize(sphere_count);
+            for (auto i = 0u; i < sphere_count; i++) {
+                _spheres[i] = make_float4(center(i), radius);
+            }
+            return;
+        }
+        if (_mode == Mode::INSTANCED) {
+            // the unit sphere is cached per subdivision level and shared by all copies
+            _sphere = SphereGeometry::create(subdiv);
+            _copies.resize(sphere_count);
+            for (auto i = 0u; i < sphere_count; i++) {
+                _copies[i] = translation(center(i)) * scaling(radius);
+            }
+            _sphere.wait();
+            return;
+        }
         static std::mutex mutex;
         std::scoped_lock lock{mutex};
         _geometry = SphereGroupGeometry::create(centers, radius, subdiv);
         _geometry.wait();
     }
 
+    void _check_mode() noexcept {
+        // lights sample triangles, so emissive groups keep the tessellated mesh
+        if (_mode == Mode::PROCEDURAL && light() != nullptr && !light()->is_null()) {
+            LUISA_WARNING_WITH_LOCATION(
+                "Emissive sphere groups are not supported as procedural "
+                "primitives. Falling back to tessellated spheres.");
+            _mode = Mode::MESH;
+        }
+    }
+
+    [[nodiscard]] const ShapeGeometry &_mesh_geometry() const noexcept {
+        if (_mode == Mode::INSTANCED) { return _sphere.get(); }
+        return _geometry.get();
+    }
+
 public:
     SphereGroup(Scene *scene, const SceneNodeDesc *desc) noexcept :
         Shape{scene, desc},
-        _geometry(SphereGroupGeometry::create(
-            desc->property_float_list("centers"),
-            desc->property_float("radius"),
-            desc->property_uint_or_default("subdivision", 0u)
-        )) { }
+        _mode{desc->property_bool_or_default("instanced", false) ? Mode::INSTANCED :
+              desc->property_bool_or_default("procedural", false) ? Mode::PROCEDURAL :
+                                                                    Mode::MESH} {
+        _check_mode();
+        _build(desc->property_float_list("centers"),
+               desc->property_float("radius"),
+               desc->property_uint_or_default("subdivision", 0u));
+    }
     
     SphereGroup(Scene *scene, const RawShapeInfo &shape_info) noexcept :
-        Shape{scene, shape_info} {
+        Shape{scene, shape_info},
+        _mode{shape_info.spheres_info != nullptr && shape_info.spheres_info->procedural ? Mode::PROCEDURAL : Mode::MESH} {
         LUISA_ASSERT(shape_info.spheres_info != nullptr, "Invalid spheres info.");
+        _check_mode();
         auto spheres_info = shape_info.spheres_info.get();
-        _build_mesh(
+        _build(
             spheres_info->centers, spheres_info->radius, spheres_info->subdivision
         );
     }
@@ -48,22 +103,35 @@ public:
         Shape::update_shape(scene, shape_info);
         LUISA_ASSERT(shape_info.spheres_info != nullptr, "Invalid spheres info.");
         auto spheres_info = shape_info.spheres_info.get();
-        _build_mesh(
+        _build(
             spheres_info->centers, spheres_info->radius, spheres_info->subdivision
         );
+        _bump_mesh_version();
     }
 
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] bool is_mesh() const noexcept override { return true; }
+    [[nodiscard]] bool is_procedural() const noexcept override { return _mode == Mode::PROCEDURAL; }
+    [[nodiscard]] luisa::span<const float4> spheres() const noexcept override { return _spheres; }
+    [[nodiscard]] luisa::span<const float4x4> copies() const noexcept override { return _copies; }
     [[nodiscard]] bool empty() const noexcept override { 
-        const SphereGroupGeometry &g = _geometry.get();
+        if (_mode == Mode::PROCEDURAL) { return _spheres.empty(); }
+        if (_mode == Mode::INSTANCED && _copies.empty()) { return true; }
+        auto &&g = _mesh_geometry();
         return g.vertices().empty() || g.triangles().empty();
     }
     [[nodiscard]] MeshView mesh() const noexcept override {
-        const SphereGroupGeometry &g = _geometry.get();
+        if (_mode == Mode::PROCEDURAL) { return {}; }
+        auto &&g = _mesh_geometry();
         return { g.vertices(), g.triangles() };
     }
+    [[nodiscard]] uint64_t mesh_identity() const noexcept override {
+        if (_mode == Mode::PROCEDURAL) { return 0u; }
+        return _mesh_geometry().identity();
+    }
     [[nodiscard]] uint vertex_properties() const noexcept override { 
+        // procedural spheres have exact normals and uvs
+        if (_mode == Mode::PROCEDURAL) { return 0u; }
         return Shape::property_flag_has_vertex_normal |
                Shape::property_flag_has_vertex_uv;
     }
@@ -32,6 +32,7 @@ public:
 
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] uint properties() const noexcept override { return property_reflective; }
+    [[nodiscard]] luisa::string batch_key() const noexcept override { return luisa::string{impl_type()}; }
 
 protected:
     [[nodiscard]] luisa::unique_ptr<Instance> _build(
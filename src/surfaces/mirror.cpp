@@ -29,6 +29,9 @@ public:
     [[nodiscard]] auto remap_roughness() const noexcept { return _remap_roughness; }
     [[nodiscard]] luisa::string_view impl_type() const noexcept override { return LUISA_RENDER_PLUGIN_NAME; }
     [[nodiscard]] uint properties() const noexcept override { return property_reflective; }
+    [[nodiscard]] luisa::string batch_key() const noexcept override {
+        return luisa::format("{}|remap_roughness:{}", impl_type(), _remap_roughness);
+    }
 
 protected:
     [[nodiscard]] luisa::unique_ptr<Instance> _build(
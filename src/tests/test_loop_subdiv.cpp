@@ -0,0 +1,83 @@
+#include <luisa/core/clock.h>
+#include <luisa/core/logging.h>
+#include <util/thread_pool.h>
+#include <util/mesh_base.h>
+#include <util/loop_subdiv.h>
+
+namespace luisa::render::reference {
+// the previous implementation, see loop_subdiv_reference.cpp
+[[nodiscard]] SubdivMesh loop_subdivide(luisa::span<const Vertex> vertices,
+                                        luisa::span<const Triangle> triangles,
+                                        uint level) noexcept;
+}// namespace luisa::render::reference
+
+using namespace luisa;
+using namespace luisa::compute;
+using namespace luisa::render;
+
+// every edge of a closed mesh is shared by exactly two triangles
+[[nodiscard]] static auto is_closed(const SubdivMesh &m) noexcept {
+    luisa::unordered_map<uint64_t, uint> edges;
+    for (auto [a, b, c] : m.triangles) {
+        for (auto [u, v] : {std::make_pair(a, b), std::make_pair(b, c), std::make_pair(c, a)}) {
+            edges[(static_cast<uint64_t>(std::min(u, v)) << 32u) | std::max(u, v)]++;
+        }
+    }
+    return std::all_of(edges.cbegin(), edges.cend(), [](auto &&e) noexcept { return e.second == 2u; });
+}
+
+[[nodiscard]] static auto nearly_equal(float3 a, float3 b) noexcept {
+    return all(abs(a - b) <= 1e-6f * max(max(abs(a), abs(b)), make_float3(1.f)));
+}
+
+// the rewrite keeps the vertex numbering, ring order and face order of the previous implementation
+static void check_against_reference(const SubdivMesh &m, const ShapeGeometry &base,
+                                    uint level, luisa::string_view name) noexcept {
+    auto r = reference::loop_subdivide(base.vertices(), base.triangles(), level);
+    LUISA_ASSERT(m.vertices.size() == r.vertices.size() &&
+                     m.triangles.size() == r.triangles.size() &&
+                     m.base_triangle_indices.size() == r.base_triangle_indices.size(),
+                 "Subdivided {} at level {} differs in size from the reference.", name, level);
+    for (auto i = 0u; i < m.vertices.size(); i++) {
+        LUISA_ASSERT(nearly_equal(m.vertices[i].position(), r.vertices[i].position()) &&
+                         nearly_equal(m.vertices[i].normal(), r.vertices[i].normal()),
+                     "Vertex {} of {} at level {} differs from the reference.", i, name, level);
+    }
+    for (auto i = 0u; i < m.triangles.size(); i++) {
+        auto a = m.triangles[i];
+        auto b = r.triangles[i];
+        LUISA_ASSERT(a.i0 == b.i0 && a.i1 == b.i1 && a.i2 == b.i2 &&
+                         m.base_triangle_indices[i] == r.base_triangle_indices[i],
+                     "Triangle {} of {} at level {} differs from the reference.", i, name, level);
+    }
+}
+
+int main() {
+    static_cast<void>(global_thread_pool());
+    // the level-0 geometries are the unsubdivided base meshes
+    auto sphere = SphereGeometry::create(0u).get();
+    auto plane = PlaneGeometry::create(0u).get();
+    for (auto level = 0u; level <= 8u; level++) {
+        Clock clk;
+        auto s = loop_subdivide(sphere.vertices(), sphere.triangles(), level);
+        auto sphere_time = clk.toc();
+        clk.tic();
+        auto p = loop_subdivide(plane.vertices(), plane.triangles(), level);
+        auto plane_time = clk.toc();
+        auto face_scale = 1u << (2u * level);
+        LUISA_ASSERT(s.triangles.size() == sphere.triangles().size() * face_scale &&
+                         p.triangles.size() == plane.triangles().size() * face_scale,
+                     "Unexpected triangle count at level {}.", level);
+        // closed icosphere: V - E + F = 2 with E = 3F / 2
+        LUISA_ASSERT(s.vertices.size() * 2u == s.triangles.size() + 4u && is_closed(s),
+                     "Broken sphere topology at level {}.", level);
+        // the reference gets slow beyond this level
+        if (level <= 7u) {
+            check_against_reference(s, sphere, level, "sphere");
+            check_against_reference(p, plane, level, "plane");
+        }
+        LUISA_INFO("Subdivision level {}: sphere with {} triangles in {} ms, "
+                   "plane with {} triangles in {} ms.",
+                   level, s.triangles.size(), sphere_time, p.triangles.size(), plane_time);
+    }
+}
@@ -0,0 +1,288 @@
+#include <luisa/core/logging.h>
+#include <luisa/dsl/sugar.h>
+#include <util/u64.h>
+#include <util/alias_table.h>
+
+namespace luisa::render {
+
+using namespace luisa::compute;
+
+namespace {
+
+// level-wise segmented inclusive scan: each thread scans one chunk in place,
+// the chunk totals are scanned recursively, and then added back to the chunks
+template<typename T, typename Add>
+[[nodiscard]] auto compile_scan(Device &device, Add add) noexcept {
+    constexpr auto chunk_size = AliasTableBuilder::chunk_size;
+    Kernel1D scan_chunks_kernel = [add](BufferVar<T> data, BufferVar<T> totals, UInt segment_size) noexcept {
+        auto chunks = (segment_size + chunk_size - 1u) / chunk_size;
+        auto t = dispatch_x();
+        auto segment = t / chunks;
+        auto chunk = t % chunks;
+        auto begin = segment * segment_size + chunk * chunk_size;
+        auto end = segment * segment_size + min((chunk + 1u) * chunk_size, segment_size);
+        auto sum = def(T{});
+        $for (i, begin, end) {
+            sum = add(sum, data.read(i));
+            data.write(i, sum);
+        };
+        totals.write(t, sum);
+    };
+    Kernel1D add_offsets_kernel = [add](BufferVar<T> data, BufferVar<T> totals, UInt segment_size) noexcept {
+        auto chunks = (segment_size + chunk_size - 1u) / chunk_size;
+        auto i = dispatch_x();
+        auto segment = i / segment_size;
+        auto chunk = (i % segment_size) / chunk_size;
+        $if (chunk != 0u) {
+            data.write(i, add(data.read(i), totals.read(segment * chunks + chunk - 1u)));
+        };
+    };
+    return AliasTableBuilder::ScanShaders<T>{device.compile(scan_chunks_kernel),
+                                             device.compile(add_offsets_kernel)};
+}
+
+// 32.32 fixed point (hi, lo) of a non-negative value below 2^32
+[[nodiscard]] auto to_fixed(Expr<float> x) noexcept {
+    auto v = min(x, 0x1.fffffep31f);
+    auto i = floor(v);
+    return make_uint2(cast<uint>(i), cast<uint>(min((v - i) * 0x1p32f, 0x1.fffffep31f)));
+}
+
+// the deficit (light) or excess (heavy) of a weight, in units of the segment average
+[[nodiscard]] auto fixed_difference(Expr<float> w, Expr<float> mean) noexcept {
+    return to_fixed(ite(w < mean, 1.f - w / mean, ite(mean > 0.f, w / mean - 1.f, 0.f)));
+}
+
+}// namespace
+
+AliasTableBuilder::AliasTableBuilder(Device &device) noexcept : _device{device} {
+
+    Kernel1D load_kernel = [](BufferFloat weights, BufferFloat scan) noexcept {
+        auto i = dispatch_x();
+        scan.write(i, abs(weights.read(i)));
+    };
+
+    Kernel1D gather_sums_kernel = [](BufferFloat scan, BufferFloat sums, UInt segment_size) noexcept {
+        auto segment = dispatch_x();
+        sums.write(segment, scan.read(segment * segment_size + segment_size - 1u));
+    };
+
+    // (lights, heavies) and (deficit, excess) of each element, scanned afterwards
+    Kernel1D classify_kernel = [](BufferFloat weights, BufferFloat sums, BufferUInt2 counts,
+                                  BufferUInt4 keys, UInt segment_size) noexcept {
+        auto i = dispatch_x();
+        auto mean = sums.read(i / segment_size) / cast<float>(segment_size);
+        auto w = abs(weights.read(i));
+        auto d = fixed_difference(w, mean);
+        $if (w < mean) {
+            counts.write(i, make_uint2(1u, 0u));
+            keys.write(i, make_uint4(d, 0u, 0u));
+        }
+        $else {
+            counts.write(i, make_uint2(0u, 1u));
+            keys.write(i, make_uint4(0u, 0u, d));
+        };
+    };
+
+    // compacts the deficit consumed before each light and the excess accumulated up to each heavy
+    Kernel1D scatter_kernel = [](BufferFloat weights, BufferFloat sums, BufferUInt2 counts, BufferUInt4 keys,
+                                 BufferUInt2 light_keys, BufferUInt2 heavy_keys,
+                                 BufferUInt heavy_indices, UInt segment_size) noexcept {
+        auto i = dispatch_x();
+        auto base = i / segment_size * segment_size;
+        auto mean = sums.read(i / segment_size) / cast<float>(segment_size);
+        auto w = abs(weights.read(i));
+        auto c = counts.read(i);
+        auto k = keys.read(i);
+        $if (w < mean) {
+            auto key = U64{k.xy()} - U64{fixed_difference(w, mean)};
+            light_keys.write(base + c.x - 1u, key.bits());
+        }
+        $else {
+            heavy_keys.write(base + c.y - 1u, k.zw());
+            heavy_indices.write(base + c.y - 1u, i - base);
+        };
+    };
+
+    // the sweep fills light i from the first heavy whose accumulated excess exceeds the
+    // deficit consumed before i; heavy j is done when the lights before it have consumed
+    // its excess, and the rest of its bucket is taken from the next heavy
+    Kernel1D finalize_kernel = [](BufferFloat weights, BufferFloat sums, BufferUInt2 counts, BufferUInt4 keys,
+                                  BufferUInt2 light_keys, BufferUInt2 heavy_keys, BufferUInt heavy_indices,
+                                  BufferVar<AliasEntry> table, BufferFloat pdf, UInt segment_size) noexcept {
+        auto i = dispatch_x();
+        auto base = i / segment_size * segment_size;
+        auto total = sums.read(i / segment_size);
+        auto mean = total / cast<float>(segment_size);
+        auto w = abs(weights.read(i));
+        auto segment_counts = counts.read(base + segment_size - 1u);
+        auto light_count = segment_counts.x;
+        auto heavy_count = segment_counts.y;
+        auto total_deficit = keys.read(base + segment_size - 1u).xy();
+        auto c = counts.read(i);
+        auto k = keys.read(i);
+        auto prob = def(1.f);
+        auto alias = def(i - base);
+        $if (w < mean) {
+            auto key = U64{k.xy()} - U64{fixed_difference(w, mean)};
+            auto lo = def(0u);
+            auto hi = def(heavy_count);
+            $while (lo < hi) {
+                auto mid = (lo + hi) / 2u;
+                $if (U64{heavy_keys.read(base + mid)} > key) {
+                    hi = mid;
+                }
+                $else {
+                    lo = mid + 1u;
+                };
+            };
+            $if (lo < heavy_count) {
+                prob = w / mean;
+                alias = heavy_indices.read(base + lo);
+            };
+        }
+        $else {
+            auto b = c.y - 1u;
+            $if (mean > 0.f & b + 1u < heavy_count) {
+                auto key = U64{k.zw()};
+                auto lo = def(0u);
+                auto hi = def(light_count);
+                $while (lo < hi) {
+                    auto mid = (lo + hi) / 2u;
+                    $if (U64{light_keys.read(base + mid)} >= key) {
+                        hi = mid;
+                    }
+                    $else {
+                        lo = mid + 1u;
+                    };
+                };
+                auto consumed = def(total_deficit);
+                $if (lo < light_count) { consumed = light_keys.read(base + lo); };
+                // the unconsumed part of the excess, in units of the average
+                auto rest = U64{consumed};
+                auto over = ite(rest >= key, (rest - key).to_float(), -(key - rest).to_float()) * 0x1p-32f;
+                prob = 1.f - over;
+                alias = heavy_indices.read(base + b + 1u);
+            };
+        };
+        Var<AliasEntry> entry;
+        entry.prob = clamp(prob, 0.f, 1.f);
+        entry.alias = alias;
+        table.write(i, entry);
+        pdf.write(i, ite(total > 0.f, w / total, 1.f / cast<float>(segment_size)));
+    };
+
+    // componentwise 64-bit sums of the (hi, lo) pairs
+    auto add_fixed_pairs = [](Expr<uint4> a, Expr<uint4> b) noexcept {
+        auto lo = a.yw() + b.yw();
+        auto hi = a.xz() + b.xz() + ite(lo < a.yw(), make_uint2(1u), make_uint2(0u));
+        return make_uint4(hi.x, lo.x, hi.y, lo.y);
+    };
+    auto add = [](auto a, auto b) noexcept { return a + b; };
+
+    _load = device.compile(load_kernel);
+    _weight_scan = compile_scan<float>(device, add);
+    _count_scan = compile_scan<uint2>(device, add);
+    _key_scan = compile_scan<uint4>(device, add_fixed_pairs);
+    _gather_sums = device.compile(gather_sums_kernel);
+    _classify = device.compile(classify_kernel);
+    _scatter = device.compile(scatter_kernel);
+    _finalize = device.compile(finalize_kernel);
+}
+
+void AliasTableBuilder::_reserve(CommandBuffer &command_buffer, uint segment_count, uint segment_size) noexcept {
+    auto n = segment_count * segment_size;
+    luisa::vector<uint> total_sizes;
+    for (auto size = segment_size; size > 1u;) {
+        size = (size + chunk_size - 1u) / chunk_size;
+        total_sizes.emplace_back(segment_count * size);
+    }
+    if (total_sizes.empty()) { total_sizes.emplace_back(segment_count); }
+    auto &&s = _scratch;
+    auto fits = s.weights && s.weights.size() >= n &&
+                s.segment_sums.size() >= segment_count &&
+                s.weight_totals.size() >= total_sizes.size();
+    for (auto i = 0u; fits && i < total_sizes.size(); i++) {
+        fits = s.weight_totals[i].size() >= total_sizes[i];
+    }
+    if (fits) { return; }
+    auto capacity = std::max<size_t>(n, s.weights ? s.weights.size() : 0u);
+    auto sum_capacity = std::max<size_t>(segment_count, s.segment_sums ? s.segment_sums.size() : 0u);
+    auto level_count = std::max(s.weight_totals.size(), total_sizes.size());
+    luisa::vector<size_t> level_capacities(level_count, 0u);
+    for (auto i = 0u; i < level_count; i++) {
+        if (i < total_sizes.size()) { level_capacities[i] = total_sizes[i]; }
+        if (i < s.weight_totals.size()) { level_capacities[i] = std::max(level_capacities[i], s.weight_totals[i].size()); }
+    }
+    // earlier builds in flight may still use the old scratch, so it is only dropped once the stream has passed them
+    if (s.weights) { command_buffer << [retired = luisa::make_shared<Scratch>(std::move(_scratch))] {}; }
+    _scratch = {};
+    s.weights = _device.create_buffer<float>(capacity);
+    s.counts = _device.create_buffer<uint2>(capacity);
+    s.keys = _device.create_buffer<uint4>(capacity);
+    s.light_keys = _device.create_buffer<uint2>(capacity);
+    s.heavy_keys = _device.create_buffer<uint2>(capacity);
+    s.heavy_indices = _device.create_buffer<uint>(capacity);
+    s.segment_sums = _device.create_buffer<float>(sum_capacity);
+    for (auto size : level_capacities) {
+        s.weight_totals.emplace_back(_device.create_buffer<float>(size));
+        s.count_totals.emplace_back(_device.create_buffer<uint2>(size));
+        s.key_totals.emplace_back(_device.create_buffer<uint4>(size));
+    }
+}
+
+template<typename T>
+void AliasTableBuilder::_prefix_sum(CommandBuffer &command_buffer, const ScanShaders<T> &shaders,
+                                    luisa::vector<Buffer<T>> &totals, uint level, BufferView<T> data,
+                                    uint segment_count, uint segment_size) noexcept {
+    auto chunks = (segment_size + chunk_size - 1u) / chunk_size;
+    auto level_totals = totals[level].view(0u, segment_count * chunks);
+    command_buffer << shaders.scan_chunks(data, level_totals, segment_size).dispatch(segment_count * chunks);
+    if (chunks > 1u) {
+        _prefix_sum(command_buffer, shaders, totals, level + 1u, level_totals, segment_count, chunks);
+        command_buffer << shaders.add_offsets(data, level_totals, segment_size).dispatch(segment_count * segment_size);
+    }
+}
+
+void AliasTableBuilder::sum(CommandBuffer &command_buffer, BufferView<float> weights,
+                            BufferView<float> sums, uint segment_size) noexcept {
+    if (weights.size() == 0u) { return; }
+    LUISA_ASSERT(segment_size != 0u && weights.size() % segment_size == 0u &&
+                     sums.size() * segment_size == weights.size(),
+                 "Invalid segments for {} weights: size = {}, sums = {}.",
+                 weights.size(), segment_size, sums.size());
+    auto segment_count = static_cast<uint>(weights.size() / segment_size);
+    _reserve(command_buffer, segment_count, segment_size);
+    auto scan = _scratch.weights.view(0u, weights.size());
+    command_buffer << _load(weights, scan).dispatch(weights.size());
+    _prefix_sum(command_buffer, _weight_scan, _scratch.weight_totals, 0u, scan, segment_count, segment_size);
+    command_buffer << _gather_sums(scan, sums, segment_size).dispatch(segment_count);
+}
+
+void AliasTableBuilder::build(CommandBuffer &command_buffer, BufferView<float> weights,
+                              BufferView<AliasEntry> table, BufferView<float> pdf, uint segment_size,
+                              BufferView<float> segment_sums) noexcept {
+    if (weights.size() == 0u) { return; }
+    LUISA_ASSERT(table.size() == weights.size() && pdf.size() == weights.size(),
+                 "Alias table size mismatch: weights = {}, table = {}, pdf = {}.",
+                 weights.size(), table.size(), pdf.size());
+    auto n = static_cast<uint>(weights.size());
+    auto segment_count = n / segment_size;
+    _reserve(command_buffer, segment_count, segment_size);
+    auto sums = segment_sums.size() == 0u ? _scratch.segment_sums.view(0u, segment_count) : segment_sums;
+    sum(command_buffer, weights, sums, segment_size);
+    auto counts = _scratch.counts.view(0u, n);
+    auto keys = _scratch.keys.view(0u, n);
+    command_buffer << _classify(weights, sums, counts, keys, segment_size).dispatch(n);
+    _prefix_sum(command_buffer, _count_scan, _scratch.count_totals, 0u, counts, segment_count, segment_size);
+    _prefix_sum(command_buffer, _key_scan, _scratch.key_totals, 0u, keys, segment_count, segment_size);
+    auto light_keys = _scratch.light_keys.view(0u, n);
+    auto heavy_keys = _scratch.heavy_keys.view(0u, n);
+    auto heavy_indices = _scratch.heavy_indices.view(0u, n);
+    command_buffer << _scatter(weights, sums, counts, keys, light_keys, heavy_keys, heavy_indices, segment_size).dispatch(n)
+                   << _finalize(weights, sums, counts, keys, light_keys, heavy_keys, heavy_indices,
+                                table, pdf, segment_size)
+                          .dispatch(n);
+}
+
+}// namespace luisa::render
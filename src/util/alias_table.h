@@ -0,0 +1,84 @@
+#pragma once
+
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/device.h>
+#include <luisa/runtime/shader.h>
+#include <util/sampling.h>
+#include <util/command_buffer.h>
+
+namespace luisa::render {
+
+using compute::Buffer;
+using compute::BufferView;
+using compute::Device;
+
+// Builds alias tables on the device, so that emitters never round-trip through the host.
+// The sequential sweeping construction is expressed in closed form over prefix sums of the
+// light (below average) deficits and heavy (above average) excesses: every entry is then
+// found with a binary search, see Hübschle-Schneider and Sanders, "Parallel Weighted
+// Random Sampling", 2019. The tables are compatible with sample_alias_table().
+// Counts are scanned as integers and the deficits and excesses as 32.32 fixed point in
+// units of the segment average, so the prefix sums stay exact for any segment size.
+class AliasTableBuilder {
+
+public:
+    static constexpr auto chunk_size = 64u;// elements scanned sequentially by one thread
+
+    // level-wise segmented inclusive scan over T, see _prefix_sum()
+    template<typename T>
+    struct ScanShaders {
+        compute::Shader1D<Buffer<T>, Buffer<T>, uint> scan_chunks;
+        compute::Shader1D<Buffer<T>, Buffer<T>, uint> add_offsets;
+    };
+
+private:
+    // grown on demand; replaced scratch is kept alive until the stream has passed the builds using it
+    struct Scratch {
+        Buffer<float> weights;
+        Buffer<uint2> counts;// (lights, heavies) up to each element
+        Buffer<uint4> keys;  // (deficit, excess) up to each element, as (hi, lo) pairs
+        Buffer<uint2> light_keys;
+        Buffer<uint2> heavy_keys;
+        Buffer<uint> heavy_indices;
+        Buffer<float> segment_sums;
+        luisa::vector<Buffer<float>> weight_totals;// per scan level
+        luisa::vector<Buffer<uint2>> count_totals;
+        luisa::vector<Buffer<uint4>> key_totals;
+    };
+
+private:
+    Device &_device;
+    compute::Shader1D<Buffer<float>, Buffer<float>> _load;
+    ScanShaders<float> _weight_scan;
+    ScanShaders<uint2> _count_scan;
+    ScanShaders<uint4> _key_scan;
+    compute::Shader1D<Buffer<float>, Buffer<float>, uint> _gather_sums;
+    compute::Shader1D<Buffer<float>, Buffer<float>, Buffer<uint2>, Buffer<uint4>, uint> _classify;
+    compute::Shader1D<Buffer<float>, Buffer<float>, Buffer<uint2>, Buffer<uint4>,
+                      Buffer<uint2>, Buffer<uint2>, Buffer<uint>, uint> _scatter;
+    compute::Shader1D<Buffer<float>, Buffer<float>, Buffer<uint2>, Buffer<uint4>,
+                      Buffer<uint2>, Buffer<uint2>, Buffer<uint>,
+                      Buffer<AliasEntry>, Buffer<float>, uint> _finalize;
+    Scratch _scratch;
+
+private:
+    void _reserve(CommandBuffer &command_buffer, uint segment_count, uint segment_size) noexcept;
+    template<typename T>
+    void _prefix_sum(CommandBuffer &command_buffer, const ScanShaders<T> &shaders,
+                     luisa::vector<Buffer<T>> &totals, uint level, BufferView<T> data,
+                     uint segment_count, uint segment_size) noexcept;
+
+public:
+    explicit AliasTableBuilder(Device &device) noexcept;
+    // Builds one table per consecutive segment of `segment_size` weights; both `table` and `pdf`
+    // have the size of `weights`, and `pdf` may alias `weights`. The total weight of each
+    // segment is written to `segment_sums` if it is not empty, e.g. to build a marginal table.
+    void build(CommandBuffer &command_buffer, BufferView<float> weights,
+               BufferView<AliasEntry> table, BufferView<float> pdf, uint segment_size,
+               BufferView<float> segment_sums = {}) noexcept;
+    // Sums each consecutive segment of `segment_size` weights into `sums`.
+    void sum(CommandBuffer &command_buffer, BufferView<float> weights,
+             BufferView<float> sums, uint segment_size) noexcept;
+};
+
+}// namespace luisa::render
@@ -784,4 +784,120 @@ void save_image(std::filesystem::path path, const uint8_t *pixels, uint2 resolut
     }
 }
 
+namespace detail {
+
+template<typename T>
+inline void exr_write(std::ostream &os, T value) noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+inline void exr_write_attribute_header(std::ostream &os, const char *name,
+                                       const char *type, int32_t size) noexcept {
+    os.write(name, static_cast<std::streamsize>(std::strlen(name) + 1u));
+    os.write(type, static_cast<std::streamsize>(std::strlen(type) + 1u));
+    exr_write(os, size);
+}
+
+// OpenEXR requires the channel list sorted by name
+[[nodiscard]] inline luisa::span<const std::pair<const char *, uint>> exr_channels(uint components) noexcept {
+    static constexpr std::array<std::pair<const char *, uint>, 1u> y{{{"Y", 0u}}};
+    static constexpr std::array<std::pair<const char *, uint>, 3u> bgr{{{"B", 2u}, {"G", 1u}, {"R", 0u}}};
+    static constexpr std::array<std::pair<const char *, uint>, 4u> abgr{{{"A", 3u}, {"B", 2u}, {"G", 1u}, {"R", 0u}}};
+    switch (components) {
+        case 1u: return y;
+        case 3u: return bgr;
+        case 4u: return abgr;
+        default: break;
+    }
+    LUISA_ERROR_WITH_LOCATION("Unsupported OpenEXR channel count {}.", components);
+}
+
+}// namespace detail
+
+ScanlineExrWriter::ScanlineExrWriter(std::filesystem::path path, uint2 resolution, uint components) noexcept
+    : _path{std::move(path)}, _resolution{resolution}, _components{components} {
+    LUISA_ASSERT(all(resolution > 0u), "Invalid OpenEXR resolution {}x{}.", resolution.x, resolution.y);
+    auto channels = detail::exr_channels(components);
+    _file.open(_path, std::ios::binary | std::ios::trunc);
+    if (!_file) [[unlikely]] {
+        LUISA_ERROR_WITH_LOCATION("Failed to open '{}' for writing.", _path.string());
+    }
+    auto &os = _file;
+    detail::exr_write(os, 20000630);// magic number
+    detail::exr_write(os, 2);       // version 2, single-part scanline image
+    auto channel_list_size = 1;
+    for (auto [name, _] : channels) { channel_list_size += static_cast<int32_t>(std::strlen(name)) + 1 + 16; }
+    detail::exr_write_attribute_header(os, "channels", "chlist", channel_list_size);
+    for (auto [name, _] : channels) {
+        os.write(name, static_cast<std::streamsize>(std::strlen(name) + 1u));
+        detail::exr_write(os, 2);         // FLOAT
+        detail::exr_write(os, 0u);        // pLinear and reserved
+        detail::exr_write(os, make_int2(1));// x and y sampling
+    }
+    detail::exr_write(os, '\0');
+    detail::exr_write_attribute_header(os, "compression", "compression", 1);
+    detail::exr_write(os, static_cast<uint8_t>(0u));// NO_COMPRESSION
+    auto window = make_int4(0, 0, static_cast<int>(resolution.x) - 1, static_cast<int>(resolution.y) - 1);
+    detail::exr_write_attribute_header(os, "dataWindow", "box2i", 16);
+    detail::exr_write(os, window);
+    detail::exr_write_attribute_header(os, "displayWindow", "box2i", 16);
+    detail::exr_write(os, window);
+    detail::exr_write_attribute_header(os, "lineOrder", "lineOrder", 1);
+    detail::exr_write(os, static_cast<uint8_t>(0u));// INCREASING_Y
+    detail::exr_write_attribute_header(os, "pixelAspectRatio", "float", 4);
+    detail::exr_write(os, 1.f);
+    detail::exr_write_attribute_header(os, "screenWindowCenter", "v2f", 8);
+    detail::exr_write(os, make_float2(0.f));
+    detail::exr_write_attribute_header(os, "screenWindowWidth", "float", 4);
+    detail::exr_write(os, 1.f);
+    detail::exr_write(os, '\0');
+    // uncompressed chunks have a fixed size, so the offset table can be written up front
+    _chunk_table_offset = static_cast<size_t>(os.tellp());
+    auto chunk_size = sizeof(int32_t) * 2u + sizeof(float) * resolution.x * components;
+    auto first_chunk = _chunk_table_offset + sizeof(uint64_t) * resolution.y;
+    for (auto y = 0u; y < resolution.y; y++) {
+        detail::exr_write(os, static_cast<uint64_t>(first_chunk + y * chunk_size));
+    }
+    _scanline.resize(resolution.x * components);
+}
+
+void ScanlineExrWriter::write_rows(uint first_row, uint row_count, const float *pixels) noexcept {
+    LUISA_ASSERT(first_row + row_count <= _resolution.y,
+                 "Rows [{}, {}) are out of the OpenEXR image of height {}.",
+                 first_row, first_row + row_count, _resolution.y);
+    auto channels = detail::exr_channels(_components);
+    auto width = _resolution.x;
+    auto chunk_size = sizeof(int32_t) * 2u + sizeof(float) * width * _components;
+    auto first_chunk = _chunk_table_offset + sizeof(uint64_t) * _resolution.y;
+    _file.seekp(static_cast<std::streamoff>(first_chunk + first_row * chunk_size));
+    for (auto r = 0u; r < row_count; r++) {
+        auto row = pixels + static_cast<size_t>(r) * width * _components;
+        // scanline data are stored channel by channel
+        for (auto c = 0u; c < channels.size(); c++) {
+            auto component = channels[c].second;
+            for (auto x = 0u; x < width; x++) {
+                _scanline[c * width + x] = row[x * _components + component];
+            }
+        }
+        detail::exr_write(_file, static_cast<int32_t>(first_row + r));
+        detail::exr_write(_file, static_cast<int32_t>(_scanline.size() * sizeof(float)));
+        _file.write(reinterpret_cast<const char *>(_scanline.data()),
+                    static_cast<std::streamsize>(_scanline.size() * sizeof(float)));
+    }
+    if (!_file) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION("Failed to write rows to '{}'.", _path.string());
+    }
+    _rows_written += row_count;
+}
+
+ScanlineExrWriter::~ScanlineExrWriter() noexcept {
+    if (_rows_written < _resolution.y) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION(
+            "Only {} of {} rows were written to '{}'.",
+            _rows_written, _resolution.y, _path.string());
+    }
+    _file.close();
+}
+
 }// namespace luisa::render
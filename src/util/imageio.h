@@ -5,6 +5,7 @@
 #pragma once
 
 #include <filesystem>
+#include <fstream>
 
 #include <luisa/core/stl.h>
 #include <util/half.h>
@@ -60,4 +61,29 @@ void save_image(std::filesystem::path path, const float *pixels,
 void save_image(std::filesystem::path path, const uint8_t *pixels,
                 uint2 resolution, uint components = 4) noexcept;
 
+// Streams an uncompressed scanline OpenEXR image to disk in bands of rows,
+// so that the whole image never has to be held in memory. Rows may arrive
+// in any order; pixels are interleaved with `components` floats each.
+class ScanlineExrWriter {
+
+private:
+    std::filesystem::path _path;
+    std::ofstream _file;
+    uint2 _resolution;
+    uint _components;
+    size_t _chunk_table_offset{};
+    uint _rows_written{};
+    luisa::vector<float> _scanline;
+
+public:
+    ScanlineExrWriter(std::filesystem::path path, uint2 resolution, uint components = 4u) noexcept;
+    ~ScanlineExrWriter() noexcept;
+    ScanlineExrWriter(ScanlineExrWriter &&) noexcept = delete;
+    ScanlineExrWriter(const ScanlineExrWriter &) noexcept = delete;
+    ScanlineExrWriter &operator=(ScanlineExrWriter &&) noexcept = delete;
+    ScanlineExrWriter &operator=(const ScanlineExrWriter &) noexcept = delete;
+    [[nodiscard]] auto resolution() const noexcept { return _resolution; }
+    void write_rows(uint first_row, uint row_count, const float *pixels) noexcept;
+};
+
 }// namespace luisa::render
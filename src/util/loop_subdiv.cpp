@@ -2,423 +2,432 @@
 // Created by Mike Smith on 2022/11/8.
 //
 
-#include <luisa/core/pool.h>
+#include <atomic>
+#include <thread>
+
 #include <luisa/core/logging.h>
+#include <util/thread_pool.h>
 #include <util/loop_subdiv.h>
 
 namespace luisa::render {
 
-// The following code is from PBRT-v4.
+// The subdivision and limit rules follow PBRT-v4.
 // License: Apache 2.0
 // pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
 // The pbrt source code is licensed under the Apache License, Version 2.0.
 
-struct SDFace;
-struct SDVertex;
+namespace {
 
-// LoopSubdiv Macros
+constexpr auto invalid_index = ~0u;
 
 [[nodiscard]] constexpr auto loop_subdiv_next(uint e) noexcept { return (e + 1u) % 3u; }
 [[nodiscard]] constexpr auto loop_subdiv_prev(uint e) noexcept { return (e + 2u) % 3u; }
 
-// LoopSubdiv Local Structures
-struct SDVertex {
-    float px{};
-    float py{};
-    float pz{};
-    bool regular{};
-    bool boundary{};
-    SDFace *startFace{};
-    SDVertex *child{};
-
-    // SDVertex Constructor
-    SDVertex() noexcept = default;
-    explicit SDVertex(float3 p) noexcept { set_p(p); }
-    [[nodiscard]] uint valence() noexcept;
-    void set_p(float3 p) noexcept {
-        px = p.x;
-        py = p.y;
-        pz = p.z;
-    }
-    [[nodiscard]] auto p() const noexcept { return make_float3(px, py, pz); }
-    void oneRing(float3 *pp) noexcept;
-};
-
-struct SDFace {
+// half-edge h = 3 * face + k goes from the k-th to the next vertex of the face
+[[nodiscard]] constexpr auto half_edge_next(uint h) noexcept { return h - h % 3u + loop_subdiv_next(h % 3u); }
+[[nodiscard]] constexpr auto half_edge_prev(uint h) noexcept { return h - h % 3u + loop_subdiv_prev(h % 3u); }
 
-    SDVertex *v[3]{};
-    SDFace *f[3]{};
-    SDFace *children[4]{};
-    uint baseTriangle{};
+[[nodiscard]] inline auto beta(uint valence) noexcept {
+    return 3.f / (valence == 3u ? 16.f : 8.f * static_cast<float>(valence));
+}
 
-    // SDFace Constructor
-    SDFace() noexcept = default;
+[[nodiscard]] inline auto loop_gamma(uint valence) noexcept {
+    return 1.f / (static_cast<float>(valence) + 3.f / (8.f * beta(valence)));
+}
 
-    // SDFace Methods
-    [[nodiscard]] auto vnum(SDVertex *vert) const noexcept {
-        for (auto i = 0u; i < 3u; i++) {
-            if (v[i] == vert) { return i; }
-        }
-        LUISA_ERROR_WITH_LOCATION("Basic logic error in SDFace::vnum()");
-    }
-    [[nodiscard]] auto nextFace(SDVertex *vert) noexcept { return f[vnum(vert)]; }
-    [[nodiscard]] auto prevFace(SDVertex *vert) noexcept { return f[loop_subdiv_prev(vnum(vert))]; }
-    [[nodiscard]] auto nextVert(SDVertex *vert) noexcept { return v[loop_subdiv_next(vnum(vert))]; }
-    [[nodiscard]] auto prevVert(SDVertex *vert) noexcept { return v[loop_subdiv_prev(vnum(vert))]; }
-    [[nodiscard]] auto otherVert(SDVertex *v0, SDVertex *v1) noexcept {
-        for (auto i : v) {
-            if (i != v0 && i != v1) { return i; }
-        }
-        LUISA_ERROR_WITH_LOCATION("Basic logic error in SDFace::otherVert()");
+// One allocation for all levels; levels ping-pong between two slots sized for the finest one.
+class SubdivArena {
+
+private:
+    luisa::vector<std::byte> _storage;
+    size_t _offset{0u};
+
+public:
+    explicit SubdivArena(size_t size_bytes) noexcept : _storage(size_bytes) {}
+    template<typename T>
+    [[nodiscard]] auto allocate(size_t n) noexcept {
+        static_assert(std::is_trivially_destructible_v<T>);
+        _offset = (_offset + alignof(T) - 1u) / alignof(T) * alignof(T);
+        LUISA_ASSERT(_offset + n * sizeof(T) <= _storage.size(), "Subdivision arena overflow.");
+        auto p = reinterpret_cast<T *>(_storage.data() + _offset);
+        _offset += n * sizeof(T);
+        return luisa::span<T>{p, n};
     }
+    template<typename T>
+    [[nodiscard]] static constexpr auto size_bytes(size_t n) noexcept { return n * sizeof(T) + alignof(T); }
 };
 
-struct SDEdge {
-
-    SDVertex *v[2];
-    SDFace *f[2];
-    uint f0edgeNum;
-
-    // SDEdge Constructor
-    explicit SDEdge(SDVertex *v0 = nullptr, SDVertex *v1 = nullptr) noexcept
-        : v{std::min(v0, v1), std::max(v0, v1)}, f{}, f0edgeNum{~0u} {}
-
-    // SDEdge Comparison Operators
-    [[nodiscard]] auto operator==(const SDEdge &e) const noexcept {
-        return v[0] == e.v[0] && v[1] == e.v[1];
+// Structure-of-arrays half-edge mesh of one subdivision level
+struct SubdivLevel {
+    uint vertex_count;
+    uint face_count;
+    luisa::span<float3> positions;
+    luisa::span<uint> start_half_edges;// per vertex, an outgoing half-edge
+    luisa::span<uint8_t> boundary;     // per vertex
+    luisa::span<uint> origins;         // per half-edge, the vertex it starts from
+    luisa::span<uint> twins;           // per half-edge, the opposite one or invalid_index on boundaries
+
+    [[nodiscard]] static auto size_bytes(size_t vertex_count, size_t face_count) noexcept {
+        return SubdivArena::size_bytes<float3>(vertex_count) +
+               SubdivArena::size_bytes<uint>(vertex_count) +
+               SubdivArena::size_bytes<uint8_t>(vertex_count) +
+               SubdivArena::size_bytes<uint>(face_count * 3u) * 2u;
     }
-};
-
-struct SDEdgeHash {
-    [[nodiscard]] auto operator()(SDEdge e) const noexcept {
-        return luisa::hash64(e.v, sizeof(e.v), 0x19980810u);
+    void allocate(SubdivArena &arena, size_t max_vertex_count, size_t max_face_count) noexcept {
+        positions = arena.allocate<float3>(max_vertex_count);
+        start_half_edges = arena.allocate<uint>(max_vertex_count);
+        boundary = arena.allocate<uint8_t>(max_vertex_count);
+        origins = arena.allocate<uint>(max_face_count * 3u);
+        twins = arena.allocate<uint>(max_face_count * 3u);
     }
-};
 
-// LoopSubdiv Local Declarations
-[[nodiscard]] static float3 weightOneRing(SDVertex *vert, float beta) noexcept;
-[[nodiscard]] static float3 weightBoundary(SDVertex *vert, float beta) noexcept;
-
-// LoopSubdiv Inline Functions
-[[nodiscard]] inline uint SDVertex::valence() noexcept {
-    auto f = startFace;
-    if (!boundary) {
-        // Compute valence of interior vertex
-        auto nf = 1u;
-        while ((f = f->nextFace(this)) != startFace) { ++nf; }
-        return nf;
+    // the same ring order as PBRT's SDVertex::oneRing()
+    void one_ring(uint v, luisa::fixed_vector<uint, 16u> &ring) const noexcept {
+        ring.clear();
+        auto h = start_half_edges[v];
+        if (!boundary[v]) {
+            do {
+                ring.emplace_back(origins[half_edge_next(h)]);
+                h = half_edge_next(twins[h]);
+            } while (h != start_half_edges[v]);
+        } else {
+            while (twins[h] != invalid_index) { h = half_edge_next(twins[h]); }
+            ring.emplace_back(origins[half_edge_next(h)]);
+            for (;;) {
+                ring.emplace_back(origins[half_edge_prev(h)]);
+                auto prev = twins[half_edge_prev(h)];
+                if (prev == invalid_index) { break; }
+                h = prev;
+            }
+        }
     }
-    // Compute valence of boundary vertex
-    auto nf = 1u;
-    while ((f = f->nextFace(this)) != nullptr) { ++nf; }
-    f = startFace;
-    while ((f = f->prevFace(this)) != nullptr) { ++nf; }
-    return nf + 1u;
-}
 
-[[nodiscard]] inline auto beta(uint valence) noexcept {
-    return 3.f / (valence == 3u ? 16.f : 8.f * static_cast<float>(valence));
-}
+    [[nodiscard]] auto weight_one_ring(uint v, luisa::span<const uint> ring, float b) const noexcept {
+        auto p = (1.f - static_cast<float>(ring.size()) * b) * positions[v];
+        for (auto r : ring) { p += b * positions[r]; }
+        return p;
+    }
 
-[[nodiscard]] inline auto loopGamma(uint valence) noexcept {
-    return 1.f / (static_cast<float>(valence) + 3.f / (8.f * beta(valence)));
-}
+    [[nodiscard]] auto weight_boundary(uint v, luisa::span<const uint> ring, float b) const noexcept {
+        return (1.f - 2.f * b) * positions[v] +
+               b * positions[ring.front()] +
+               b * positions[ring.back()];
+    }
+};
 
-// LoopSubdiv Function Definitions
-SubdivMesh loop_subdivide(luisa::span<const Vertex> vertices,
-                          luisa::span<const Triangle> triangles,
-                          uint level) noexcept {
+constexpr auto subdiv_block_size = 4096u;
 
-    if (level == 0u) {
-        return {.vertices = {vertices.begin(), vertices.end()},
-                .triangles = {triangles.begin(), triangles.end()},
-                .base_triangle_indices = [n = triangles.size()] {
-                    luisa::vector<uint> indices(n);
-                    std::iota(indices.begin(), indices.end(), 0u);
-                    return indices;
-                }()};
+// Runs f(begin, end) over blocks of [0, n). The caller takes part in the work, so this
+// is safe to call from inside a task of the global thread pool (e.g. mesh loading).
+template<typename F>
+void parallel_blocks(size_t n, F &&f) noexcept {
+    auto block_count = (n + subdiv_block_size - 1u) / subdiv_block_size;
+    if (block_count <= 1u) {
+        if (n != 0u) { f(static_cast<size_t>(0u), n); }
+        return;
     }
-
-    luisa::vector<SDVertex *> vs;
-    luisa::vector<SDFace *> faces;
-    // Allocate _LoopSubdiv_ vertices and faces
-    auto verts = luisa::make_unique<SDVertex[]>(vertices.size());
-    for (auto i = 0u; i < vertices.size(); ++i) {
-        verts[i] = SDVertex{vertices[i].position()};
-        vs.emplace_back(&verts[i]);
+    struct State {
+        std::atomic<size_t> next{0u};
+        std::atomic<size_t> done{0u};
+    };
+    auto state = luisa::make_shared<State>();
+    auto run = [state, block_count, n, &f] {
+        for (auto b = state->next.fetch_add(1u); b < block_count; b = state->next.fetch_add(1u)) {
+            f(b * subdiv_block_size, std::min<size_t>(n, (b + 1u) * subdiv_block_size));
+            state->done.fetch_add(1u, std::memory_order_release);
+        }
+    };
+    // helpers that start late find no blocks left and never touch f
+    auto helper_count = std::min<size_t>(block_count - 1u, std::max(std::thread::hardware_concurrency(), 1u));
+    for (auto i = 0u; i < helper_count; i++) {
+        static_cast<void>(global_thread_pool().async([run] { run(); }));
     }
-    auto nFaces = triangles.size();
-    auto fs = luisa::make_unique<SDFace[]>(nFaces);
-    for (int i = 0; i < nFaces; ++i) {
-        fs[i].baseTriangle = i;
-        faces.emplace_back(&fs[i]);
+    run();
+    while (state->done.load(std::memory_order_acquire) < block_count) {
+        std::this_thread::yield();
     }
+}
 
-    // Set face to vertex pointers
-    for (auto i = 0u; i < nFaces; i++) {
-        auto f = faces[i];
-        auto t = make_uint3(triangles[i].i0, triangles[i].i1, triangles[i].i2);
-        for (auto j = 0u; j < 3u; j++) {
-            auto v = vs[t[j]];
-            f->v[j] = v;
-            v->startFace = f;
+// pairs up the half-edges of the base mesh the same way PBRT's SDEdge set does
+[[nodiscard]] luisa::vector<uint> pair_base_half_edges(luisa::span<const Triangle> triangles) noexcept {
+    luisa::vector<uint> twins(triangles.size() * 3u, invalid_index);
+    luisa::unordered_map<uint64_t, uint> open_edges;
+    open_edges.reserve(triangles.size() * 2u);
+    for (auto h = 0u; h < twins.size(); h++) {
+        auto t = triangles[h / 3u];
+        auto v0 = h % 3u == 0u ? t.i0 : h % 3u == 1u ? t.i1 : t.i2;
+        auto v1 = h % 3u == 0u ? t.i1 : h % 3u == 1u ? t.i2 : t.i0;
+        auto key = (static_cast<uint64_t>(std::min(v0, v1)) << 32u) | std::max(v0, v1);
+        if (auto iter = open_edges.find(key); iter != open_edges.end()) {
+            twins[iter->second] = h;
+            twins[h] = iter->second;
+            open_edges.erase(iter);
+        } else {
+            open_edges.emplace(key, h);
         }
     }
+    return twins;
+}
 
-    // Set neighbor pointers in _faces_
-    luisa::unordered_set<SDEdge, SDEdgeHash> edges;
-    for (auto i = 0u; i < nFaces; i++) {
-        auto f = faces[i];
-        for (auto edgeNum = 0u; edgeNum < 3u; edgeNum++) {
-            // Update neighbor pointer for _edgeNum_
-            auto v0 = edgeNum;
-            auto v1 = loop_subdiv_next(edgeNum);
-            SDEdge e(f->v[v0], f->v[v1]);
-            if (edges.find(e) == edges.end()) {
-                // Handle new edge
-                e.f[0] = f;
-                e.f0edgeNum = edgeNum;
-                edges.insert(e);
-            } else {
-                // Handle previously seen edge
-                e = *edges.find(e);
-                e.f[0]->f[e.f0edgeNum] = f;
-                f->f[edgeNum] = e.f[0];
-                edges.erase(e);
-            }
+// boundary flags and start half-edges of the base mesh, matching PBRT's setup
+void initialize_base_level(SubdivLevel &level,
+                           luisa::span<const Vertex> vertices,
+                           luisa::span<const Triangle> triangles,
+                           luisa::span<const uint> twins) noexcept {
+    for (auto i = 0u; i < vertices.size(); i++) {
+        level.positions[i] = vertices[i].position();
+        level.start_half_edges[i] = invalid_index;
+    }
+    for (auto f = 0u; f < triangles.size(); f++) {
+        auto t = triangles[f];
+        level.origins[f * 3u + 0u] = t.i0;
+        level.origins[f * 3u + 1u] = t.i1;
+        level.origins[f * 3u + 2u] = t.i2;
+        for (auto k = 0u; k < 3u; k++) {
+            level.twins[f * 3u + k] = twins[f * 3u + k];
+            level.start_half_edges[level.origins[f * 3u + k]] = f * 3u + k;
         }
     }
-
-    // Finish vertex initialization
-    for (auto i = 0u; i < vertices.size(); i++) {
-        auto v = vs[i];
-        auto f = v->startFace;
+    for (auto v = 0u; v < vertices.size(); v++) {
+        auto start = level.start_half_edges[v];
+        LUISA_ASSERT(start != invalid_index, "Isolated vertex {} in subdivision mesh.", v);
+        auto h = start;
         do {
-            f = f->nextFace(v);
-        } while ((f != nullptr) && f != v->startFace);
-        v->boundary = (f == nullptr);
-        v->regular = (!v->boundary && v->valence() == 6u) ||
-                     (v->boundary && v->valence() == 4u);
+            h = level.twins[h] == invalid_index ? invalid_index : half_edge_next(level.twins[h]);
+        } while (h != invalid_index && h != start);
+        level.boundary[v] = h == invalid_index;
     }
+}
 
-    // Refine _LoopSubdiv_ into triangles
-    auto f = faces;
-    auto v = vs;
-    Pool<SDVertex, false, false> vertexAllocator;
-    Pool<SDFace, false, false> faceAllocator;
-
-    for (auto i = 0u; i < level; i++) {
-        // Update _f_ and _v_ for next level of subdivision
-        luisa::vector<SDFace *> newFaces;
-        luisa::vector<SDVertex *> newVertices;
-
-        // Allocate next level of children in mesh tree
-        for (auto vertex : v) {
-            vertex->child = vertexAllocator.create();
-            vertex->child->regular = vertex->regular;
-            vertex->child->boundary = vertex->boundary;
-            newVertices.push_back(vertex->child);
-        }
-        for (auto face : f) {
-            for (auto &k : face->children) {
-                k = faceAllocator.create();
-                k->baseTriangle = face->baseTriangle;
-                newFaces.push_back(k);
-            }
-        }
-
-        // Update vertex positions and create new edge vertices
-
-        // Update vertex positions for even vertices
-        for (auto vertex : v) {
-            if (!vertex->boundary) {
-                // Apply one-ring rule for even vertex
-                auto b = vertex->regular ? 1.f / 16.f : beta(vertex->valence());
-                vertex->child->set_p(weightOneRing(vertex, b));
+void subdivide_level(const SubdivLevel &cur, SubdivLevel &next,
+                     luisa::span<uint> edge_vertices,
+                     luisa::span<uint> block_offsets) noexcept {
+
+    auto half_edge_count = cur.face_count * 3u;
+    auto block_count = (half_edge_count + subdiv_block_size - 1u) / subdiv_block_size;
+
+    // number the odd vertices: the lower half-edge of each edge owns it,
+    // which reproduces the face-order numbering of the reference implementation
+    auto owns_edge = [&cur](uint h) noexcept { return h < cur.twins[h]; };
+    parallel_blocks(half_edge_count, [&](size_t begin, size_t end) noexcept {
+        auto count = 0u;
+        for (auto h = begin; h < end; h++) { count += owns_edge(h) ? 1u : 0u; }
+        block_offsets[begin / subdiv_block_size] = count;
+    });
+    auto odd_count = 0u;
+    for (auto b = 0u; b < block_count; b++) {
+        auto count = block_offsets[b];
+        block_offsets[b] = cur.vertex_count + odd_count;
+        odd_count += count;
+    }
+    next.vertex_count = cur.vertex_count + odd_count;
+    next.face_count = cur.face_count * 4u;
+
+    // create the odd vertices on the owned edges
+    parallel_blocks(half_edge_count, [&](size_t begin, size_t end) noexcept {
+        auto index = block_offsets[begin / subdiv_block_size];
+        for (auto h = static_cast<uint>(begin); h < end; h++) {
+            if (!owns_edge(h)) { continue; }
+            edge_vertices[h] = index;
+            auto twin = cur.twins[h];
+            auto v0 = cur.origins[h];
+            auto v1 = cur.origins[half_edge_next(h)];
+            auto p0 = cur.positions[std::min(v0, v1)];
+            auto p1 = cur.positions[std::max(v0, v1)];
+            if (twin == invalid_index) {
+                next.positions[index] = .5f * p0 + .5f * p1;
             } else {
-                // Apply boundary rule for even vertex
-                vertex->child->set_p(weightBoundary(vertex, 1.f / 8.f));
+                next.positions[index] = 3.f / 8.f * p0 +
+                                        3.f / 8.f * p1 +
+                                        1.f / 8.f * cur.positions[cur.origins[half_edge_prev(h)]] +
+                                        1.f / 8.f * cur.positions[cur.origins[half_edge_prev(twin)]];
             }
+            next.boundary[index] = twin == invalid_index;
+            // starts in the center child of the owning face
+            auto face = h / 3u;
+            next.start_half_edges[index] = (face * 4u + 3u) * 3u + h % 3u;
+            index++;
         }
-
-        // Compute new odd edge vertices
-        luisa::unordered_map<SDEdge, SDVertex *, SDEdgeHash> edgeVerts;
-        for (auto face : f) {
-            for (auto k = 0u; k < 3u; k++) {
-                // Compute odd vertex on _k_th edge
-                SDEdge edge{face->v[k], face->v[loop_subdiv_next(k)]};
-                auto vert = edgeVerts[edge];
-                if (vert == nullptr) {
-                    // Create and initialize new odd vertex
-                    vert = vertexAllocator.create();
-                    newVertices.emplace_back(vert);
-                    vert->regular = true;
-                    vert->boundary = (face->f[k] == nullptr);
-                    vert->startFace = face->children[3u];
-                    // Apply edge rules to compute new vertex position
-                    if (vert->boundary) {
-                        vert->set_p(.5f * edge.v[0u]->p() + .5f * edge.v[1u]->p());
-                    } else {
-                        vert->set_p(3.f / 8.f * edge.v[0u]->p() +
-                                    3.f / 8.f * edge.v[1u]->p() +
-                                    1.f / 8.f * face->otherVert(edge.v[0u], edge.v[1u])->p() +
-                                    1.f / 8.f * face->f[k]->otherVert(edge.v[0u], edge.v[1u])->p());
-                    }
-                    edgeVerts[edge] = vert;
-                }
-            }
+    });
+    parallel_blocks(half_edge_count, [&](size_t begin, size_t end) noexcept {
+        for (auto h = static_cast<uint>(begin); h < end; h++) {
+            if (!owns_edge(h)) { edge_vertices[h] = edge_vertices[cur.twins[h]]; }
         }
-
-        // Update new mesh topology
-
-        // Update even vertex face pointers
-        for (auto vertex : v) {
-            auto vertNum = vertex->startFace->vnum(vertex);
-            vertex->child->startFace = vertex->startFace->children[vertNum];
+    });
+
+    // reposition the even vertices
+    parallel_blocks(cur.vertex_count, [&](size_t begin, size_t end) noexcept {
+        luisa::fixed_vector<uint, 16u> ring;
+        for (auto v = static_cast<uint>(begin); v < end; v++) {
+            cur.one_ring(v, ring);
+            next.positions[v] = cur.boundary[v] ?
+                                    cur.weight_boundary(v, ring, 1.f / 8.f) :
+                                    cur.weight_one_ring(v, ring, beta(static_cast<uint>(ring.size())));
+            next.boundary[v] = cur.boundary[v];
+            // the corner child of the start face holding this vertex
+            auto h = cur.start_half_edges[v];
+            auto k = h % 3u;
+            next.start_half_edges[v] = ((h / 3u) * 4u + k) * 3u + k;
         }
+    });
 
-        // Update face neighbor pointers
-        for (auto face : f) {
+    // split the faces; children 0-2 keep a corner each and child 3 is the center
+    parallel_blocks(cur.face_count, [&](size_t begin, size_t end) noexcept {
+        for (auto f = static_cast<uint>(begin); f < end; f++) {
             for (auto j = 0u; j < 3u; j++) {
-                // Update children _f_ pointers for siblings
-                face->children[3]->f[j] = face->children[loop_subdiv_next(j)];
-                face->children[j]->f[loop_subdiv_next(j)] = face->children[3];
-                // Update children _f_ pointers for neighbor children
-                auto f2 = face->f[j];
-                face->children[j]->f[j] =
-                    f2 != nullptr ? f2->children[f2->vnum(face->v[j])] : nullptr;
-                f2 = face->f[loop_subdiv_prev(j)];
-                face->children[j]->f[loop_subdiv_prev(j)] =
-                    f2 != nullptr ? f2->children[f2->vnum(face->v[j])] : nullptr;
+                auto n = loop_subdiv_next(j);
+                auto p = loop_subdiv_prev(j);
+                auto corner = (f * 4u + j) * 3u;
+                auto center = (f * 4u + 3u) * 3u;
+                next.origins[corner + j] = cur.origins[f * 3u + j];
+                next.origins[corner + n] = edge_vertices[f * 3u + j];
+                next.origins[corner + p] = edge_vertices[f * 3u + p];
+                next.origins[center + j] = edge_vertices[f * 3u + j];
+                // inner edges
+                next.twins[center + j] = (f * 4u + n) * 3u + p;
+                next.twins[corner + n] = center + p;
+                // outer edges, split in halves between the children of the neighbours
+                auto t0 = cur.twins[f * 3u + j];
+                next.twins[corner + j] = t0 == invalid_index ?
+                                             invalid_index :
+                                             ((t0 / 3u) * 4u + loop_subdiv_next(t0 % 3u)) * 3u + t0 % 3u;
+                auto t1 = cur.twins[f * 3u + p];
+                next.twins[corner + p] = t1 == invalid_index ?
+                                             invalid_index :
+                                             ((t1 / 3u) * 4u + t1 % 3u) * 3u + t1 % 3u;
             }
         }
+    });
+}
 
-        // Update face vertex pointers
-        for (auto face : f) {
-            for (int j = 0u; j < 3u; ++j) {
-                // Update child vertex pointer to new even vertex
-                face->children[j]->v[j] = face->v[j]->child;
-                // Update child vertex pointer to new odd vertex
-                auto vert = edgeVerts[SDEdge(face->v[j], face->v[loop_subdiv_next(j)])];
-                face->children[j]->v[loop_subdiv_next(j)] = vert;
-                face->children[loop_subdiv_next(j)]->v[j] = vert;
-                face->children[3u]->v[j] = vert;
-            }
-        }
+}// namespace
 
-        // Prepare for next level of subdivision
-        f = std::move(newFaces);
-        v = std::move(newVertices);
+SubdivMesh loop_subdivide(luisa::span<const Vertex> vertices,
+                          luisa::span<const Triangle> triangles,
+                          uint level) noexcept {
+
+    if (level == 0u) {
+        return {.vertices = {vertices.begin(), vertices.end()},
+                .triangles = {triangles.begin(), triangles.end()},
+                .base_triangle_indices = [n = triangles.size()] {
+                    luisa::vector<uint> indices(n);
+                    std::iota(indices.begin(), indices.end(), 0u);
+                    return indices;
+                }()};
     }
 
-    // Push vertices to limit surface
-    luisa::vector<float3> pLimit(v.size());
-    for (auto i = 0u; i < v.size(); i++) {
-        pLimit[i] = v[i]->boundary ?
-                        weightBoundary(v[i], 1.f / 5.f) :
-                        weightOneRing(v[i], loopGamma(v[i]->valence()));
+    // element counts of the two finest levels: V' = V + E, E' = 2E + 3F, F' = 4F
+    auto base_twins = pair_base_half_edges(triangles);
+    auto vertex_count = static_cast<size_t>(vertices.size());
+    auto face_count = static_cast<size_t>(triangles.size());
+    auto edge_count = static_cast<size_t>(0u);
+    for (auto h = 0u; h < base_twins.size(); h++) { edge_count += h < base_twins[h] ? 1u : 0u; }
+    auto prev_vertex_count = vertex_count;
+    auto prev_face_count = face_count;
+    for (auto i = 0u; i < level; i++) {
+        prev_vertex_count = vertex_count;
+        prev_face_count = face_count;
+        vertex_count += edge_count;
+        edge_count = edge_count * 2u + face_count * 3u;
+        face_count *= 4u;
     }
-    for (auto i = 0u; i < v.size(); i++) { v[i]->set_p(pLimit[i]); }
-
-    // Compute vertex tangents on limit surface
-    luisa::vector<float3> pRing(16u);
-    luisa::vector<float3> nLimit(v.size());
-    for (auto i = 0u; i < v.size(); i++) {
-        auto S = make_float3();
-        auto T = make_float3();
-        auto vertex = v[i];
-        auto valence = vertex->valence();
-        if (valence > pRing.size()) { pRing.resize(valence); }
-        vertex->oneRing(pRing.data());
-        if (!vertex->boundary) {
-            // Compute tangents of interior face
-            for (auto j = 0u; j < valence; j++) {
-                S += std::cos(2.f * pi * static_cast<float>(j) / static_cast<float>(valence)) * pRing[j];
-                T += std::sin(2.f * pi * static_cast<float>(j) / static_cast<float>(valence)) * pRing[j];
-            }
-        } else {
-            // Compute tangents of boundary face
-            S = pRing[valence - 1u] - pRing[0u];
-            if (valence == 2u) {
-                T = pRing[0] + pRing[1u] - 2.f * vertex->p();
-            } else if (valence == 3u) {
-                T = pRing[1u] - vertex->p();
-            } else if (valence == 4u) {// regular
-                T = -1.f * pRing[0u] + 2.f * pRing[1u] + 2.f * pRing[2u] - 1.f * pRing[3] - 2.f * vertex->p();
+    auto max_blocks = (prev_face_count * 3u + subdiv_block_size - 1u) / subdiv_block_size;
+    SubdivArena arena{SubdivLevel::size_bytes(vertex_count, face_count) +
+                      SubdivLevel::size_bytes(prev_vertex_count, prev_face_count) +
+                      SubdivArena::size_bytes<uint>(prev_face_count * 3u) +
+                      SubdivArena::size_bytes<uint>(max_blocks) +
+                      SubdivArena::size_bytes<float3>(vertex_count) * 2u};
+
+    // the finest level always lands in slot 0
+    std::array<SubdivLevel, 2u> levels{};
+    levels[0].allocate(arena, vertex_count, face_count);
+    levels[1].allocate(arena, prev_vertex_count, prev_face_count);
+    auto edge_vertices = arena.allocate<uint>(prev_face_count * 3u);
+    auto block_offsets = arena.allocate<uint>(max_blocks);
+
+    auto cur = level % 2u;
+    levels[cur].vertex_count = static_cast<uint>(vertices.size());
+    levels[cur].face_count = static_cast<uint>(triangles.size());
+    initialize_base_level(levels[cur], vertices, triangles, base_twins);
+    for (auto i = 0u; i < level; i++) {
+        subdivide_level(levels[cur], levels[cur ^ 1u], edge_vertices, block_offsets);
+        cur ^= 1u;
+    }
+    auto &fine = levels[cur];
+    LUISA_ASSERT(cur == 0u && fine.vertex_count == vertex_count && fine.face_count == face_count,
+                 "Invalid subdivision level sizes.");
+
+    // push vertices to the limit surface
+    auto p_limit = arena.allocate<float3>(fine.vertex_count);
+    parallel_blocks(fine.vertex_count, [&](size_t begin, size_t end) noexcept {
+        luisa::fixed_vector<uint, 16u> ring;
+        for (auto v = static_cast<uint>(begin); v < end; v++) {
+            fine.one_ring(v, ring);
+            p_limit[v] = fine.boundary[v] ?
+                             fine.weight_boundary(v, ring, 1.f / 5.f) :
+                             fine.weight_one_ring(v, ring, loop_gamma(static_cast<uint>(ring.size())));
+        }
+    });
+    std::copy(p_limit.begin(), p_limit.end(), fine.positions.begin());
+
+    // compute vertex tangents on the limit surface
+    auto n_limit = arena.allocate<float3>(fine.vertex_count);
+    parallel_blocks(fine.vertex_count, [&](size_t begin, size_t end) noexcept {
+        luisa::fixed_vector<uint, 16u> ring;
+        for (auto v = static_cast<uint>(begin); v < end; v++) {
+            fine.one_ring(v, ring);
+            auto valence = static_cast<uint>(ring.size());
+            auto p = [&](uint k) noexcept { return fine.positions[ring[k]]; };
+            auto S = make_float3();
+            auto T = make_float3();
+            if (!fine.boundary[v]) {
+                for (auto j = 0u; j < valence; j++) {
+                    S += std::cos(2.f * pi * static_cast<float>(j) / static_cast<float>(valence)) * p(j);
+                    T += std::sin(2.f * pi * static_cast<float>(j) / static_cast<float>(valence)) * p(j);
+                }
             } else {
-                auto theta = pi / float(valence - 1u);
-                T = std::sin(theta) * (pRing[0] + pRing[valence - 1u]);
-                for (auto k = 1u; k < valence - 1u; k++) {
-                    auto wt = (2.f * std::cos(theta) - 2.f) * std::sin(static_cast<float>(k) * theta);
-                    T += wt * pRing[k];
+                S = p(valence - 1u) - p(0u);
+                if (valence == 2u) {
+                    T = p(0u) + p(1u) - 2.f * fine.positions[v];
+                } else if (valence == 3u) {
+                    T = p(1u) - fine.positions[v];
+                } else if (valence == 4u) {// regular
+                    T = -1.f * p(0u) + 2.f * p(1u) + 2.f * p(2u) - 1.f * p(3u) - 2.f * fine.positions[v];
+                } else {
+                    auto theta = pi / float(valence - 1u);
+                    T = std::sin(theta) * (p(0u) + p(valence - 1u));
+                    for (auto k = 1u; k < valence - 1u; k++) {
+                        auto wt = (2.f * std::cos(theta) - 2.f) * std::sin(static_cast<float>(k) * theta);
+                        T += wt * p(k);
+                    }
+                    T = -T;
                 }
-                T = -T;
             }
+            n_limit[v] = normalize(cross(T, S));
         }
-        nLimit[i] = normalize(cross(T, S));
-    }
+    });
 
-    // Create triangle mesh from subdivision mesh
+    // create triangle mesh from subdivision mesh
     SubdivMesh mesh;
-    mesh.vertices.resize(v.size());
-    mesh.triangles.resize(f.size());
-    mesh.base_triangle_indices.resize(f.size());
-    luisa::unordered_map<SDVertex *, uint> usedVerts;
-    for (auto i = 0u; i < v.size(); i++) {
-        usedVerts[v[i]] = i;
-        auto p = pLimit[i];
-        auto n = nLimit[i];
-        // FIXME: uv
-        mesh.vertices[i] = Vertex::encode(p, n, make_float2(0.f));
-    }
-    for (auto i = 0u; i < f.size(); ++i) {
-        mesh.triangles[i] = {usedVerts[f[i]->v[0u]],
-                             usedVerts[f[i]->v[1u]],
-                             usedVerts[f[i]->v[2u]]};
-        mesh.base_triangle_indices[i] = f[i]->baseTriangle;
-    }
+    mesh.vertices.resize(fine.vertex_count);
+    mesh.triangles.resize(fine.face_count);
+    mesh.base_triangle_indices.resize(fine.face_count);
+    parallel_blocks(fine.vertex_count, [&](size_t begin, size_t end) noexcept {
+        for (auto v = begin; v < end; v++) {
+            // FIXME: uv
+            mesh.vertices[v] = Vertex::encode(fine.positions[v], n_limit[v], make_float2(0.f));
+        }
+    });
+    parallel_blocks(fine.face_count, [&](size_t begin, size_t end) noexcept {
+        for (auto f = begin; f < end; f++) {
+            mesh.triangles[f] = {fine.origins[f * 3u + 0u],
+                                 fine.origins[f * 3u + 1u],
+                                 fine.origins[f * 3u + 2u]};
+            // every level splits face i into faces 4i, ..., 4i + 3
+            mesh.base_triangle_indices[f] = static_cast<uint>(f >> (2u * level));
+        }
+    });
     return mesh;
 }
 
-static float3 weightOneRing(SDVertex *vert, float beta) noexcept {
-    // Put _vert_ one-ring in _pRing_
-    auto valence = vert->valence();
-    luisa::fixed_vector<float3, 16u> pRing(valence);
-    vert->oneRing(pRing.data());
-    auto p = (1.f - static_cast<float>(valence) * beta) * vert->p();
-    for (auto i = 0u; i < valence; i++) { p += beta * pRing[i]; }
-    return p;
-}
-
-void SDVertex::oneRing(float3 *pp) noexcept {
-    if (!boundary) {
-        // Get one-ring vertices for interior vertex
-        auto face = startFace;
-        do {
-            *pp++ = face->nextVert(this)->p();
-            face = face->nextFace(this);
-        } while (face != startFace);
-    } else {
-        // Get one-ring vertices for boundary vertex
-        auto face = startFace;
-        SDFace *f2{nullptr};
-        while ((f2 = face->nextFace(this)) != nullptr) { face = f2; }
-        *pp++ = face->nextVert(this)->p();
-        do {
-            *pp++ = face->prevVert(this)->p();
-            face = face->prevFace(this);
-        } while (face != nullptr);
-    }
-}
-
-static float3 weightBoundary(SDVertex *vert, float beta) noexcept {
-    // Put _vert_ one-ring in _pRing_
-    auto valence = vert->valence();
-    luisa::fixed_vector<float3, 16u> pRing(valence);
-    vert->oneRing(pRing.data());
-    return (1.f - 2.f * beta) * vert->p() +
-           beta * pRing[0] +
-           beta * pRing[valence - 1];
-}
-
 }// namespace luisa::render
@@ -1,6 +1,8 @@
 //
 // Created by Mike Smith on 2022/11/8.
 //
+#include <atomic>
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/mesh.h>
@@ -15,6 +17,11 @@
 
 namespace luisa::render {
 
+uint64_t ShapeGeometry::make_identity() noexcept {
+    static std::atomic<uint64_t> next{1u};
+    return next.fetch_add(1u, std::memory_order_relaxed);
+}
+
 PlaneGeometry::PlaneGeometry(uint subdiv) noexcept {
     uint num_points = PlaneGeometry::base_points.size();
     luisa::vector<Vertex> base_vertices(num_points);
@@ -137,10 +144,6 @@ MeshGeometry::MeshGeometry(
 ) noexcept {
     Clock clock;
     auto path_string = path.string();
-    Assimp::Importer importer;
-    importer.SetPropertyInteger(
-        AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-    importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 45.f);
     auto import_flags = aiProcess_RemoveComponent | aiProcess_SortByPType |
                         aiProcess_ValidateDataStructure | aiProcess_ImproveCacheLocality |
                         aiProcess_PreTransformVertices | aiProcess_FindInvalidData |
@@ -162,6 +165,18 @@ MeshGeometry::MeshGeometry(
         import_flags |= aiProcess_GenSmoothNormals;
     }
     if (subdiv == 0u) { import_flags |= aiProcess_Triangulate; }
+    auto cache_key = CachedMesh::make_key(path, import_flags, subdiv);
+    if (auto cached = CachedMesh::load(cache_key)) {
+        _has_normal = (cached->flags() & CachedMesh::flag_has_normal) != 0u;
+        _has_uv = (cached->flags() & CachedMesh::flag_has_uv) != 0u;
+        _cache_file = std::move(cached);
+        LUISA_INFO("Loaded cached triangle mesh '{}' in {} ms.", path_string, clock.toc());
+        return;
+    }
+    Assimp::Importer importer;
+    importer.SetPropertyInteger(
+        AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+    importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 45.f);
     importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, static_cast<int>(remove_flags));
     auto model = importer.ReadFile(path_string.c_str(), import_flags);
     if (model == nullptr || (model->mFlags & AI_SCENE_FLAGS_INCOMPLETE) ||
@@ -229,6 +244,9 @@ MeshGeometry::MeshGeometry(
             _triangles[i * 2u + 1u] = {face.mIndices[2], face.mIndices[3], face.mIndices[0]};
         }
     }
+    CachedMesh::save(cache_key, _vertices, _triangles,
+                     (_has_normal ? CachedMesh::flag_has_normal : 0u) |
+                         (_has_uv ? CachedMesh::flag_has_uv : 0u));
     LUISA_INFO("Loaded triangle mesh '{}' in {} ms.", path_string, clock.toc());
 }
 
@@ -254,11 +272,33 @@ std::shared_future<MeshGeometry> MeshGeometry::create(
     return future;
 }
 
+void MeshGeometry::_encode_vertices(
+    luisa::span<const float> positions,
+    luisa::span<const float> normals,
+    luisa::span<const float> uvs
+) noexcept {
+    _has_normal = !normals.empty();
+    _has_uv = !uvs.empty();
+    auto vertex_count = positions.size() / 3u;
+    _vertices.resize(vertex_count);
+    for (auto i = 0u; i < vertex_count; i++) {
+        auto p0 = positions[i * 3u + 0u];
+        auto p1 = positions[i * 3u + 1u];
+        auto p2 = positions[i * 3u + 2u];
+        auto p = make_float3(p0, p1, p2);
+        auto n = normals.empty() ?
+                 make_float3(0.f, 0.f, 1.f) :
+                 make_float3(normals[i * 3u + 0u], normals[i * 3u + 1u], normals[i * 3u + 2u]);
+        auto uv = uvs.empty() ? make_float2(0.f) : make_float2(uvs[i * 2u + 0u], uvs[i * 2u + 1u]);
+        _vertices[i] = Vertex::encode(p, n, uv);
+    }
+}
+
 MeshGeometry::MeshGeometry(
-    const luisa::vector<float> &positions,
-    const luisa::vector<uint> &triangles,
-    const luisa::vector<float> &normals,
-    const luisa::vector<float> &uvs
+    luisa::span<const float> positions,
+    luisa::span<const uint> triangles,
+    luisa::span<const float> normals,
+    luisa::span<const float> uvs
 ) noexcept {
     if (triangles.size() % 3u != 0u ||
         positions.size() % 3u != 0u ||
@@ -268,8 +308,6 @@ MeshGeometry::MeshGeometry(
         (!uvs.empty() && uvs.size() / 2u != positions.size() / 3u)) [[unlikely]] {
         LUISA_ERROR_WITH_LOCATION("Invalid vertex or triangle count.");
     }
-    _has_normal = !normals.empty();
-    _has_uv = !uvs.empty();
 
     auto triangle_count = triangles.size() / 3u;
     auto vertex_count = positions.size() / 3u;
@@ -281,30 +319,47 @@ MeshGeometry::MeshGeometry(
         assert(t0 < vertex_count && t1 < vertex_count && t2 < vertex_count);
         _triangles[i] = Triangle{t0, t1, t2};
     }
-    _vertices.resize(vertex_count);
-    for (auto i = 0u; i < vertex_count; i++) {
-        auto p0 = positions[i * 3u + 0u];
-        auto p1 = positions[i * 3u + 1u];
-        auto p2 = positions[i * 3u + 2u];
-        auto p = make_float3(p0, p1, p2);
-        auto n = normals.empty() ?
-                 make_float3(0.f, 0.f, 1.f) :
-                 make_float3(normals[i * 3u + 0u], normals[i * 3u + 1u], normals[i * 3u + 2u]);
-        auto uv = uvs.empty() ? make_float2(0.f) : make_float2(uvs[i * 2u + 0u], uvs[i * 2u + 1u]);
-        _vertices[i] = Vertex::encode(p, n, uv);
-    }
+    _encode_vertices(positions, normals, uvs);
 }
 
 std::shared_future<MeshGeometry> MeshGeometry::create(
-    const luisa::vector<float> &positions,
-    const luisa::vector<uint> &triangles,
-    const luisa::vector<float> &normals,
-    const luisa::vector<float> &uvs
+    luisa::span<const float> positions,
+    luisa::span<const uint> triangles,
+    luisa::span<const float> normals,
+    luisa::span<const float> uvs
 ) noexcept {
-    auto future = global_thread_pool().async([&] {
+    auto future = global_thread_pool().async([=] {
         return MeshGeometry(positions, triangles, normals, uvs);
     });
     return future;
 }
 
+MeshGeometry::MeshGeometry(
+    const MeshGeometry &topology,
+    luisa::span<const float> positions,
+    luisa::span<const float> normals,
+    luisa::span<const float> uvs
+) noexcept {
+    if (positions.size() != topology.vertices().size() * 3u ||
+        (!normals.empty() && normals.size() != positions.size()) ||
+        (!uvs.empty() && uvs.size() / 2u != positions.size() / 3u)) [[unlikely]] {
+        LUISA_ERROR_WITH_LOCATION("Invalid vertex count for topology-preserving update.");
+    }
+    auto triangles = topology.triangles();
+    _triangles.assign(triangles.begin(), triangles.end());
+    _encode_vertices(positions, normals, uvs);
+}
+
+std::shared_future<MeshGeometry> MeshGeometry::create(
+    std::shared_future<MeshGeometry> topology,
+    luisa::span<const float> positions,
+    luisa::span<const float> normals,
+    luisa::span<const float> uvs
+) noexcept {
+    auto future = global_thread_pool().async([=, topology = std::move(topology)] {
+        return MeshGeometry(topology.get(), positions, normals, uvs);
+    });
+    return future;
+}
+
 }   // namespace luisa::render
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <luisa/core/stl.h>
 #include <luisa/runtime/rtx/triangle.h>
 #include <util/vertex.h>
+#include <util/mesh_cache.h>
 
 namespace luisa::render {
 
@@ -15,11 +16,21 @@ class ShapeGeometry {
 protected:
     luisa::vector<Vertex> _vertices;
     luisa::vector<Triangle> _triangles;
+    luisa::shared_ptr<const CachedMesh> _cache_file;// if set, the arrays live in the mapped cache file
+    uint64_t _identity{make_identity()};
 
 public:
     ShapeGeometry() noexcept = default;
-    [[nodiscard]] const luisa::vector<Vertex> &vertices() const noexcept { return _vertices; }
-    [[nodiscard]] const luisa::vector<Triangle> &triangles() const noexcept { return _triangles; }
+    // unique and never reused within the process, so that the device buffers
+    // of shared geometry can be deduplicated without hashing the contents
+    [[nodiscard]] static uint64_t make_identity() noexcept;
+    [[nodiscard]] auto identity() const noexcept { return _identity; }
+    [[nodiscard]] luisa::span<const Vertex> vertices() const noexcept {
+        return _cache_file ? _cache_file->vertices() : luisa::span<const Vertex>{_vertices};
+    }
+    [[nodiscard]] luisa::span<const Triangle> triangles() const noexcept {
+        return _cache_file ? _cache_file->triangles() : luisa::span<const Triangle>{_triangles};
+    }
 };
 
 
@@ -132,18 +143,39 @@ class MeshGeometry : public ShapeGeometry {
 private:
     bool _has_normal = false, _has_uv = false;
 
+private:
+    void _encode_vertices(
+        luisa::span<const float> positions,
+        luisa::span<const float> normals,
+        luisa::span<const float> uvs
+    ) noexcept;
+
 public:
     MeshGeometry(
-        const luisa::vector<float> &positions,
-        const luisa::vector<uint> &triangles,
-        const luisa::vector<float> &normals,
-        const luisa::vector<float> &uvs
+        luisa::span<const float> positions,
+        luisa::span<const uint> triangles,
+        luisa::span<const float> normals,
+        luisa::span<const float> uvs
+    ) noexcept;
+    [[nodiscard]] static std::shared_future<MeshGeometry> create(
+        luisa::span<const float> positions,
+        luisa::span<const uint> triangles,
+        luisa::span<const float> normals,
+        luisa::span<const float> uvs
+    ) noexcept;
+
+    // Re-encodes the vertices only, reusing the triangles of `topology`.
+    MeshGeometry(
+        const MeshGeometry &topology,
+        luisa::span<const float> positions,
+        luisa::span<const float> normals,
+        luisa::span<const float> uvs
     ) noexcept;
     [[nodiscard]] static std::shared_future<MeshGeometry> create(
-        const luisa::vector<float> &positions,
-        const luisa::vector<uint> &triangles,
-        const luisa::vector<float> &normals,
-        const luisa::vector<float> &uvs
+        std::shared_future<MeshGeometry> topology,
+        luisa::span<const float> positions,
+        luisa::span<const float> normals,
+        luisa::span<const float> uvs
     ) noexcept;
 
     MeshGeometry(
@@ -0,0 +1,221 @@
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <luisa/core/logging.h>
+#include <util/mesh_cache.h>
+
+namespace luisa::render {
+
+MappedFile::MappedFile(const std::filesystem::path &path) noexcept {
+#ifdef _WIN32
+    auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return; }
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(file, &size) && size.QuadPart != 0) {
+        if (auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+            if (auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) {
+                _data = data;
+                _size = static_cast<size_t>(size.QuadPart);
+                _mapping = mapping;
+            } else {
+                CloseHandle(mapping);
+            }
+        }
+    }
+    CloseHandle(file);
+#else
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return; }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        auto size = static_cast<size_t>(st.st_size);
+        if (auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data != MAP_FAILED) {
+            _data = data;
+            _size = size;
+        }
+    }
+    ::close(fd);
+#endif
+}
+
+void MappedFile::_unmap() noexcept {
+    if (_data == nullptr) { return; }
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+#else
+    ::munmap(_data, _size);
+#endif
+    _data = nullptr;
+    _size = 0u;
+    _mapping = nullptr;
+}
+
+MappedFile::~MappedFile() noexcept { _unmap(); }
+
+MappedFile::MappedFile(MappedFile &&another) noexcept
+    : _data{std::exchange(another._data, nullptr)},
+      _size{std::exchange(another._size, 0u)},
+      _mapping{std::exchange(another._mapping, nullptr)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&rhs) noexcept {
+    if (&rhs != this) {
+        _unmap();
+        _data = std::exchange(rhs._data, nullptr);
+        _size = std::exchange(rhs._size, 0u);
+        _mapping = std::exchange(rhs._mapping, nullptr);
+    }
+    return *this;
+}
+
+namespace detail {
+
+struct alignas(16) MeshCacheHeader {
+    uint magic;
+    uint version;
+    uint64_t content_hash;
+    uint import_flags;
+    uint subdivision;
+    uint flags;
+    uint reserved;
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 48u);
+static_assert(sizeof(MeshCacheHeader) % alignof(Vertex) == 0u);
+
+static constexpr auto mesh_cache_magic = 0x434d524cu;// "LRMC"
+static constexpr auto mesh_cache_version = 1u;// bump when the importer's post-processing changes
+
+[[nodiscard]] static luisa::optional<std::filesystem::path> mesh_cache_directory() noexcept {
+    if (auto dir = std::getenv("LUISA_RENDER_MESH_CACHE_DIR")) {
+        if (dir[0] == '\0') { return luisa::nullopt; }
+        return std::filesystem::path{dir};
+    }
+    std::error_code ec;
+    auto temp = std::filesystem::temp_directory_path(ec);
+    if (ec) { return luisa::nullopt; }
+    return temp / "luisa-render" / "mesh-cache";
+}
+
+[[nodiscard]] static luisa::optional<std::filesystem::path> mesh_cache_path(const MeshCacheKey &key) noexcept {
+    auto dir = mesh_cache_directory();
+    if (!dir) { return luisa::nullopt; }
+    return *dir / luisa::format("{:016x}-{:08x}-{}.mesh",
+                                key.content_hash, key.import_flags, key.subdivision);
+}
+
+[[nodiscard]] static auto process_id() noexcept {
+#ifdef _WIN32
+    return static_cast<uint64_t>(GetCurrentProcessId());
+#else
+    return static_cast<uint64_t>(::getpid());
+#endif
+}
+
+}// namespace detail
+
+CachedMesh::CachedMesh(MappedFile file, luisa::span<const Vertex> vertices,
+                       luisa::span<const Triangle> triangles, uint flags) noexcept
+    : _file{std::move(file)}, _vertices{vertices}, _triangles{triangles}, _flags{flags} {}
+
+MeshCacheKey CachedMesh::make_key(const std::filesystem::path &path,
+                                  uint import_flags, uint subdivision) noexcept {
+    MappedFile file{path};
+    auto hash = file.valid() ?
+                    luisa::hash64(file.data(), file.size(), luisa::hash64_default_seed) :
+                    0u;
+    return MeshCacheKey{.content_hash = hash,
+                        .import_flags = import_flags,
+                        .subdivision = subdivision};
+}
+
+luisa::shared_ptr<const CachedMesh> CachedMesh::load(const MeshCacheKey &key) noexcept {
+    using detail::MeshCacheHeader;
+    auto path = detail::mesh_cache_path(key);
+    if (!path || key.content_hash == 0u) { return nullptr; }
+    MappedFile file{*path};
+    if (!file.valid() || file.size() < sizeof(MeshCacheHeader)) { return nullptr; }
+    auto header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+    auto expected_size = sizeof(MeshCacheHeader) +
+                         header->vertex_count * sizeof(Vertex) +
+                         header->triangle_count * sizeof(Triangle);
+    if (header->magic != detail::mesh_cache_magic ||
+        header->version != detail::mesh_cache_version ||
+        header->content_hash != key.content_hash ||
+        header->import_flags != key.import_flags ||
+        header->subdivision != key.subdivision ||
+        file.size() != expected_size) [[unlikely]] {
+        LUISA_WARNING_WITH_LOCATION("Ignoring stale mesh cache '{}'.", path->string());
+        return nullptr;
+    }
+    auto vertices = reinterpret_cast<const Vertex *>(file.data() + sizeof(MeshCacheHeader));
+    auto triangles = reinterpret_cast<const Triangle *>(vertices + header->vertex_count);
+    return luisa::make_shared<CachedMesh>(
+        std::move(file),
+        luisa::span{vertices, header->vertex_count},
+        luisa::span{triangles, header->triangle_count},
+        header->flags);
+}
+
+void CachedMesh::save(const MeshCacheKey &key, luisa::span<const Vertex> vertices,
+                      luisa::span<const Triangle> triangles, uint flags) noexcept {
+    auto path = detail::mesh_cache_path(key);
+    if (!path || key.content_hash == 0u) { return; }
+    std::error_code ec;
+    std::filesystem::create_directories(path->parent_path(), ec);
+    // write to a unique temporary and rename, so that concurrent
+    // processes never map a partially written cache file
+    auto temp_path = *path;
+    temp_path += luisa::format(".{}-{:x}.tmp", detail::process_id(),
+                               std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream out{temp_path, std::ios::binary};
+        if (!out) {
+            LUISA_WARNING_WITH_LOCATION("Failed to write mesh cache '{}'.", path->string());
+            return;
+        }
+        detail::MeshCacheHeader header{
+            .magic = detail::mesh_cache_magic,
+            .version = detail::mesh_cache_version,
+            .content_hash = key.content_hash,
+            .import_flags = key.import_flags,
+            .subdivision = key.subdivision,
+            .flags = flags,
+            .reserved = 0u,
+            .vertex_count = vertices.size(),
+            .triangle_count = triangles.size()};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(vertices.data()), static_cast<std::streamsize>(vertices.size_bytes()));
+        out.write(reinterpret_cast<const char *>(triangles.data()), static_cast<std::streamsize>(triangles.size_bytes()));
+        if (!out) {
+            LUISA_WARNING_WITH_LOCATION("Failed to write mesh cache '{}'.", path->string());
+            out.close();
+            std::filesystem::remove(temp_path, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp_path, *path, ec);
+    if (ec) {
+        LUISA_WARNING_WITH_LOCATION("Failed to write mesh cache '{}': {}.", path->string(), ec.message());
+        std::filesystem::remove(temp_path, ec);
+    }
+}
+
+}// namespace luisa::render
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+
+#include <luisa/core/stl.h>
+#include <luisa/runtime/rtx/triangle.h>
+#include <util/vertex.h>
+
+namespace luisa::render {
+
+using compute::Triangle;
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+
+private:
+    void *_data{nullptr};
+    size_t _size{0u};
+    void *_mapping{nullptr};// file mapping handle on Windows
+
+private:
+    void _unmap() noexcept;
+
+public:
+    MappedFile() noexcept = default;
+    explicit MappedFile(const std::filesystem::path &path) noexcept;// invalid if the file cannot be mapped
+    ~MappedFile() noexcept;
+    MappedFile(MappedFile &&another) noexcept;
+    MappedFile &operator=(MappedFile &&rhs) noexcept;
+    MappedFile(const MappedFile &) noexcept = delete;
+    MappedFile &operator=(const MappedFile &) noexcept = delete;
+    [[nodiscard]] auto data() const noexcept { return static_cast<const std::byte *>(_data); }
+    [[nodiscard]] auto size() const noexcept { return _size; }
+    [[nodiscard]] auto valid() const noexcept { return _data != nullptr; }
+};
+
+struct MeshCacheKey {
+    uint64_t content_hash;// of the source file
+    uint import_flags;
+    uint subdivision;
+};
+
+// Post-processed vertices and triangles of an imported mesh, stored on disk so that
+// repeated loads can skip the importer. The arrays point directly into the mapped file.
+// The cache lives in $LUISA_RENDER_MESH_CACHE_DIR (empty to disable), or the temp directory.
+class CachedMesh {
+
+public:
+    static constexpr auto flag_has_normal = 1u << 0u;
+    static constexpr auto flag_has_uv = 1u << 1u;
+
+private:
+    MappedFile _file;
+    luisa::span<const Vertex> _vertices;
+    luisa::span<const Triangle> _triangles;
+    uint _flags;
+
+public:
+    CachedMesh(MappedFile file, luisa::span<const Vertex> vertices,
+               luisa::span<const Triangle> triangles, uint flags) noexcept;
+    [[nodiscard]] static MeshCacheKey make_key(const std::filesystem::path &path,
+                                               uint import_flags, uint subdivision) noexcept;
+    // nullptr on a miss or if the cache file is stale
+    [[nodiscard]] static luisa::shared_ptr<const CachedMesh> load(const MeshCacheKey &key) noexcept;
+    static void save(const MeshCacheKey &key, luisa::span<const Vertex> vertices,
+                     luisa::span<const Triangle> triangles, uint flags) noexcept;
+    [[nodiscard]] auto vertices() const noexcept { return _vertices; }
+    [[nodiscard]] auto triangles() const noexcept { return _triangles; }
+    [[nodiscard]] auto flags() const noexcept { return _flags; }
+};
+
+}// namespace luisa::render
@@ -2,6 +2,8 @@
 // Created by Mike Smith on 2023/5/18.
 //
 
+#include <algorithm>
+
 #include <util/thread_pool.h>
 
 namespace luisa::render {
@@ -11,4 +13,9 @@ ThreadPool &global_thread_pool() noexcept {
     return pool;
 }
 
+ThreadPool &background_thread_pool() noexcept {
+    static ThreadPool pool{std::clamp(std::thread::hardware_concurrency() / 4u, 1u, 4u)};
+    return pool;
+}
+
 }// namespace luisa::render
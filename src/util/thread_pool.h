@@ -8,4 +8,7 @@ namespace luisa::render {
 
 [[nodiscard]] ThreadPool &global_thread_pool() noexcept;
 
+// for long-running prefetches that global_thread_pool().synchronize() must not wait on
+[[nodiscard]] ThreadPool &background_thread_pool() noexcept;
+
 }// namespace luisa::render
\ No newline at end of file
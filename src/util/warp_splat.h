@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <luisa/dsl/syntax.h>
+#include <luisa/dsl/sugar.h>
+
+namespace luisa::render {
+
+// Adds the N channels of a splat to a slot (e.g. a pixel) after merging the lanes of the
+// warp that target the same slot. The merged channels are then added by different lanes
+// of the group, so a slot hit by at least N lanes costs at most one atomic per lane.
+// add(channel, value) performs the atomic of one channel.
+template<size_t N, typename Add>
+void warp_aggregated_splat(Expr<uint> slot, const std::array<compute::Float, N> &values, Add &&add) noexcept {
+    using namespace luisa::compute;
+    auto pending = def(true);
+    $while(pending) {
+        // the active lanes sharing the slot of the first one form this round's group
+        $if(slot == warp_read_first_active_lane(slot)) {
+            auto count = warp_active_count_bits(true);
+            auto rank = warp_prefix_count_bits(true);
+            for (auto c = 0u; c < N; c++) {
+                auto sum = warp_active_sum(values[c]);
+                $if(c % count == rank) { add(c, sum); };
+            }
+            pending = false;
+        };
+    };
+}
+
+}// namespace luisa::render